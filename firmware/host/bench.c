@@ -0,0 +1,344 @@
+/*
+ * bench.c
+ *
+ * Scripted test bench: runs a scenario script against the firmware on the host simulation, and
+ * checks the heater, the state and the text on the display at given times
+ *
+ * Usage: opensolder_bench [--verbose] script
+ * Exits with 1 if a check failed, and 2 if a script can't be read.
+ *
+ * - SCRIPTS -
+ * A script is a list of statements, separated by newlines or ';'. # starts a comment. Each statement
+ * is "at t=<time> <command>", with the time in ms, s or min since power up, in increasing order.
+ * Statements at t=0s set the inputs before the firmware boots, and statements during the splash
+ * screen (about 1.2s) run when it ends. Example:
+ *
+ *   at t=2s lift tool; at t=10s rotate encoder +6; at t=30s inject 20 W load; at t=60s remove tip
+ *   at t=61s expect state TIP_CHANGE; at t=61s expect display "Insert tip"
+ *
+ * Inputs:
+ *   lift tool, place tool                  Tool out of or in the holder
+ *   rotate encoder <+-steps>
+ *   press button, release button
+ *   touch tip change, release tip change   Tip change bracket
+ *   remove tip, insert tip
+ *   remove ac, restore ac
+ *   inject <watts> W load, remove load     Heat drawn from the tip by soldering
+ *   set pcb temp <celsius> C
+ *   inject fault <name>, clear fault <name>  Peripheral fault of sim_set_fault(): adc-noise, adc-open,
+ *                                          dma-drop, timer-delay, i2c-fail or zc-loss
+ * Checks:
+ *   expect state <INIT|TIP_CHANGE|OFF|ON|STANDBY|ERROR>
+ *   expect heater <on|off>                 Heater pin right now
+ *   expect heater duty <min>..<max>% over <time>
+ *   expect display "<text>"                Drawn with any of the firmware's fonts
+ *   expect no display "<text>"
+ *   expect tip temp <min>..<max> C         Temperature read by the firmware
+ *   expect set temp <celsius>
+ * And "end" runs the station until its time, for a script that ends with inputs.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "display.h"
+#include "sim.h"
+#include "temperature.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/******    Constants    ******/
+enum bench_constants {
+	SAMPLE_MS = 10,		   // Heater duty resolution
+	SAMPLE_COUNT = 6000,   // Longest duty window, 60s
+	STATEMENT_MAX = 256,   // Characters
+	SCRIPT_MAX = 1 << 16   // Characters
+};
+
+static const char *const state_names[] = {
+	[INIT_STATE] = "INIT",
+	[TIP_CHANGE_STATE] = "TIP_CHANGE",
+	[OFF_STATE] = "OFF",
+	[ON_STATE] = "ON",
+	[STANDBY_STATE] = "STANDBY",
+	[ERROR_STATE] = "ERROR",
+};
+
+static const char *const fault_names[SIM_FAULT_COUNT] = {
+	[SIM_FAULT_ADC_NOISE] = "adc-noise",
+	[SIM_FAULT_ADC_OPEN] = "adc-open",
+	[SIM_FAULT_DMA_DROP] = "dma-drop",
+	[SIM_FAULT_TIMER_DELAY] = "timer-delay",
+	[SIM_FAULT_I2C_FAIL] = "i2c-fail",
+	[SIM_FAULT_ZC_LOSS] = "zc-loss",
+};
+
+/******    File Scope Variables    ******/
+static uint64_t heater_samples[SAMPLE_COUNT]; // heater_on_ns every SAMPLE_MS, ring buffer
+static uint32_t sample_count = 0;
+static uint8_t verbose = 0;
+static uint32_t checks = 0;
+static uint32_t failed_checks = 0;
+
+/******    Functions    ******/
+// Runs the station to time_ns, sampling the heater on time
+static void run_until(uint64_t time_ns) {
+	while (sim_time_ns() + SAMPLE_MS * SIM_NS_PER_MS <= time_ns) {
+		sim_run_ms(SAMPLE_MS);
+		heater_samples[sample_count++ % SAMPLE_COUNT] = sim_get_stats()->heater_on_ns;
+	}
+	if (sim_time_ns() < time_ns) {
+		sim_run_until_ns(time_ns);
+	}
+}
+
+// Heater duty in percent over the last window_ns, or -1 if the window is too long
+static double heater_duty(uint64_t window_ns) {
+	uint32_t samples = window_ns / (SAMPLE_MS * SIM_NS_PER_MS);
+	if ((samples == 0) || (samples >= SAMPLE_COUNT) || (samples >= sample_count)) {
+		return -1;
+	}
+	uint64_t newest = heater_samples[(sample_count - 1) % SAMPLE_COUNT];
+	uint64_t oldest = heater_samples[(sample_count - 1 - samples) % SAMPLE_COUNT];
+	return 100.0 * (newest - oldest) / ((uint64_t)samples * SAMPLE_MS * SIM_NS_PER_MS);
+}
+
+// Parses "<number><ms|s|min>", returns 0 if it isn't a time
+static uint8_t parse_time(const char *text, uint64_t *time_ns, int *length) {
+	double value;
+	char unit[4];
+	int end = 0;
+	if (sscanf(text, "%lf%3[a-z]%n", &value, unit, &end) != 2) {
+		return 0;
+	}
+	if (strcmp(unit, "ms") == 0) {
+		*time_ns = value * SIM_NS_PER_MS;
+	} else if (strcmp(unit, "s") == 0) {
+		*time_ns = value * 1000 * SIM_NS_PER_MS;
+	} else if (strcmp(unit, "min") == 0) {
+		*time_ns = value * 60000 * SIM_NS_PER_MS;
+	} else {
+		return 0;
+	}
+	if (length) {
+		*length = end;
+	}
+	return 1;
+}
+
+// Text between the first and the last quote, returns 0 if there isn't one
+static uint8_t parse_quoted(const char *text, char *quoted, size_t size) {
+	const char *first = strchr(text, '"');
+	const char *last = strrchr(text, '"');
+	if (!first || (last == first) || ((size_t)(last - first) > size)) {
+		return 0;
+	}
+	memcpy(quoted, first + 1, last - first - 1);
+	quoted[last - first - 1] = '\0';
+	return 1;
+}
+
+static void check(uint8_t passed, const char *where, const char *statement, const char *got) {
+	checks++;
+	if (!passed) {
+		failed_checks++;
+		printf("%s: FAIL %s (%s)\n", where, statement, got);
+	} else if (verbose) {
+		printf("%s: pass %s (%s)\n", where, statement, got);
+	}
+}
+
+// Returns SIM_FAULT_COUNT if there is no fault with the name
+static uint8_t parse_fault(const char *name) {
+	uint8_t fault = 0;
+	while ((fault < SIM_FAULT_COUNT) && (strcmp(name, fault_names[fault]) != 0)) {
+		fault++;
+	}
+	return fault;
+}
+
+// Runs one command, returns 0 if it can't be parsed
+static uint8_t run_command(const char *command, const char *where, const char *statement) {
+	char text[STATEMENT_MAX];
+	char got[STATEMENT_MAX];
+	int steps, min, max; // Ranges are whole numbers, "%lf.." would take the first dot
+	double value;
+	int offset = 0;
+
+	if (strcmp(command, "lift tool") == 0) {
+		sim_set_tool_in_holder(0);
+	} else if (strcmp(command, "place tool") == 0) {
+		sim_set_tool_in_holder(1);
+	} else if (sscanf(command, "rotate encoder %d%n", &steps, &offset) == 1 && (command[offset] == '\0')) {
+		sim_rotate_encoder(steps);
+	} else if (strcmp(command, "press button") == 0) {
+		sim_set_button(1);
+	} else if (strcmp(command, "release button") == 0) {
+		sim_set_button(0);
+	} else if (strcmp(command, "touch tip change") == 0) {
+		sim_set_tip_change(1);
+	} else if (strcmp(command, "release tip change") == 0) {
+		sim_set_tip_change(0);
+	} else if (strcmp(command, "remove tip") == 0) {
+		sim_set_tip_inserted(0);
+	} else if (strcmp(command, "insert tip") == 0) {
+		sim_set_tip_inserted(1);
+	} else if (strcmp(command, "remove ac") == 0) {
+		sim_set_ac(0);
+	} else if (strcmp(command, "restore ac") == 0) {
+		sim_set_ac(1);
+	} else if (sscanf(command, "inject %lf W load%n", &value, &offset) == 1 && (command[offset] == '\0')) {
+		sim_set_load_w(value);
+	} else if (strcmp(command, "remove load") == 0) {
+		sim_set_load_w(0);
+	} else if (sscanf(command, "set pcb temp %lf C%n", &value, &offset) == 1 && (command[offset] == '\0')) {
+		sim_set_pcb_temp(value);
+	} else if ((sscanf(command, "inject fault %31s%n", text, &offset) == 1) && (command[offset] == '\0') && (parse_fault(text) < SIM_FAULT_COUNT)) {
+		sim_set_fault(parse_fault(text), 1);
+	} else if ((sscanf(command, "clear fault %31s%n", text, &offset) == 1) && (command[offset] == '\0') && (parse_fault(text) < SIM_FAULT_COUNT)) {
+		sim_set_fault(parse_fault(text), 0);
+	} else if (sscanf(command, "expect state %31s", text) == 1) {
+		uint8_t state = get_system_state();
+		const char *name = (state < sizeof(state_names) / sizeof(state_names[0])) ? state_names[state] : "NONE";
+		snprintf(got, sizeof(got), "state %s", name);
+		check(strcmp(text, name) == 0, where, statement, got);
+	} else if ((strcmp(command, "expect heater on") == 0) || (strcmp(command, "expect heater off") == 0)) {
+		snprintf(got, sizeof(got), "heater %s", sim_heater_on() ? "on" : "off");
+		check(sim_heater_on() == (strcmp(command, "expect heater on") == 0), where, statement, got);
+	} else if (sscanf(command, "expect heater duty %d..%d%% over %n", &min, &max, &offset) == 2) {
+		uint64_t window_ns;
+		int length = 0;
+		if (!parse_time(command + offset, &window_ns, &length) || (command[offset + length] != '\0')) {
+			return 0;
+		}
+		double duty = heater_duty(window_ns);
+		if (duty < 0) {
+			snprintf(got, sizeof(got), "window longer than the run, or than %us", SAMPLE_COUNT * SAMPLE_MS / 1000);
+		} else {
+			snprintf(got, sizeof(got), "duty %.1f%%", duty);
+		}
+		check((duty >= min) && (duty <= max), where, statement, got);
+	} else if ((strncmp(command, "expect display ", 15) == 0) && parse_quoted(command, text, sizeof(text))) {
+		check(display_contains(text), where, statement, display_contains(text) ? "shown" : "not shown");
+		if (verbose && !display_contains(text)) {
+			display_print(stdout);
+		}
+	} else if ((strncmp(command, "expect no display ", 18) == 0) && parse_quoted(command, text, sizeof(text))) {
+		check(!display_contains(text), where, statement, display_contains(text) ? "shown" : "not shown");
+	} else if (sscanf(command, "expect tip temp %d..%d C%n", &min, &max, &offset) == 2 && (command[offset] == '\0')) {
+		uint16_t tip_temp = get_station_snapshot()->tip_temp;
+		snprintf(got, sizeof(got), "tip %u C", tip_temp);
+		check((tip_temp >= min) && (tip_temp <= max), where, statement, got);
+	} else if (sscanf(command, "expect set temp %lf%n", &value, &offset) == 1 && (command[offset] == '\0')) {
+		snprintf(got, sizeof(got), "set %u C", get_set_temp());
+		check(get_set_temp() == value, where, statement, got);
+	} else if (strcmp(command, "end") != 0) {
+		return 0;
+	}
+	return 1;
+}
+
+// Runs a script on a newly booted station, returns 0 if it can't be read or parsed
+static uint8_t run_script(const char *path) {
+	static char script[SCRIPT_MAX];
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		perror(path);
+		return 0;
+	}
+	size_t size = fread(script, 1, sizeof(script) - 1, file);
+	fclose(file);
+	script[size] = '\0';
+
+	// Blank out the comments, the line numbers stay the same
+	for (char *comment = strchr(script, '#'); comment; comment = strchr(comment, '#')) {
+		size_t length = strcspn(comment, "\n");
+		memset(comment, ' ', length);
+		comment += length;
+	}
+
+	sim_config config = sim_default_config();
+	sim_init(&config);
+	uint8_t booted = 0;
+	uint64_t previous_ns = 0;
+	uint32_t line = 1;
+
+	for (char *next = script; *next != '\0';) {
+		// One statement, up to a ';' or the end of the line
+		char statement[STATEMENT_MAX];
+		size_t length = strcspn(next, ";\n");
+		uint32_t statement_line = line;
+		if (next[length] == '\n') {
+			line++;
+		}
+		snprintf(statement, sizeof(statement), "%.*s", (int)length, next);
+		next += length + (next[length] != '\0');
+
+		char *start = statement + strspn(statement, " \t\r");
+		for (char *end = start + strlen(start); (end > start) && strchr(" \t\r", end[-1]); end--) {
+			end[-1] = '\0';
+		}
+		if (*start == '\0') {
+			continue;
+		}
+
+		char where[STATEMENT_MAX + 32];
+		snprintf(where, sizeof(where), "%s:%u", path, statement_line);
+		uint64_t time_ns;
+		int offset = 0;
+		if ((strncmp(start, "at t=", 5) != 0) || !parse_time(start + 5, &time_ns, &offset) || (start[5 + offset] != ' ')) {
+			printf("%s: expected \"at t=<time> <command>\": %s\n", where, start);
+			return 0;
+		}
+		if (time_ns < previous_ns) {
+			printf("%s: time goes backwards: %s\n", where, start);
+			return 0;
+		}
+		previous_ns = time_ns;
+
+		if ((time_ns > 0) && !booted) {
+			sim_boot();
+			booted = 1;
+		}
+		if (booted) {
+			run_until(time_ns);
+		}
+
+		const char *command = start + 5 + offset + strspn(start + 5 + offset, " ");
+		if (verbose) {
+			printf("%9.3f s  %s\n", sim_time_ns() * 1e-9, command);
+		}
+		if (!run_command(command, where, start)) {
+			printf("%s: unknown command: %s\n", where, command);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int main(int argc, char **argv) {
+	uint8_t scripts = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--verbose") == 0) {
+			verbose = 1;
+			continue;
+		}
+
+		// The firmware's static state can't be reset, every script runs in its own process
+		if (scripts++) {
+			printf("%s: one script per run\n", argv[i]);
+			return 2;
+		}
+		if (!run_script(argv[i])) {
+			return 2;
+		}
+		printf("%s: %u/%u checks passed\n", argv[i], checks - failed_checks, checks);
+	}
+
+	if (!scripts) {
+		printf("Usage: opensolder_bench [--verbose] script\n");
+		return 2;
+	}
+	return failed_checks ? 1 : 0;
+}
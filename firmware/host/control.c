@@ -0,0 +1,230 @@
+/*
+ * control.c
+ *
+ * Runs the standard temperature control scenarios on the host simulation, and reports the
+ * control_metrics.h run of each: rise time, overshoot, settling time, ripple, droop and recovery
+ * under load, estimated energy and time at full power. Each run is checked against the thresholds
+ * below, compare a power_control() change against the current one with --dump and
+ * tools/control_decode.py --baseline.
+ *
+ * Usage: opensolder_control [--json] [--load <watts>] [--dump control.bin]
+ *   --json     JSON instead of CSV
+ *   --load     Periodic soldering load in the load scenario, default 120 W. A load that doesn't pull
+ *              the tip out of the CONTROL_SETTLE_BAND fails the scenario, it tests nothing
+ *   --dump     Write control_log, in the same format as a dump from the device
+ * The exit code is 1 if a run exceeded a threshold.
+ *
+ * The scenarios run in order on one station:
+ *   cold_start    Tip inserted at ambient with the set temperature at 350C
+ *   standby       Tool placed in the holder
+ *   standby_wake  Tool lifted from the holder at 160C
+ *   step_up       Set temperature +50C
+ *   step_down     Set temperature -50C
+ *   load          Set temperature +TEMP_STEPS, and once that run has settled the load for LOAD_TIME_S
+ *                 every LOAD_INTERVAL_S. The metrics are all from this run, droop and recovery must
+ *                 be seen, the T245 holds the band up to about 80 W
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "control_metrics.h"
+#include "sim.h"
+#include "temperature.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/******    Constants    ******/
+enum control_constants {
+	SCENARIO_TEMP = 350,
+	SCENARIO_STEP = 50,
+	LOAD_INTERVAL_S = 10,
+	LOAD_TIME_S = 2,
+	LOAD_PERIODS = 4,
+	LOAD_SETTLE_TIMEOUT_MS = 10000,
+	DEFAULT_LOAD_W = 120
+};
+
+typedef struct {
+	const char *name;
+	uint32_t run_ms; // Time from the input to the end of the scenario, the load scenario also waits until settled
+	// Thresholds, 0 is not checked. With a droop threshold, a droop and a recovery time must be measured
+	uint16_t rise_time_ms_max;
+	uint16_t settling_time_ms_max;
+	int16_t overshoot_max;
+	uint16_t ripple_max;
+	uint16_t droop_max;
+	uint16_t recovery_time_ms_max;
+} scenario;
+
+enum scenario_index {
+	COLD_START = 0,
+	STANDBY,
+	STANDBY_WAKE,
+	STEP_UP,
+	STEP_DOWN,
+	LOAD,
+	SCENARIO_COUNT
+};
+
+static const scenario scenarios[SCENARIO_COUNT] = {
+	[COLD_START] = {"cold_start", 20000, 3000, 4000, 10, 8, 0, 0},
+	[STANDBY] = {"standby", 60000, 0, 40000, 10, 8, 0, 0}, // Cools without the heater
+	[STANDBY_WAKE] = {"standby_wake", 20000, 2000, 3000, 10, 8, 0, 0},
+	[STEP_UP] = {"step_up", 20000, 1000, 2000, 10, 8, 0, 0},
+	[STEP_DOWN] = {"step_down", 30000, 0, 6000, 10, 8, 0, 0},
+	[LOAD] = {"load", LOAD_PERIODS * LOAD_INTERVAL_S * 1000, 1000, 4000, 10, 10, 30, 3000},
+};
+
+static const char *const status_names[] = {"IDLE", "RISING", "SETTLING", "SETTLED"};
+
+/******    File Scope Variables    ******/
+static control_run results[SCENARIO_COUNT];
+static uint8_t passed[SCENARIO_COUNT];
+
+/******    Functions    ******/
+static void set_temp(uint16_t temp) {
+	sim_rotate_encoder(((int32_t)temp - get_set_temp()) / TEMP_STEPS);
+}
+
+static void run_scenario(uint8_t index, double load_w) {
+	const scenario *s = &scenarios[index];
+
+	switch (index) {
+		case COLD_START:
+			sim_set_tip_inserted(1);
+			break;
+		case STANDBY:
+			sim_set_tool_in_holder(1);
+			break;
+		case STANDBY_WAKE:
+			sim_set_tool_in_holder(0);
+			break;
+		case STEP_UP:
+			set_temp(SCENARIO_TEMP + SCENARIO_STEP);
+			break;
+		case STEP_DOWN:
+			set_temp(SCENARIO_TEMP);
+			break;
+		case LOAD:
+			set_temp(SCENARIO_TEMP + TEMP_STEPS);
+			break;
+		default:
+			break;
+	}
+
+	if (index != LOAD) {
+		sim_run_ms(s->run_ms);
+		results[index] = *control_metrics_get_run();
+		return;
+	}
+
+	// Droop and recovery are only measured after settling
+	for (uint32_t ms = 0; (ms < LOAD_SETTLE_TIMEOUT_MS) && (control_metrics_get_run()->status != CONTROL_RUN_SETTLED); ms += 100) {
+		sim_run_ms(100);
+	}
+	for (uint32_t period = 0; period < LOAD_PERIODS; period++) {
+		sim_set_load_w(load_w);
+		sim_run_ms(LOAD_TIME_S * 1000);
+		sim_set_load_w(0);
+		sim_run_ms((LOAD_INTERVAL_S - LOAD_TIME_S) * 1000);
+	}
+	results[index] = *control_metrics_get_run();
+}
+
+static uint8_t within(uint32_t value, uint32_t max) {
+	return !max || (value <= max);
+}
+
+static uint8_t check_thresholds(uint8_t index) {
+	const scenario *s = &scenarios[index];
+	const control_run *run = &results[index];
+
+	if (s->droop_max && (!run->droop || !run->recovery_time_ms)) {
+		fprintf(stderr, "%s: the tip never left the band, the load is too small to measure droop and recovery\n", s->name);
+		return 0;
+	}
+	return (run->status == CONTROL_RUN_SETTLED) && within(run->rise_time_ms, s->rise_time_ms_max) && within(run->settling_time_ms, s->settling_time_ms_max) &&
+		   ((s->overshoot_max == 0) || (run->overshoot <= s->overshoot_max)) && within(run->ripple, s->ripple_max) &&
+		   within(run->droop, s->droop_max) && within(run->recovery_time_ms, s->recovery_time_ms_max);
+}
+
+static void print_csv(void) {
+	printf("scenario,start_temp,target_temp,rise_time_ms,settling_time_ms,overshoot,ripple,droop,recovery_time_ms,duration_ms,energy_mj,full_power_ms,status,passed\n");
+	for (uint8_t i = 0; i < SCENARIO_COUNT; i++) {
+		const control_run *run = &results[i];
+		printf("%s,%u,%u,%u,%u,%d,%u,%u,%u,%u,%u,%u,%s,%u\n", scenarios[i].name, run->start_temp, run->target_temp, run->rise_time_ms,
+			   run->settling_time_ms, run->overshoot, run->ripple, run->droop, run->recovery_time_ms, run->duration_ms, run->energy_mj,
+			   run->full_power_ms, status_names[run->status & 3], passed[i]);
+	}
+}
+
+static void print_json(double load_w) {
+	printf("{\n  \"load_w\": %.1f,\n  \"runs\": [\n", load_w);
+	for (uint8_t i = 0; i < SCENARIO_COUNT; i++) {
+		const control_run *run = &results[i];
+		printf("    {\"scenario\": \"%s\", \"start_temp\": %u, \"target_temp\": %u, \"rise_time_ms\": %u, \"settling_time_ms\": %u, "
+			   "\"overshoot\": %d, \"ripple\": %u, \"droop\": %u, \"recovery_time_ms\": %u, \"duration_ms\": %u, \"energy_mj\": %u, "
+			   "\"full_power_ms\": %u, \"status\": \"%s\", \"passed\": %s}%s\n",
+			   scenarios[i].name, run->start_temp, run->target_temp, run->rise_time_ms, run->settling_time_ms, run->overshoot, run->ripple,
+			   run->droop, run->recovery_time_ms, run->duration_ms, run->energy_mj, run->full_power_ms, status_names[run->status & 3],
+			   passed[i] ? "true" : "false", (i + 1 < SCENARIO_COUNT) ? "," : "");
+	}
+	printf("  ]\n}\n");
+}
+
+int main(int argc, char **argv) {
+	uint8_t json = 0;
+	double load_w = DEFAULT_LOAD_W;
+	const char *dump_path = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--json") == 0) {
+			json = 1;
+		} else if ((strcmp(argv[i], "--load") == 0) && (i + 1 < argc)) {
+			load_w = atof(argv[++i]);
+		} else if ((strcmp(argv[i], "--dump") == 0) && (i + 1 < argc)) {
+			dump_path = argv[++i];
+		} else {
+			fprintf(stderr, "usage: %s [--json] [--load <watts>] [--dump control.bin]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	// Boot without a tip, so the set temperature is changed before the heater turns on
+	sim_config config = sim_default_config();
+	config.tip_inserted = 0;
+	sim_init(&config);
+	sim_boot();
+	sim_run_ms(1000);
+	set_temp(SCENARIO_TEMP);
+	sim_run_ms(100);
+
+	uint8_t failed = 0;
+	for (uint8_t i = 0; i < SCENARIO_COUNT; i++) {
+		run_scenario(i, load_w);
+		passed[i] = check_thresholds(i);
+		failed |= !passed[i];
+	}
+	// Finishes the last run into control_log
+	sim_set_tool_in_holder(1);
+	sim_run_ms(100);
+
+	if (json) {
+		print_json(load_w);
+	} else {
+		print_csv();
+	}
+
+	if (dump_path) {
+		FILE *file = fopen(dump_path, "wb");
+		if (!file) {
+			perror(dump_path);
+			return 2;
+		}
+		fwrite(&control_log, sizeof(control_log), 1, file);
+		fclose(file);
+	}
+	return failed;
+}
@@ -0,0 +1,184 @@
+/*
+ * kernels.c
+ *
+ * Times the CPU bound firmware kernels of benchmark.h on the host: the ADC statistics and deviation
+ * check, ssd1306_WriteChar() for each font, ssd1306_DrawFilledRectangle(), ssd1306_UpdateScreen(),
+ * update_display() and button_scan(). The station is booted and heated first, so the kernels work
+ * on real ADC buffers and display contents.
+ *
+ * Usage: opensolder_kernels [--scale n] [--json] [--save file.csv] [--baseline file.csv] [--threshold percent]
+ *   --scale      Iterations per batch, as a multiple of the batch on the device, default 1000
+ *   --json       JSON instead of CSV
+ *   --save       Write the results as CSV, to be used as a baseline later
+ *   --baseline   Compare with a saved run, the exit code is 1 if a kernel got slower than the threshold
+ *   --threshold  Allowed slowdown against the baseline, default 20%
+ *
+ * Each kernel runs BATCHES batches of a fixed number of iterations, timed with clock_gettime(), and
+ * the fastest batch counts. The times are host CPU times: use them to compare changes on the same
+ * machine, the cycle counts on the device are in benchmark_results. The display kernels also report
+ * the bytes sent per call, the SPI transfer time on the device follows from that. On the host, SPI
+ * writes go to the display model (display.h), which adds to update_screen and update_display.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+// The ADC kernels are static in temperature.c, this program includes it with the benchmark wrappers
+#define BENCHMARK_ENABLE 1
+#include "benchmark.c"
+#include "temperature.c"
+
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/******    Constants    ******/
+enum kernels_constants {
+	BATCHES = 5,
+	DEFAULT_SCALE = 1000,
+	DEFAULT_THRESHOLD_PERCENT = 20,
+	LINE_MAX = 256
+};
+
+/******    File Scope Variables    ******/
+static double ns_per_call[BENCHMARK_COUNT];
+static double baseline_ns[BENCHMARK_COUNT]; // 0 if not in the baseline
+
+/******    Functions    ******/
+static double now_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static double time_kernel(const benchmark_kernel *entry, uint32_t iterations) {
+	double best_ns = 0;
+	for (uint8_t batch = 0; batch < BATCHES; batch++) {
+		double start_ns = now_ns();
+		for (uint32_t i = 0; i < iterations; i++) {
+			entry->kernel();
+		}
+		double batch_ns = (now_ns() - start_ns) / iterations;
+		if ((batch == 0) || (batch_ns < best_ns)) {
+			best_ns = batch_ns;
+		}
+	}
+	return best_ns;
+}
+
+// Reads "kernel,iterations,ns_per_call,..." lines of a saved run, returns 0 if the file can't be read
+static uint8_t read_baseline(const char *path) {
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		return 0;
+	}
+	char line[LINE_MAX];
+	while (fgets(line, sizeof(line), file)) {
+		char name[64];
+		unsigned iterations;
+		double ns;
+		if (sscanf(line, "%63[^,],%u,%lf", name, &iterations, &ns) != 3) {
+			continue; // Header
+		}
+		for (uint8_t id = 0; id < BENCHMARK_COUNT; id++) {
+			if (strcmp(name, benchmark_kernels[id].name) == 0) {
+				baseline_ns[id] = ns;
+			}
+		}
+	}
+	fclose(file);
+	return 1;
+}
+
+static void print_csv(FILE *file, uint32_t scale, uint8_t with_baseline) {
+	fprintf(file, "kernel,iterations,ns_per_call,bytes_per_call%s\n", with_baseline ? ",baseline_ns,change_percent" : "");
+	for (uint8_t id = 0; id < BENCHMARK_COUNT; id++) {
+		const benchmark_kernel *entry = &benchmark_kernels[id];
+		fprintf(file, "%s,%u,%.1f,%u", entry->name, entry->iterations * scale, ns_per_call[id], entry->bytes_per_call);
+		if (with_baseline && baseline_ns[id]) {
+			fprintf(file, ",%.1f,%+.1f", baseline_ns[id], 100.0 * (ns_per_call[id] / baseline_ns[id] - 1));
+		} else if (with_baseline) {
+			fprintf(file, ",,");
+		}
+		fprintf(file, "\n");
+	}
+}
+
+static void print_json(uint32_t scale) {
+	printf("{\n  \"kernels\": [\n");
+	for (uint8_t id = 0; id < BENCHMARK_COUNT; id++) {
+		const benchmark_kernel *entry = &benchmark_kernels[id];
+		printf("    {\"kernel\": \"%s\", \"iterations\": %u, \"ns_per_call\": %.1f, \"bytes_per_call\": %u", entry->name, entry->iterations * scale,
+			   ns_per_call[id], entry->bytes_per_call);
+		if (baseline_ns[id]) {
+			printf(", \"baseline_ns\": %.1f", baseline_ns[id]);
+		}
+		printf("}%s\n", (id + 1 < BENCHMARK_COUNT) ? "," : "");
+	}
+	printf("  ]\n}\n");
+}
+
+int main(int argc, char **argv) {
+	uint32_t scale = DEFAULT_SCALE;
+	double threshold_percent = DEFAULT_THRESHOLD_PERCENT;
+	uint8_t json = 0;
+	const char *save_path = NULL;
+	const char *baseline_path = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--json") == 0) {
+			json = 1;
+		} else if ((strcmp(argv[i], "--scale") == 0) && (i + 1 < argc)) {
+			scale = strtoul(argv[++i], NULL, 0);
+		} else if ((strcmp(argv[i], "--save") == 0) && (i + 1 < argc)) {
+			save_path = argv[++i];
+		} else if ((strcmp(argv[i], "--baseline") == 0) && (i + 1 < argc)) {
+			baseline_path = argv[++i];
+		} else if ((strcmp(argv[i], "--threshold") == 0) && (i + 1 < argc)) {
+			threshold_percent = atof(argv[++i]);
+		} else {
+			fprintf(stderr, "usage: %s [--scale n] [--json] [--save file.csv] [--baseline file.csv] [--threshold percent]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (baseline_path && !read_baseline(baseline_path)) {
+		perror(baseline_path);
+		return 2;
+	}
+
+	sim_config config = sim_default_config();
+	sim_init(&config);
+	sim_boot();
+	sim_run_ms(10000);
+
+	benchmark_init();
+	for (uint8_t id = 0; id < BENCHMARK_COUNT; id++) {
+		ns_per_call[id] = time_kernel(&benchmark_kernels[id], benchmark_kernels[id].iterations * scale);
+	}
+
+	if (json) {
+		print_json(scale);
+	} else {
+		print_csv(stdout, scale, baseline_path != NULL);
+	}
+	if (save_path) {
+		FILE *file = fopen(save_path, "w");
+		if (!file) {
+			perror(save_path);
+			return 2;
+		}
+		print_csv(file, scale, 0);
+		fclose(file);
+	}
+
+	uint8_t slower = 0;
+	for (uint8_t id = 0; id < BENCHMARK_COUNT; id++) {
+		if (baseline_ns[id] && (ns_per_call[id] > baseline_ns[id] * (1 + threshold_percent / 100))) {
+			fprintf(stderr, "%s: %.1f ns per call, baseline %.1f ns\n", benchmark_kernels[id].name, ns_per_call[id], baseline_ns[id]);
+			slower = 1;
+		}
+	}
+	return slower;
+}
@@ -0,0 +1,216 @@
+/*
+ * profiles.c
+ *
+ * Compares the ADC measurement profiles (MEASUREMENT PROFILES in temperature.c) on recorded
+ * thermocouple samples: every temperature reading of a session is resampled to the sample count and
+ * sample period of each profile, and run through the firmware adc_calculate_channel_stats() and
+ * adc_deviation_check(). Per profile it reports the measurement window, the noise shown on the
+ * runtime debug page, the readings the deviation check would reject and the spread between
+ * consecutive readings.
+ *
+ * Usage: opensolder_profiles [session.bin] [--json]
+ *   session.bin  Saved with firmware/tools/record_decode.py --save, or by test_record_replay. Without
+ *                a session, readings are recorded on the simulated station, heated in ON state
+ *   --json       JSON instead of CSV
+ * The exit code is 1 if none of the readings could be used, 2 if the session can't be read.
+ *
+ * Only temperature readings are used, tip checks and readings without a tip are skipped. A profile
+ * is only evaluated on readings whose recorded window covers its window, so a session recorded
+ * with ADC_PROFILE_PRECISE gives all the profiles. Samples between two recorded ones are
+ * interpolated, so the noise of the shorter sampling times on the device may be somewhat higher
+ * than reported here: the recording is the ADC input as seen with the recorded sampling time.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+// adc_profiles[] and the ADC kernels are static in temperature.c, this program includes it
+#include "temperature.c"
+
+#include "replay.h"
+#include "sim.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/******    Constants    ******/
+enum profiles_constants {
+	SIM_SETTLE_MS = 10000,	 // In ON state before the simulated readings are recorded
+	SIM_READINGS = 2000
+};
+
+static const char *const profile_names[ADC_PROFILE_COUNT] = {
+	[ADC_PROFILE_PRECISE] = "precise",
+	[ADC_PROFILE_BALANCED] = "balanced",
+	[ADC_PROFILE_FAST] = "fast",
+};
+
+typedef struct {
+	uint32_t readings;
+	uint32_t window_us;
+	double noise_sum;
+	uint16_t noise_max;
+	uint32_t rejected;	   // Readings adc_deviation_check() sets error_flag for
+	double step_square_sum; // Squared difference of consecutive readings
+	uint32_t steps;
+} profile_result;
+
+/******    File Scope Variables    ******/
+static profile_result results[ADC_PROFILE_COUNT];
+
+/******    Functions    ******/
+// The profile a reading was recorded with, from its sample count. NULL if no profile has it
+static const adc_profile *recorded_profile(const record_entry *entry) {
+	for (uint8_t i = 0; i < ADC_PROFILE_COUNT; i++) {
+		if (adc_profiles[i].sample_count == entry->sample_count) {
+			return &adc_profiles[i];
+		}
+	}
+	return NULL;
+}
+
+// Resamples the recorded samples to the period of the profile, returns RESET if the recording is too short
+static uint8_t resample(const record_entry *entry, const adc_profile *from, const adc_profile *to, uint16_t *buffer) {
+	// The first sample is taken one sample period after the start, as in the simulated ADC
+	if ((uint32_t)to->sample_count * to->sample_period_ns > (uint32_t)from->sample_count * from->sample_period_ns) {
+		return RESET;
+	}
+	for (uint8_t i = 0; i < to->sample_count; i++) {
+		double position = (double)(i + 1) * to->sample_period_ns / from->sample_period_ns - 1;
+		if (position < 0) {
+			position = 0;
+		}
+		uint8_t index = (uint8_t)position;
+		double fraction = position - index;
+		uint16_t next = (index + 1 < entry->sample_count) ? entry->samples[index + 1] : entry->samples[index];
+		buffer[i] = (uint16_t)lround(entry->samples[index] + fraction * (next - entry->samples[index]));
+	}
+	return SET;
+}
+
+static void evaluate(const replay_session *session) {
+	static const uint16_t internal_buffer[ADC_INTERNAL_SCANS * ADC_INTERNAL_CHANNEL_COUNT];
+	uint32_t last_sequence[ADC_PROFILE_COUNT] = {0};
+	uint32_t last_average[ADC_PROFILE_COUNT] = {0};
+
+	for (uint8_t i = 0; i < ADC_PROFILE_COUNT; i++) {
+		results[i].window_us = adc_profiles[i].sample_count * adc_profiles[i].sample_period_ns / 1000;
+	}
+
+	for (uint32_t r = 0; r < session->count; r++) {
+		const replay_record *record = &session->records[r];
+		const adc_profile *from = recorded_profile(&record->entry);
+		if (!from || (record->entry.flags & RECORD_FLAG_TIP_CHECK) || (record->entry.tip_state != TIP_DETECTED) ||
+			(record->entry.tip_temp == ADC_READING_ERROR)) {
+			continue;
+		}
+
+		for (uint8_t i = 0; i < ADC_PROFILE_COUNT; i++) {
+			uint16_t buffer[ADC_BUFFER_LENGTH];
+			if (!resample(&record->entry, from, &adc_profiles[i], buffer)) {
+				continue;
+			}
+			adc_calculate_channel_stats(buffer, internal_buffer, &adc_profiles[i]);
+			error_flag = RESET;
+			adc_deviation_check();
+
+			profile_result *result = &results[i];
+			result->readings++;
+			result->noise_sum += adc_noise;
+			if (adc_noise > result->noise_max) {
+				result->noise_max = adc_noise;
+			}
+			result->rejected += (error_flag == SET);
+			if (result->readings > 1 && (record->sequence == last_sequence[i] + 1)) {
+				double step = (double)adc_buffer_average - last_average[i];
+				result->step_square_sum += step * step;
+				result->steps++;
+			}
+			last_sequence[i] = record->sequence;
+			last_average[i] = adc_buffer_average;
+		}
+	}
+}
+
+// Records SIM_READINGS readings of the default profile on the simulated station, heated in ON state
+static void record_simulated(replay_session *session) {
+	sim_config config = sim_default_config();
+	sim_init(&config);
+	sim_boot();
+	sim_run_ms(SIM_SETTLE_MS);
+	replay_capture(session); // Skips the readings up to here
+	session->count = 0;
+	for (uint32_t reading = 0; reading < SIM_READINGS; reading++) {
+		if (!replay_run_to_reading(REPLAY_READING_TIMEOUT_MS)) {
+			break;
+		}
+		replay_capture(session);
+	}
+}
+
+static double noise_mean(const profile_result *result) {
+	return result->readings ? result->noise_sum / result->readings : 0;
+}
+
+static double step_rms(const profile_result *result) {
+	return result->steps ? sqrt(result->step_square_sum / result->steps) : 0;
+}
+
+static void print_csv(void) {
+	printf("profile,samples,window_us,readings,noise_mean_lsb,noise_max_lsb,rejected,step_rms_lsb\n");
+	for (uint8_t i = 0; i < ADC_PROFILE_COUNT; i++) {
+		const profile_result *result = &results[i];
+		printf("%s,%u,%u,%u,%.1f,%u,%u,%.2f\n", profile_names[i], adc_profiles[i].sample_count, result->window_us, result->readings, noise_mean(result),
+			   result->noise_max, result->rejected, step_rms(result));
+	}
+}
+
+static void print_json(void) {
+	printf("{\n  \"profiles\": [\n");
+	for (uint8_t i = 0; i < ADC_PROFILE_COUNT; i++) {
+		const profile_result *result = &results[i];
+		printf("    {\"profile\": \"%s\", \"samples\": %u, \"window_us\": %u, \"readings\": %u, \"noise_mean_lsb\": %.1f, \"noise_max_lsb\": %u, "
+			   "\"rejected\": %u, \"step_rms_lsb\": %.2f}%s\n",
+			   profile_names[i], adc_profiles[i].sample_count, result->window_us, result->readings, noise_mean(result), result->noise_max,
+			   result->rejected, step_rms(result), (i + 1 < ADC_PROFILE_COUNT) ? "," : "");
+	}
+	printf("  ]\n}\n");
+}
+
+int main(int argc, char **argv) {
+	const char *path = NULL;
+	uint8_t json = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--json") == 0) {
+			json = 1;
+		} else if ((argv[i][0] != '-') && !path) {
+			path = argv[i];
+		} else {
+			fprintf(stderr, "usage: %s [session.bin] [--json]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	replay_session session = {0};
+	if (path && !replay_load(path, &session)) {
+		fprintf(stderr, "%s: not a session file\n", path);
+		return 2;
+	} else if (!path) {
+		record_simulated(&session);
+	}
+
+	evaluate(&session);
+	if (json) {
+		print_json();
+	} else {
+		print_csv();
+	}
+	replay_free(&session);
+
+	uint32_t readings = 0;
+	for (uint8_t i = 0; i < ADC_PROFILE_COUNT; i++) {
+		readings += results[i].readings;
+	}
+	return readings ? 0 : 1;
+}
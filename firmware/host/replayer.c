@@ -0,0 +1,58 @@
+/*
+ * replayer.c
+ *
+ * Replays a recorded session through the firmware on the host simulation, and compares every
+ * reading with the recording, see replay.h
+ *
+ * Usage: opensolder_replay session.bin [--quiet]
+ * The session is a file saved with firmware/tools/record_decode.py --save. The mismatches are
+ * printed (unless --quiet) and the exit code is 1 if there were any or none of the readings could be
+ * compared, 2 if the session can't be read.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "replay.h"
+#include "sim.h"
+#include <string.h>
+
+int main(int argc, char **argv) {
+	const char *path = NULL;
+	uint8_t quiet = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--quiet") == 0) {
+			quiet = 1;
+		} else {
+			path = argv[i];
+		}
+	}
+	if (!path) {
+		fprintf(stderr, "usage: %s session.bin [--quiet]\n", argv[0]);
+		return 2;
+	}
+
+	replay_session session;
+	if (!replay_load(path, &session)) {
+		fprintf(stderr, "%s: not a session file\n", path);
+		return 2;
+	}
+
+	sim_config config = sim_default_config();
+	sim_init(&config);
+	replay_result result = replay_run(&session, quiet ? NULL : stdout);
+
+	printf("readings          %u (sequence %u to %u, %u missing)\n", session.count, session.records[0].sequence, session.records[session.count - 1].sequence, result.gaps);
+	printf("compared          %u\n", result.compared);
+	if (result.mismatches) {
+		printf("mismatches        %u, first at reading %u\n", result.mismatches, result.first_mismatch);
+	} else {
+		printf("mismatches        0\n");
+	}
+	if (result.timeout) {
+		printf("the firmware stopped reading after %.3f s\n", sim_time_ns() * 1e-9);
+	}
+	replay_free(&session);
+	return (result.mismatches || result.timeout || !result.compared) ? 1 : 0;
+}
@@ -0,0 +1,21 @@
+/*
+ * _ansi.h
+ *
+ * Host build: the newlib header ssd1306.h includes, glibc doesn't have it
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef SIM_ANSI_H
+#define SIM_ANSI_H
+
+#ifdef __cplusplus
+#define _BEGIN_STD_C extern "C" {
+#define _END_STD_C }
+#else
+#define _BEGIN_STD_C
+#define _END_STD_C
+#endif
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ * core_cm0.h
+ *
+ * Host build: Cortex-M0 core header with the intrinsics replaced by the simulator
+ *
+ * The register types and bit definitions come from the CMSIS header, only cmsis_gcc.h (ARM inline
+ * assembly) is left out. Interrupt masking, WFI and the memory barriers call into sim.c, and the
+ * core peripherals are plain structs owned by the simulator.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef SIM_CORE_CM0_H
+#define SIM_CORE_CM0_H
+
+/******    Includes    ******/
+#include <stdint.h>
+
+/******    Compiler Macros    ******/
+// Normally defined by cmsis_gcc.h, which is skipped
+#define __CMSIS_GCC_H
+#define __ASM __asm
+#define __INLINE inline
+#define __STATIC_INLINE static inline
+#define __STATIC_FORCEINLINE static inline __attribute__((always_inline))
+#define __NO_RETURN __attribute__((__noreturn__))
+#define __USED __attribute__((used))
+#define __WEAK __attribute__((weak))
+#define __PACKED __attribute__((packed, aligned(1)))
+#define __PACKED_STRUCT struct __attribute__((packed, aligned(1)))
+#define __PACKED_UNION union __attribute__((packed, aligned(1)))
+#define __ALIGNED(x) __attribute__((aligned(x)))
+#define __RESTRICT __restrict
+#define __COMPILER_BARRIER() __asm volatile("" ::: "memory")
+
+/******    Intrinsics    ******/
+extern volatile uint32_t sim_primask;
+void sim_wait_for_interrupt(void);
+void sim_memory_barrier(void);
+uint32_t sim_get_msp(void);
+
+static inline void __enable_irq(void) {
+	sim_primask = 0;
+}
+
+static inline void __disable_irq(void) {
+	sim_primask = 1;
+}
+
+static inline uint32_t __get_PRIMASK(void) {
+	return sim_primask;
+}
+
+static inline void __set_PRIMASK(uint32_t primask) {
+	sim_primask = primask;
+}
+
+static inline uint32_t __get_MSP(void) {
+	return sim_get_msp();
+}
+
+static inline void __WFI(void) {
+	sim_wait_for_interrupt();
+}
+
+static inline void __DMB(void) {
+	sim_memory_barrier();
+}
+
+static inline void __DSB(void) {
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void __ISB(void) {
+	__COMPILER_BARRIER();
+}
+
+static inline void __NOP(void) {
+}
+
+/******    CMSIS Core Header    ******/
+#include_next "core_cm0.h"
+
+/******    Core Peripherals    ******/
+extern SCB_Type sim_scb;
+extern SysTick_Type sim_systick;
+extern NVIC_Type sim_nvic;
+
+#undef SCB
+#undef SysTick
+#undef NVIC
+#define SCB (&sim_scb)
+#define SysTick (&sim_systick)
+#define NVIC (&sim_nvic)
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ * stm32f0xx.h
+ *
+ * Host build: STM32F0 device header with the peripherals the firmware uses moved into the simulator
+ *
+ * The device header is included unchanged for the register types and bit definitions. The
+ * peripheral pointers are redefined to structs owned by sim.c, so register accesses in the firmware
+ * (and in the inline HAL/LL functions) read and write simulator state instead of fixed addresses.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef SIM_STM32F0XX_H
+#define SIM_STM32F0XX_H
+
+/******    Device Header    ******/
+#include_next "stm32f0xx.h"
+
+/******    Peripherals    ******/
+extern GPIO_TypeDef sim_gpioa;
+extern GPIO_TypeDef sim_gpiob;
+extern GPIO_TypeDef sim_gpiof;
+extern TIM_TypeDef sim_tim2;
+extern TIM_TypeDef sim_tim6;
+extern TIM_TypeDef sim_tim7;
+extern TIM_TypeDef sim_tim14;
+extern ADC_TypeDef sim_adc1;
+extern ADC_Common_TypeDef sim_adc_common;
+extern I2C_TypeDef sim_i2c1;
+extern SPI_TypeDef sim_spi1;
+extern DMA_Channel_TypeDef sim_dma1_channel1;
+
+#undef GPIOA
+#undef GPIOB
+#undef GPIOF
+#undef TIM2
+#undef TIM6
+#undef TIM7
+#undef TIM14
+#undef ADC1
+#undef ADC1_COMMON
+#undef ADC
+#undef I2C1
+#undef SPI1
+#undef DMA1_Channel1
+
+#define GPIOA (&sim_gpioa)
+#define GPIOB (&sim_gpiob)
+#define GPIOF (&sim_gpiof)
+#define TIM2 (&sim_tim2)
+#define TIM6 (&sim_tim6)
+#define TIM7 (&sim_tim7)
+#define TIM14 (&sim_tim14)
+#define ADC1 (&sim_adc1)
+#define ADC1_COMMON (&sim_adc_common)
+#define ADC (&sim_adc_common)
+#define I2C1 (&sim_i2c1)
+#define SPI1 (&sim_spi1)
+#define DMA1_Channel1 (&sim_dma1_channel1)
+
+#endif
@@ -0,0 +1,41 @@
+/*
+ * stm32f0xx_ll_adc.h
+ *
+ * Host build: LL ADC header with the parts that need the hardware replaced by the simulator
+ *
+ * LL_ADC_REG_StopConversion() sets ADSTP and relies on the hardware to clear it again, so it is
+ * replaced by a fake that stops the simulated conversion at once. The factory calibration values
+ * are read from the simulator instead of the system memory.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef SIM_STM32F0XX_LL_ADC_H
+#define SIM_STM32F0XX_LL_ADC_H
+
+/******    LL ADC Header    ******/
+// LL_ADC_DMA_GetRegAddr() returns a register address as uint32_t, which doesn't fit on a 64 bit host
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpointer-to-int-cast"
+#define LL_ADC_REG_StopConversion LL_ADC_REG_StopConversion_hardware
+#include_next "stm32f0xx_ll_adc.h"
+#undef LL_ADC_REG_StopConversion
+#pragma GCC diagnostic pop
+
+/******    Replaced Functions    ******/
+void LL_ADC_REG_StopConversion(ADC_TypeDef *ADCx);
+
+/******    Calibration Values    ******/
+extern uint16_t sim_vrefint_cal;
+extern uint16_t sim_tempsensor_cal1;
+extern uint16_t sim_tempsensor_cal2;
+
+#undef VREFINT_CAL_ADDR
+#undef TEMPSENSOR_CAL1_ADDR
+#undef TEMPSENSOR_CAL2_ADDR
+#define VREFINT_CAL_ADDR (&sim_vrefint_cal)
+#define TEMPSENSOR_CAL1_ADDR (&sim_tempsensor_cal1)
+#define TEMPSENSOR_CAL2_ADDR (&sim_tempsensor_cal2)
+
+#endif
@@ -0,0 +1,168 @@
+/*
+ * display.c
+ *
+ * SSD1306 model for the host simulation, see display.h
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "display.h"
+#include <string.h>
+
+/******    File Scope Variables    ******/
+static uint8_t gddram[DISPLAY_PAGES][DISPLAY_WIDTH];
+static uint8_t page = 0;
+static uint8_t column = 0;
+static uint8_t display_on = 0;
+static uint8_t skip_arguments = 0; // Argument bytes of the last command, still to come
+static uint32_t frames = 0;		   // Times the last byte of the display RAM was written
+
+static const FontDef *const fonts[] = {&Font_6x8, &Font_7x10, &Font_11x18, &Font_16x26};
+
+/******    Function Prototypes    ******/
+static void command(uint8_t byte);
+static uint8_t text_matches(const char *text, const FontDef *font, uint8_t x, uint8_t y, uint8_t inverted);
+
+/******    Functions    ******/
+void display_reset(void) {
+	memset(gddram, 0, sizeof(gddram));
+	page = 0;
+	column = 0;
+	display_on = 0;
+	skip_arguments = 0;
+	frames = 0;
+}
+
+void display_spi_write(uint8_t data_mode, const uint8_t *data, uint16_t size) {
+	for (uint16_t i = 0; i < size; i++) {
+		if (!data_mode) {
+			command(data[i]);
+			continue;
+		}
+
+		gddram[page][column] = data[i];
+		if (++column >= DISPLAY_WIDTH) {
+			column = 0;
+			if (++page >= DISPLAY_PAGES) {
+				page = 0;
+				frames++;
+			}
+		}
+	}
+}
+
+uint8_t display_pixel(uint8_t x, uint8_t y) {
+	if ((x >= DISPLAY_WIDTH) || (y >= DISPLAY_HEIGHT)) {
+		return 0;
+	}
+	return (gddram[y / 8][x] >> (y % 8)) & 1;
+}
+
+uint8_t display_is_on(void) {
+	return display_on;
+}
+
+uint32_t display_frames(void) {
+	return frames;
+}
+
+// Searches every position for the text as ssd1306_WriteString() draws it, in either color. Returns 1 if found
+uint8_t display_find_text(const char *text, const FontDef *font, uint8_t *x, uint8_t *y) {
+	size_t width = strlen(text) * font->FontWidth;
+	if ((width == 0) || (width > DISPLAY_WIDTH) || (font->FontHeight > DISPLAY_HEIGHT)) {
+		return 0;
+	}
+
+	for (uint8_t row = 0; row <= DISPLAY_HEIGHT - font->FontHeight; row++) {
+		for (uint8_t col = 0; col <= DISPLAY_WIDTH - width; col++) {
+			if (text_matches(text, font, col, row, 0) || text_matches(text, font, col, row, 1)) {
+				if (x) {
+					*x = col;
+				}
+				if (y) {
+					*y = row;
+				}
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+uint8_t display_contains(const char *text) {
+	for (uint8_t i = 0; i < sizeof(fonts) / sizeof(fonts[0]); i++) {
+		if (display_find_text(text, fonts[i], NULL, NULL)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void display_print(FILE *file) {
+	fputc('+', file);
+	for (uint8_t x = 0; x < DISPLAY_WIDTH; x++) {
+		fputc('-', file);
+	}
+	fputs("+\n", file);
+
+	for (uint8_t y = 0; y < DISPLAY_HEIGHT; y++) {
+		fputc('|', file);
+		for (uint8_t x = 0; x < DISPLAY_WIDTH; x++) {
+			fputc(display_pixel(x, y) ? '#' : ' ', file);
+		}
+		fputs("|\n", file);
+	}
+
+	fputc('+', file);
+	for (uint8_t x = 0; x < DISPLAY_WIDTH; x++) {
+		fputc('-', file);
+	}
+	fputs("+\n", file);
+}
+
+/******    Static Functions    ******/
+static void command(uint8_t byte) {
+	if (skip_arguments) {
+		skip_arguments--;
+		return;
+	}
+
+	if ((byte >= 0xB0) && (byte <= 0xB7)) {
+		page = byte - 0xB0;
+	} else if (byte <= 0x0F) {
+		column = (column & 0xF0) | byte;
+	} else if (byte <= 0x1F) {
+		column = (column & 0x0F) | ((byte & 0x0F) << 4);
+	} else if (byte == 0xAE) {
+		display_on = 0;
+	} else if (byte == 0xAF) {
+		display_on = 1;
+	} else if ((byte == 0x21) || (byte == 0x22)) {
+		skip_arguments = 2;
+	} else if ((byte == 0x20) || (byte == 0x81) || (byte == 0xA8) || (byte == 0xD3) || (byte == 0xD5) || (byte == 0xD9) || (byte == 0xDA) || (byte == 0xDB) || (byte == 0x8D)) {
+		skip_arguments = 1;
+	}
+	column %= DISPLAY_WIDTH;
+}
+
+// Font glyphs are one uint16_t per row, MSB first, and the background is drawn too
+static uint8_t text_matches(const char *text, const FontDef *font, uint8_t x, uint8_t y, uint8_t inverted) {
+	for (size_t i = 0; text[i] != '\0'; i++) {
+		char ch = text[i];
+		if ((ch < 32) || (ch > 126)) {
+			return 0;
+		}
+
+		for (uint8_t row = 0; row < font->FontHeight; row++) {
+			uint16_t bits = font->data[(ch - 32) * font->FontHeight + row];
+			for (uint8_t col = 0; col < font->FontWidth; col++) {
+				uint8_t expected = ((bits << col) & 0x8000) ? !inverted : inverted;
+				if (display_pixel(x + i * font->FontWidth + col, y + row) != expected) {
+					return 0;
+				}
+			}
+		}
+	}
+	return 1;
+}
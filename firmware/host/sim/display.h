@@ -0,0 +1,45 @@
+/*
+ * display.h
+ *
+ * SSD1306 model for the host simulation: decodes the SPI stream into the display RAM
+ *
+ * USAGE:
+ * - HAL_SPI_Transmit() (hal.c) feeds display_spi_write() while CS is low, DC selects command or data
+ * - display_pixel() reads the display RAM, display_print() dumps it as ASCII
+ * - display_contains() searches the display for a text drawn with any of the firmware's fonts,
+ *   display_find_text() with one font
+ *
+ * Only the commands ssd1306.c uses are decoded: page and column addressing, display on/off, and the
+ * commands with arguments (which are skipped). Data is written at the current column and page,
+ * in horizontal addressing mode.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+/******    Includes    ******/
+#include "ssd1306_fonts.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/******    Constants and Objects    ******/
+enum display_constants {
+	DISPLAY_WIDTH = 128,
+	DISPLAY_HEIGHT = 64,
+	DISPLAY_PAGES = DISPLAY_HEIGHT / 8
+};
+
+/******    Function Declarations    ******/
+void display_reset(void);
+void display_spi_write(uint8_t data_mode, const uint8_t *data, uint16_t size);
+uint8_t display_pixel(uint8_t x, uint8_t y);
+uint8_t display_is_on(void);
+uint32_t display_frames(void);
+uint8_t display_find_text(const char *text, const FontDef *font, uint8_t *x, uint8_t *y);
+uint8_t display_contains(const char *text);
+void display_print(FILE *file);
+
+#endif
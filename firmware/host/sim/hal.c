@@ -0,0 +1,525 @@
+/*
+ * hal.c
+ *
+ * Host build: the STM32 HAL functions the firmware calls, on top of the simulated peripherals
+ *
+ * Only the behaviour the firmware depends on is modelled: timer update interrupts, the ADC DMA
+ * transfer with sample timing, the PCT2075 on I2C, and the SSD1306 on SPI (display.h). The
+ * handles are set up the way MX_*_Init() in main.c leaves them. The faults of sim_set_fault() are
+ * injected here, where the hardware would fail.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "sim.h"
+#include "display.h"
+#include "pct2075.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/******    Peripherals    ******/
+GPIO_TypeDef sim_gpioa;
+GPIO_TypeDef sim_gpiob;
+GPIO_TypeDef sim_gpiof;
+TIM_TypeDef sim_tim2;
+TIM_TypeDef sim_tim6;
+TIM_TypeDef sim_tim7;
+TIM_TypeDef sim_tim14;
+ADC_TypeDef sim_adc1;
+ADC_Common_TypeDef sim_adc_common;
+I2C_TypeDef sim_i2c1;
+SPI_TypeDef sim_spi1;
+DMA_Channel_TypeDef sim_dma1_channel1;
+
+uint16_t sim_vrefint_cal = SIM_VREFINT_CAL;
+uint16_t sim_tempsensor_cal1 = SIM_TEMPSENSOR_CAL1;
+uint16_t sim_tempsensor_cal2 = SIM_TEMPSENSOR_CAL2;
+
+/******    Handles    ******/
+ADC_HandleTypeDef hadc;
+DMA_HandleTypeDef hdma_adc;
+I2C_HandleTypeDef hi2c1;
+SPI_HandleTypeDef hspi1;
+TIM_HandleTypeDef htim2;
+TIM_HandleTypeDef htim6;
+TIM_HandleTypeDef htim7;
+TIM_HandleTypeDef htim14;
+
+/******    HAL Tick    ******/
+__IO uint32_t uwTick;
+uint32_t uwTickPrio = 0;
+HAL_TickFreqTypeDef uwTickFreq = HAL_TICK_FREQ_DEFAULT;
+uint32_t SystemCoreClock = 48000000; // SystemClock_Config(), system_stm32f0xx.c isn't built
+
+/******    File Scope Variables    ******/
+// Timer update interrupts, the time of the update event is kept apart from the dispatch time
+static uint64_t update_ns[SIM_SOURCE_COUNT];
+static uint64_t tim14_start_ns = 0;
+static uint64_t zc_ideal_ns = 0; // Zero cross edge without jitter
+static uint8_t tim6_delayed = 0;  // The pending TIM6 interrupt has been held back by SIM_FAULT_TIMER_DELAY
+
+static struct {
+	uint16_t *buffer;
+	uint32_t length;
+	uint64_t start_ns;
+	uint32_t period_ns;
+	uint8_t channels[ADC_CHANNEL_COUNT];
+	uint8_t channel_count;
+} adc_transfer;
+
+static struct {
+	uint8_t conf;
+	int8_t hyst_c;
+	int8_t os_c;
+	uint8_t os_active;
+	uint8_t *rx_buffer;
+} pct2075;
+
+// Conversion time per sample for each SMPR setting, sampling plus 12.5 cycles, at the 14MHz ADC clock
+static const double adc_sample_cycles[8] = {1.5, 7.5, 13.5, 28.5, 41.5, 55.5, 71.5, 239.5};
+
+/******    Function Prototypes    ******/
+static TIM_HandleTypeDef *source_timer(uint8_t source);
+static uint8_t timer_source(TIM_HandleTypeDef *htim);
+static uint64_t timer_period_ns(TIM_TypeDef *tim);
+static void timer_init(TIM_HandleTypeDef *htim, TIM_TypeDef *instance, uint32_t prescaler, uint32_t period);
+static void timer_update(uint8_t source);
+static void zero_cross(void);
+static void adc_dma_complete(void);
+static uint16_t adc_sample(uint8_t channel, uint64_t time_ns);
+static void i2c_complete(void);
+static void pct2075_register(uint8_t *buffer);
+
+/******    Simulator Interface    ******/
+void hal_reset(void) {
+	memset(&sim_gpioa, 0, sizeof(GPIO_TypeDef));
+	memset(&sim_gpiob, 0, sizeof(GPIO_TypeDef));
+	memset(&sim_gpiof, 0, sizeof(GPIO_TypeDef));
+	memset(&sim_adc1, 0, sizeof(ADC_TypeDef));
+	memset(&sim_adc_common, 0, sizeof(ADC_Common_TypeDef));
+	memset(&adc_transfer, 0, sizeof(adc_transfer));
+	memset(&pct2075, 0, sizeof(pct2075));
+	pct2075.os_c = 80; // Power up defaults
+	pct2075.hyst_c = 75;
+	memset(update_ns, 0, sizeof(update_ns));
+	tim6_delayed = 0;
+	uwTick = 0;
+
+	// MX_GPIO_Init(): thermocouple analog, heater output low, clamp and tip check inputs. OS is pulled up
+	sim_gpioa.MODER = GPIO_MODER_MODER0 | GPIO_MODER_MODER3_0;
+	sim_gpiob.MODER = GPIO_MODER_MODER0_0 | GPIO_MODER_MODER1_0 | GPIO_MODER_MODER2_0;
+	sim_gpiob.IDR = OS_Pin;
+
+	// MX_ADC_Init(): thermocouple channel at 239.5 cycles
+	hadc.Instance = ADC1;
+	hadc.DMA_Handle = &hdma_adc;
+	sim_adc1.CHSELR = ADC_CHSELR_CHSEL0;
+	sim_adc1.SMPR = ADC_SAMPLETIME_239CYCLES_5;
+
+	hi2c1.Instance = I2C1;
+	hi2c1.State = HAL_I2C_STATE_READY;
+	hspi1.Instance = SPI1;
+
+	timer_init(&htim2, TIM2, 3, 0xFFFFFFFF);
+	timer_init(&htim6, TIM6, 47, 90);
+	timer_init(&htim7, TIM7, 47, 1999);
+	timer_init(&htim14, TIM14, 47, 65535);
+
+	sim_schedule(SIM_SYSTICK, SIM_NS_PER_MS);
+	hal_zero_cross_restart();
+}
+
+void hal_dispatch(uint8_t source) {
+	switch (source) {
+		case SIM_ZERO_CROSS:
+			zero_cross();
+			break;
+		case SIM_OS_PIN:
+			HAL_GPIO_EXTI_Callback(OS_Pin);
+			break;
+		case SIM_TIM6:
+		case SIM_TIM7:
+		case SIM_TIM14:
+			timer_update(source);
+			break;
+		case SIM_ADC_DMA:
+			adc_dma_complete();
+			break;
+		case SIM_SYSTICK:
+			HAL_IncTick();
+			HAL_SYSTICK_Callback();
+			sim_schedule(SIM_SYSTICK, sim_time_ns() + SIM_NS_PER_MS);
+			break;
+		case SIM_I2C:
+			i2c_complete();
+			break;
+	}
+}
+
+// Counter values as the firmware reads them at the current time
+void hal_timers_sync(void) {
+	uint64_t now = sim_time_ns();
+
+	// TIM14 free runs in 1us steps. UIF is set at the wrap, before the overflow interrupt is serviced
+	if (TIM14->CR1 & TIM_CR1_CEN) {
+		TIM14->CNT = ((now - tim14_start_ns) / SIM_NS_PER_US) & 0xFFFF;
+		if (sim_due_ns(SIM_TIM14) <= now) {
+			TIM14->SR |= TIM_SR_UIF;
+		}
+	}
+
+	// TIM6 and TIM7 count on from the update event until the interrupt stops them
+	static const uint8_t counters[] = {SIM_TIM6, SIM_TIM7};
+	for (uint8_t i = 0; i < sizeof(counters); i++) {
+		TIM_TypeDef *tim = source_timer(counters[i])->Instance;
+		if ((tim->CR1 & TIM_CR1_CEN) && (now >= update_ns[counters[i]])) {
+			tim->CNT = (now - update_ns[counters[i]]) * SIM_CPU_MHZ / ((tim->PSC + 1) * (uint64_t)SIM_NS_PER_US);
+		}
+	}
+}
+
+// Start or stop the zero cross edges after the AC supply changed
+void hal_zero_cross_restart(void) {
+	if (sim_get_config()->ac_present) {
+		if (!sim_scheduled(SIM_ZERO_CROSS)) {
+			zc_ideal_ns = sim_time_ns() + (uint64_t)SIM_NS_PER_MS * 500 / sim_get_config()->mains_hz;
+			sim_schedule(SIM_ZERO_CROSS, zc_ideal_ns);
+		}
+	} else {
+		sim_cancel(SIM_ZERO_CROSS);
+	}
+}
+
+// PCT2075 comparator: OS goes low above Tos, and is released below Thyst
+void hal_pct2075_update(void) {
+	int16_t temp_c = sim_get_config()->pcb_temp_c;
+	uint8_t active = pct2075.os_active;
+
+	if (temp_c > pct2075.os_c) {
+		active = 1;
+	} else if (temp_c < pct2075.hyst_c) {
+		active = 0;
+	}
+
+	if (active && !pct2075.os_active) {
+		OS_GPIO_Port->IDR &= ~OS_Pin;
+		sim_schedule(SIM_OS_PIN, sim_time_ns());
+	} else if (!active) {
+		OS_GPIO_Port->IDR |= OS_Pin;
+	}
+	pct2075.os_active = active;
+}
+
+/******    HAL Core    ******/
+void HAL_IncTick(void) {
+	uwTick += uwTickFreq;
+}
+
+uint32_t HAL_GetTick(void) {
+	return uwTick;
+}
+
+void HAL_Delay(uint32_t Delay) {
+	uint32_t tickstart = HAL_GetTick();
+	uint32_t wait = Delay;
+	if (wait < HAL_MAX_DELAY) {
+		wait += (uint32_t)uwTickFreq;
+	}
+	while ((HAL_GetTick() - tickstart) < wait) {
+		sim_wait_for_tick();
+	}
+}
+
+void Error_Handler(void) {
+	fprintf(stderr, "Error_Handler() called at %.6fs\n", sim_time_ns() * 1e-9);
+	abort();
+}
+
+/******    GPIO    ******/
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState) {
+	if (PinState != GPIO_PIN_RESET) {
+		GPIOx->ODR |= GPIO_Pin;
+	} else {
+		GPIOx->ODR &= ~GPIO_Pin;
+	}
+	sim_pins_sync();
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+	return (GPIOx->IDR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+/******    Timers    ******/
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef *htim) {
+	if (htim->State != HAL_TIM_STATE_READY) {
+		return HAL_ERROR;
+	}
+	htim->State = HAL_TIM_STATE_BUSY;
+	htim->Instance->CR1 |= TIM_CR1_CEN;
+	htim->Instance->DIER |= TIM_DIER_UIE;
+	htim->Instance->CNT = 0;
+
+	uint8_t source = timer_source(htim);
+	if (htim->Instance == TIM14) {
+		tim14_start_ns = sim_time_ns();
+	}
+	update_ns[source] = sim_time_ns() + timer_period_ns(htim->Instance);
+	sim_schedule(source, update_ns[source]);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Stop_IT(TIM_HandleTypeDef *htim) {
+	htim->Instance->CR1 &= ~TIM_CR1_CEN;
+	htim->Instance->DIER &= ~TIM_DIER_UIE;
+	htim->State = HAL_TIM_STATE_READY;
+	sim_cancel(timer_source(htim));
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Encoder_Start(TIM_HandleTypeDef *htim, uint32_t Channel) {
+	(void)Channel;
+	htim->Instance->CR1 |= TIM_CR1_CEN;
+	htim->State = HAL_TIM_STATE_BUSY;
+	return HAL_OK;
+}
+
+/******    ADC    ******/
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef *hadc, ADC_ChannelConfTypeDef *sConfig) {
+	hadc->Instance->CHSELR |= 1UL << sConfig->Channel;
+	MODIFY_REG(hadc->Instance->SMPR, ADC_SMPR_SMP, sConfig->SamplingTime);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADCEx_Calibration_Start(ADC_HandleTypeDef *hadc) {
+	(void)hadc;
+	return HAL_OK;
+}
+
+// The channels in CHSELR are converted lowest first, repeatedly until the transfer length is reached
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef *hadc, uint32_t *pData, uint32_t Length) {
+	ADC_TypeDef *adc = hadc->Instance;
+	if (adc->CR & ADC_CR_ADSTART) {
+		return HAL_BUSY;
+	}
+	adc->CR |= ADC_CR_ADSTART;
+
+	adc_transfer.buffer = (uint16_t *)pData;
+	adc_transfer.length = Length;
+	adc_transfer.start_ns = sim_time_ns();
+	adc_transfer.period_ns = (adc_sample_cycles[adc->SMPR & ADC_SMPR_SMP] + 12.5) * 1000 / 14;
+	adc_transfer.channel_count = 0;
+	for (uint8_t channel = 0; channel <= 17; channel++) {
+		if ((adc->CHSELR & (1UL << channel)) && (adc_transfer.channel_count < ADC_CHANNEL_COUNT)) {
+			adc_transfer.channels[adc_transfer.channel_count++] = channel;
+		}
+	}
+
+	sim_schedule(SIM_ADC_DMA, adc_transfer.start_ns + (uint64_t)Length * adc_transfer.period_ns);
+	return HAL_OK;
+}
+
+// Replaces the LL function, see shim/stm32f0xx_ll_adc.h. A transfer in progress is abandoned
+void LL_ADC_REG_StopConversion(ADC_TypeDef *ADCx) {
+	ADCx->CR &= ~(ADC_CR_ADSTART | ADC_CR_ADSTP);
+	sim_cancel(SIM_ADC_DMA);
+}
+
+/******    I2C    ******/
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c) {
+	hi2c->State = HAL_I2C_STATE_READY;
+	return HAL_OK;
+}
+
+HAL_I2C_StateTypeDef HAL_I2C_GetState(I2C_HandleTypeDef *hi2c) {
+	return hi2c->State;
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout) {
+	(void)hi2c, (void)MemAddSize, (void)Size, (void)Timeout;
+	if (DevAddress != PCT2075_I2C_ADDR) {
+		return HAL_ERROR;
+	}
+
+	switch (MemAddress) {
+		case PCT2075_CONF_REG:
+			pct2075.conf = pData[0];
+			break;
+		case PCT2075_HYST_REG:
+			pct2075.hyst_c = (int8_t)pData[0];
+			break;
+		case PCT2075_OS_REG:
+			pct2075.os_c = (int8_t)pData[0];
+			break;
+	}
+	hal_pct2075_update();
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout) {
+	(void)hi2c, (void)MemAddSize, (void)Size, (void)Timeout;
+	if ((DevAddress != PCT2075_I2C_ADDR) || (MemAddress != PCT2075_TEMP_REG) || sim_fault_active(SIM_FAULT_I2C_FAIL)) {
+		hi2c->ErrorCode = HAL_I2C_ERROR_AF;
+		return HAL_ERROR;
+	}
+	pct2075_register(pData);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size) {
+	(void)MemAddSize, (void)Size;
+	if (hi2c->State != HAL_I2C_STATE_READY) {
+		return HAL_BUSY;
+	}
+	if ((DevAddress != PCT2075_I2C_ADDR) || (MemAddress != PCT2075_TEMP_REG)) {
+		return HAL_ERROR;
+	}
+	hi2c->State = HAL_I2C_STATE_BUSY_RX;
+	pct2075.rx_buffer = pData;
+	sim_schedule(SIM_I2C, sim_time_ns() + (uint64_t)SIM_I2C_TRANSFER_US * SIM_NS_PER_US);
+	return HAL_OK;
+}
+
+/******    SPI    ******/
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout) {
+	(void)hspi, (void)Timeout;
+	if (!(CS_GPIO_Port->ODR & CS_Pin)) {
+		display_spi_write((DC_GPIO_Port->ODR & DC_Pin) != 0, pData, Size);
+	}
+	return HAL_OK;
+}
+
+/******    Static Functions    ******/
+static TIM_HandleTypeDef *source_timer(uint8_t source) {
+	switch (source) {
+		case SIM_TIM6:
+			return &htim6;
+		case SIM_TIM7:
+			return &htim7;
+		default:
+			return &htim14;
+	}
+}
+
+static uint8_t timer_source(TIM_HandleTypeDef *htim) {
+	if (htim == &htim6) {
+		return SIM_TIM6;
+	} else if (htim == &htim7) {
+		return SIM_TIM7;
+	}
+	return SIM_TIM14;
+}
+
+// Time from counter start to the update event
+static uint64_t timer_period_ns(TIM_TypeDef *tim) {
+	return ((uint64_t)tim->ARR + 1) * (tim->PSC + 1) * SIM_NS_PER_US / SIM_CPU_MHZ;
+}
+
+static void timer_init(TIM_HandleTypeDef *htim, TIM_TypeDef *instance, uint32_t prescaler, uint32_t period) {
+	memset(htim, 0, sizeof(*htim));
+	memset(instance, 0, sizeof(*instance));
+	htim->Instance = instance;
+	htim->Init.Prescaler = prescaler;
+	htim->Init.Period = period;
+	htim->State = HAL_TIM_STATE_READY;
+	instance->PSC = prescaler;
+	instance->ARR = period;
+}
+
+// HAL_TIM_IRQHandler(): clear UIF and call the callback. The counter restarts at the update event, and the
+// next update is one (possibly new, no preload) ARR period after it
+static void timer_update(uint8_t source) {
+	// A late interrupt: the update event happened on time, so CNT shows the latency
+	if ((source == SIM_TIM6) && sim_fault_active(SIM_FAULT_TIMER_DELAY) && !tim6_delayed) {
+		tim6_delayed = 1;
+		sim_schedule(SIM_TIM6, sim_time_ns() + (uint64_t)SIM_FAULT_TIMER_DELAY_US * SIM_NS_PER_US);
+		return;
+	}
+	tim6_delayed = 0;
+
+	TIM_HandleTypeDef *htim = source_timer(source);
+	htim->Instance->SR &= ~TIM_SR_UIF;
+	HAL_TIM_PeriodElapsedCallback(htim);
+
+	if (htim->Instance->CR1 & TIM_CR1_CEN) {
+		update_ns[source] += timer_period_ns(htim->Instance);
+		sim_schedule(source, update_ns[source]);
+	}
+}
+
+static void zero_cross(void) {
+	const sim_config *config = sim_get_config();
+	if (!sim_fault_active(SIM_FAULT_ZC_LOSS)) {
+		HAL_GPIO_EXTI_Callback(ZERO_CROSS_Pin);
+	}
+
+	zc_ideal_ns += (uint64_t)SIM_NS_PER_MS * 500 / config->mains_hz;
+	int64_t jitter_ns = sim_random_uniform(config->zc_jitter_us) * SIM_NS_PER_US;
+	sim_schedule(SIM_ZERO_CROSS, zc_ideal_ns + jitter_ns);
+}
+
+static void adc_dma_complete(void) {
+	sim_adc1.CR &= ~ADC_CR_ADSTART;
+	for (uint32_t i = 0; i < adc_transfer.length; i++) {
+		uint64_t sample_ns = adc_transfer.start_ns + (uint64_t)(i + 1) * adc_transfer.period_ns;
+		uint8_t channel = adc_transfer.channels[i % adc_transfer.channel_count];
+		adc_transfer.buffer[i] = adc_sample(channel, sample_ns);
+
+		if ((channel == 0) && sim_fault_active(SIM_FAULT_ADC_OPEN)) {
+			adc_transfer.buffer[i] = PLANT_ADC_FULL_SCALE;
+		} else if ((channel == 0) && sim_fault_active(SIM_FAULT_ADC_NOISE) && ((i & 3) == 0)) {
+			uint16_t sample = adc_transfer.buffer[i] + SIM_FAULT_ADC_NOISE_LSB;
+			adc_transfer.buffer[i] = (sample > PLANT_ADC_FULL_SCALE) ? PLANT_ADC_FULL_SCALE : sample;
+		}
+	}
+	// The samples are taken anyway, so the random sequence is the same with and without a source
+	if ((adc_transfer.channel_count == 1) && (adc_transfer.channels[0] == 0)) {
+		sim_adc_source(adc_transfer.buffer, adc_transfer.length);
+	}
+	if (!sim_fault_active(SIM_FAULT_DMA_DROP)) {
+		HAL_ADC_ConvCpltCallback(&hadc);
+	}
+}
+
+static uint16_t adc_sample(uint8_t channel, uint64_t time_ns) {
+	const sim_config *config = sim_get_config();
+	double code;
+
+	if (channel == 0) {
+		uint64_t release_ns = sim_clamp_release_ns();
+		double since_release_us = (time_ns >= release_ns) ? (time_ns - release_ns) / (double)SIM_NS_PER_US : 0;
+		code = plant_thermocouple_adc(since_release_us, sim_clamp_engaged(), sim_tip_check_high(), config->tip_inserted, config->vdda_mv);
+		code += sim_random_uniform(config->plant.noise_lsb);
+	} else if (channel == 16) {
+		// Linear between the two factory calibration points, which are taken at 3.3V
+		double ts = sim_tempsensor_cal1 + (config->mcu_temp_c - 30) * (sim_tempsensor_cal2 - sim_tempsensor_cal1) / 80.0;
+		code = ts * 3300 / config->vdda_mv;
+	} else if (channel == 17) {
+		code = sim_vrefint_cal * 3300.0 / config->vdda_mv;
+	} else {
+		code = 0;
+	}
+
+	code = round(code);
+	return (code < 0) ? 0 : (code > PLANT_ADC_FULL_SCALE) ? PLANT_ADC_FULL_SCALE : (uint16_t)code;
+}
+
+// A failed read is not acknowledged, and ends in the error callback
+static void i2c_complete(void) {
+	hi2c1.State = HAL_I2C_STATE_READY;
+	if (sim_fault_active(SIM_FAULT_I2C_FAIL)) {
+		hi2c1.ErrorCode = HAL_I2C_ERROR_AF;
+		HAL_I2C_ErrorCallback(&hi2c1);
+		return;
+	}
+	pct2075_register(pct2075.rx_buffer);
+	HAL_I2C_MemRxCpltCallback(&hi2c1);
+}
+
+// Temperature register, whole degrees in the MSB
+static void pct2075_register(uint8_t *buffer) {
+	buffer[0] = (uint8_t)(int8_t)sim_get_config()->pcb_temp_c;
+	buffer[1] = 0;
+}
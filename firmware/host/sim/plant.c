@@ -0,0 +1,102 @@
+/*
+ * plant.c
+ *
+ * Thermal model of a T245 cartridge and the thermocouple amplifier, for the host simulation
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "plant.h"
+#include <math.h>
+#include <string.h>
+
+/******    File Scope Variables    ******/
+static plant_config config;
+static plant_state state;
+
+/******    Functions    ******/
+plant_config plant_default_config(void) {
+	plant_config defaults = {
+		.heater_capacity_j_k = 0.4,
+		.tip_capacity_j_k = 0.5,
+		.heater_tip_k_w = 0.5,
+		.tip_ambient_k_w = 36.0,
+		.ambient_c = 25.0,
+		.resistance_mohm = 2500.0,
+		.supply_mv = 24000.0,
+		.lsb_per_k = 7.5,
+		.tip_check_lsb_per_mohm = (3.3 / 10000) * 0.001 * 221 * 4096 / 3.3, // 3.3V over 10k into the heater, amplifier gain 221
+		.settle_tau_us = 250.0,
+		.noise_lsb = 3.0,
+	};
+	return defaults;
+}
+
+void plant_init(const plant_config *new_config) {
+	config = *new_config;
+	memset(&state, 0, sizeof(state));
+	state.heater_c = config.ambient_c;
+	state.tip_c = config.ambient_c;
+	state.max_heater_c = config.ambient_c;
+}
+
+// Explicit Euler steps, the simulation calls this at least every 1ms (SysTick), far below the node time constants
+void plant_advance(double dt_s, uint8_t heater_on) {
+	if (dt_s <= 0) {
+		return;
+	}
+
+	double supply_v = config.supply_mv / 1000.0;
+	state.power_w = heater_on ? (supply_v * supply_v) / (config.resistance_mohm / 1000.0) : 0;
+	state.energy_j += state.power_w * dt_s;
+
+	double heater_to_tip_w = (state.heater_c - state.tip_c) / config.heater_tip_k_w;
+	double tip_to_ambient_w = (state.tip_c - config.ambient_c) / config.tip_ambient_k_w;
+
+	state.heater_c += (state.power_w - heater_to_tip_w) * dt_s / config.heater_capacity_j_k;
+	state.tip_c += (heater_to_tip_w - tip_to_ambient_w - state.load_w) * dt_s / config.tip_capacity_j_k;
+
+	// A load can't cool the tip below the ambient temperature
+	if (state.tip_c < config.ambient_c) {
+		state.tip_c = config.ambient_c;
+	}
+	if (state.heater_c > state.max_heater_c) {
+		state.max_heater_c = state.heater_c;
+	}
+}
+
+void plant_set_load_w(double load_w) {
+	state.load_w = load_w;
+}
+
+const plant_state *plant_get_state(void) {
+	return &state;
+}
+
+// Noiseless amplifier output as an ADC code, see AMPLIFIER MODEL
+double plant_thermocouple_adc(double since_release_us, uint8_t clamped, uint8_t tip_check_high, uint8_t tip_inserted, double vdda_mv) {
+	if (!tip_inserted) {
+		return PLANT_ADC_SATURATED;
+	}
+	if (clamped) {
+		return 0;
+	}
+
+	double code = (state.heater_c - config.ambient_c) * config.lsb_per_k;
+	if (tip_check_high) {
+		code += config.resistance_mohm * config.tip_check_lsb_per_mohm;
+	}
+	if (since_release_us >= 0) {
+		code *= 1.0 - exp(-since_release_us / config.settle_tau_us);
+	}
+
+	// The ADC converts relative to VDDA
+	code = code * PLANT_VDDA_MV / vdda_mv;
+	if (code < 0) {
+		code = 0;
+	} else if (code > PLANT_ADC_FULL_SCALE) {
+		code = PLANT_ADC_FULL_SCALE;
+	}
+	return code;
+}
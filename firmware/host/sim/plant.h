@@ -0,0 +1,78 @@
+/*
+ * plant.h
+ *
+ * Thermal model of a T245 cartridge and the thermocouple amplifier, for the host simulation
+ *
+ * USAGE:
+ * - Call plant_init() with a configuration (plant_default_config() gives a T245 at 24VAC)
+ * - Call plant_advance() with the time since the last call and the heater state
+ * - Call plant_thermocouple_adc() for the ADC code of the amplifier output at the current state
+ *
+ * - THERMAL MODEL -
+ * Two lumped nodes: the heater (with the thermocouple) and the tip. The heater power goes into the
+ * heater node, flows to the tip through heater_tip_k_w, and from the tip to the ambient through
+ * tip_ambient_k_w. A soldering load (plant_set_load_w()) draws power from the tip.
+ *
+ *   P = V^2 / R -> [heater, C_h] -- R_ht -- [tip, C_t] -- R_ta -- ambient
+ *                                              |
+ *                                             load
+ *
+ * The defaults heat a T245 from 25C to 350C in about 2s at the firmware's maximum duty, and hold
+ * 350C with about 9W idle loss.
+ *
+ * - AMPLIFIER MODEL -
+ * The firmware converts the reading as temperature = code * 100 / 750 + 25 (at VDDA = 3.3V), the
+ * model is the inverse of that with the cold junction at the ambient temperature. While the clamp is
+ * engaged the output is 0, after release it recovers with settle_tau_us. With TIP_CHECK driven high
+ * the heater current through the pull-up adds about 11mOhm per LSB, and an open thermocouple (no tip)
+ * saturates the output.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef PLANT_H
+#define PLANT_H
+
+/******    Includes    ******/
+#include <stdint.h>
+
+/******    Constants and Objects    ******/
+enum plant_constants {
+	PLANT_ADC_FULL_SCALE = 4095,
+	PLANT_ADC_SATURATED = 4090, // Amplifier output with an open thermocouple
+	PLANT_VDDA_MV = 3300		// The firmware's conversion assumes a 3.3V reference
+};
+
+typedef struct {
+	double heater_capacity_j_k; // Heater and thermocouple node
+	double tip_capacity_j_k;	// Tip node
+	double heater_tip_k_w;		// Thermal resistance heater to tip
+	double tip_ambient_k_w;		// Thermal resistance tip to ambient (convection and radiation, linearized)
+	double ambient_c;
+	double resistance_mohm; // Heater resistance
+	double supply_mv;		// RMS heater supply
+	double lsb_per_k;		// Thermocouple amplifier output per kelvin above the cold junction, at 3.3V
+	double tip_check_lsb_per_mohm; // Amplifier output per mOhm heater resistance with TIP_CHECK driven high
+	double settle_tau_us;	// Amplifier recovery after clamp release
+	double noise_lsb;		// Peak ADC noise, uniform
+} plant_config;
+
+typedef struct {
+	double heater_c;
+	double tip_c;
+	double load_w;
+	double power_w;	 // Heater power in the last step
+	double energy_j; // Heater energy since plant_init()
+	double max_heater_c;
+} plant_state;
+
+/******    Function Declarations    ******/
+plant_config plant_default_config(void);
+void plant_init(const plant_config *config);
+void plant_advance(double dt_s, uint8_t heater_on);
+void plant_set_load_w(double load_w);
+const plant_state *plant_get_state(void);
+double plant_thermocouple_adc(double since_release_us, uint8_t clamped, uint8_t tip_check_high, uint8_t tip_inserted, double vdda_mv);
+
+#endif
@@ -0,0 +1,206 @@
+/*
+ * replay.c
+ *
+ * Replay of recorded sessions (record.h) through the firmware on the host simulation
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "replay.h"
+#include "sim.h"
+#include <stdlib.h>
+
+// Same layout as RECORD_FORMAT in firmware/tools/record_decode.py, with the sequence number first
+_Static_assert(sizeof(replay_record) == 4 + 112, "replay_record must match the session file format");
+
+/******    Constants    ******/
+enum replay_file_constants {
+	REPLAY_LOG_MISMATCHES = 20 // Mismatches printed to the log, the rest are only counted
+};
+
+/******    Local Function Declarations    ******/
+static void replay_source(uint16_t *buffer, uint32_t length);
+static const replay_record *find_record(uint32_t sequence);
+static void apply_inputs(const record_entry *entry);
+static uint8_t compare_reading(const record_entry *recorded, const record_entry *replayed);
+
+/******    File Scope Variables    ******/
+static const replay_session *active_session = NULL;
+static uint32_t fed_sequence = 0;  // Sequence number of the next thermocouple transfer
+static uint32_t captured_head = 0; // record_log.head at the last replay_capture()
+
+/******    Functions    ******/
+// Returns RESET if the file can't be read or isn't a session
+uint8_t replay_load(const char *path, replay_session *session) {
+	*session = (replay_session){0};
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		return RESET;
+	}
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if ((size <= 0) || (size % sizeof(replay_record))) {
+		fclose(file);
+		return RESET;
+	}
+
+	session->count = size / sizeof(replay_record);
+	session->records = malloc(size);
+	uint8_t valid = session->records && (fread(session->records, sizeof(replay_record), session->count, file) == session->count);
+	fclose(file);
+
+	for (uint32_t i = 0; valid && (i < session->count); i++) {
+		valid = (session->records[i].entry.sample_count <= ADC_BUFFER_LENGTH) && ((i == 0) || (session->records[i].sequence > session->records[i - 1].sequence));
+	}
+	if (!valid) {
+		replay_free(session);
+	}
+	return valid;
+}
+
+uint8_t replay_save(const char *path, const replay_session *session) {
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		return RESET;
+	}
+	uint8_t written = fwrite(session->records, sizeof(replay_record), session->count, file) == session->count;
+	fclose(file);
+	return written;
+}
+
+void replay_free(replay_session *session) {
+	free(session->records);
+	*session = (replay_session){0};
+}
+
+// Boots the station and replays the session, mismatches are printed to log if it isn't NULL
+replay_result replay_run(const replay_session *session, FILE *log) {
+	replay_result result = {0};
+	if (!session->count) {
+		return result;
+	}
+	for (uint32_t i = 1; i < session->count; i++) {
+		result.gaps += session->records[i].sequence - session->records[i - 1].sequence - 1;
+	}
+
+	active_session = session;
+	fed_sequence = 0;
+	if (find_record(0)) {
+		apply_inputs(&find_record(0)->entry);
+	}
+	sim_set_adc_source(replay_source);
+	sim_boot();
+
+	uint32_t last_sequence = session->records[session->count - 1].sequence;
+	uint32_t compared_head = 0;
+	while (compared_head <= last_sequence) {
+		if ((record_log.head == compared_head) && !replay_run_to_reading(REPLAY_READING_TIMEOUT_MS)) {
+			result.timeout = SET;
+			break;
+		}
+
+		// The boot runs without replay_run_to_reading(), the oldest readings may be overwritten by then
+		if ((record_log.head - compared_head) > RECORD_LENGTH) {
+			compared_head = record_log.head - RECORD_LENGTH;
+		}
+		for (; compared_head != record_log.head; compared_head++) {
+			const replay_record *recorded = find_record(compared_head);
+			const record_entry *replayed = &record_log.entries[compared_head & (RECORD_LENGTH - 1)];
+			if (recorded) {
+				result.compared++;
+				if (!compare_reading(&recorded->entry, replayed)) {
+					if (!result.mismatches) {
+						result.first_mismatch = compared_head;
+					}
+					if (log && (result.mismatches < REPLAY_LOG_MISMATCHES)) {
+						fprintf(log, "reading %u: tip %u/%u C, on periods %u/%u, tip state %u/%u, tip check %u/%u (recorded/replayed)\n", compared_head,
+								recorded->entry.tip_temp, replayed->tip_temp, recorded->entry.on_periods, replayed->on_periods, recorded->entry.tip_state,
+								replayed->tip_state, !!(recorded->entry.flags & RECORD_FLAG_TIP_CHECK), !!(replayed->flags & RECORD_FLAG_TIP_CHECK));
+					}
+					result.mismatches++;
+				}
+			}
+			if (find_record(compared_head + 1)) {
+				apply_inputs(&find_record(compared_head + 1)->entry);
+			}
+		}
+	}
+
+	sim_set_adc_source(NULL);
+	active_session = NULL;
+	return result;
+}
+
+// Runs in REPLAY_STEP_US steps until adc_process() has recorded a reading, returns RESET on timeout
+uint8_t replay_run_to_reading(uint32_t timeout_ms) {
+	uint32_t head = record_log.head;
+	uint64_t end_ns = sim_time_ns() + (uint64_t)timeout_ms * SIM_NS_PER_MS;
+	while (record_log.head == head) {
+		if (sim_time_ns() >= end_ns) {
+			return RESET;
+		}
+		sim_run_until_ns(sim_time_ns() + REPLAY_STEP_US * SIM_NS_PER_US);
+	}
+	return SET;
+}
+
+// Appends the readings recorded since the last call, readings overwritten in the ring become gaps
+void replay_capture(replay_session *session) {
+	uint32_t head = record_log.head;
+	if ((head - captured_head) > RECORD_LENGTH) {
+		captured_head = head - RECORD_LENGTH;
+	}
+	if (head == captured_head) {
+		return;
+	}
+
+	replay_record *records = realloc(session->records, (session->count + head - captured_head) * sizeof(replay_record));
+	if (!records) {
+		return;
+	}
+	session->records = records;
+	for (; captured_head != head; captured_head++) {
+		session->records[session->count++] = (replay_record){captured_head, record_log.entries[captured_head & (RECORD_LENGTH - 1)]};
+	}
+}
+
+// Called from the simulated ADC DMA with every thermocouple transfer
+static void replay_source(uint16_t *buffer, uint32_t length) {
+	const replay_record *record = find_record(fed_sequence++);
+	if (!record) {
+		return; // Not in the session, the plant samples are used
+	}
+	for (uint32_t i = 0; (i < length) && (i < record->entry.sample_count); i++) {
+		buffer[i] = record->entry.samples[i];
+	}
+}
+
+// Binary search, returns NULL if the sequence number isn't in the session
+static const replay_record *find_record(uint32_t sequence) {
+	uint32_t low = 0;
+	uint32_t high = active_session->count;
+	while (low < high) {
+		uint32_t middle = low + (high - low) / 2;
+		if (active_session->records[middle].sequence < sequence) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return ((low < active_session->count) && (active_session->records[low].sequence == sequence)) ? &active_session->records[low] : NULL;
+}
+
+// The record holds the raw pin levels, the inputs are active low
+static void apply_inputs(const record_entry *entry) {
+	sim_set_tool_in_holder(!(entry->flags & RECORD_FLAG_HOLDER));
+	sim_set_tip_change(!(entry->flags & RECORD_FLAG_TIP_CHANGE));
+	sim_set_button(!(entry->flags & RECORD_FLAG_BUTTON));
+	sim_rotate_encoder((int16_t)(entry->encoder - (uint16_t)TIM2->CNT));
+}
+
+static uint8_t compare_reading(const record_entry *recorded, const record_entry *replayed) {
+	return (recorded->tip_temp == replayed->tip_temp) && (recorded->on_periods == replayed->on_periods) && (recorded->tip_state == replayed->tip_state) &&
+		   ((recorded->flags & RECORD_FLAG_TIP_CHECK) == (replayed->flags & RECORD_FLAG_TIP_CHECK));
+}
@@ -0,0 +1,68 @@
+/*
+ * replay.h
+ *
+ * Replay of recorded sessions (record.h) through the firmware on the host simulation
+ *
+ * USAGE:
+ * - Record on the device with RECORD_ENABLE=1, and join the dumps with
+ *   firmware/tools/record_decode.py record1.bin ... --save session.bin
+ * - Load the session with replay_load(), then sim_init() and replay_run() instead of sim_boot()
+ * - A session can also be recorded on the host: replay_run_to_reading() runs until the next reading,
+ *   and replay_capture() collects the record_log entries into a session for replay_save()
+ *
+ * The raw thermocouple samples of reading N are fed to adc_complete() in place of the plant samples,
+ * where N is the record sequence number: readings before the first record of the session use the
+ * plant. The holder, tip change and button levels and the encoder counter of record N + 1 are applied
+ * right after reading N, where they were last read by the firmware on the device. AC is assumed
+ * present, and a thermocouple settle calibration (long button press) shifts the readings. Readings
+ * during the splash screen are only compared for the last RECORD_LENGTH of them.
+ * The host build records too (RECORD_ENABLE=1), and every replayed reading is compared with the
+ * session: tip temperature, heater decision, tip state and tip check. A session recorded on the host
+ * replays without mismatches, a session from the device diverges where the plant state matters.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+/******    Includes    ******/
+#include "record.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/******    Constants and Objects    ******/
+enum replay_constants {
+	REPLAY_STEP_US = 100,		 // Simulation step while waiting for a reading
+	REPLAY_READING_TIMEOUT_MS = 1000 // Longest time without a reading before the replay stops
+};
+
+// One record of a session file, as written by record_decode.py --save
+typedef struct {
+	uint32_t sequence;
+	record_entry entry;
+} replay_record;
+
+typedef struct {
+	replay_record *records; // Sorted on the sequence number
+	uint32_t count;
+} replay_session;
+
+typedef struct {
+	uint32_t compared;	 // Readings compared with the session
+	uint32_t mismatches; // Compared readings that differ
+	uint32_t first_mismatch; // Sequence number of the first mismatch
+	uint32_t gaps;		 // Sequence numbers missing in the session, the plant fills them
+	uint8_t timeout;	 // The firmware stopped reading before the end of the session
+} replay_result;
+
+/******    Function Declarations    ******/
+uint8_t replay_load(const char *path, replay_session *session);
+uint8_t replay_save(const char *path, const replay_session *session);
+void replay_free(replay_session *session);
+replay_result replay_run(const replay_session *session, FILE *log);
+uint8_t replay_run_to_reading(uint32_t timeout_ms);
+void replay_capture(replay_session *session);
+
+#endif
@@ -0,0 +1,402 @@
+/*
+ * sim.c
+ *
+ * Discrete-event simulation of the OpenSolder station, see sim.h
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "sim.h"
+#include "display.h"
+#include "temperature.h"
+#include <stddef.h>
+#include <string.h>
+
+/******    Core Peripherals    ******/
+SCB_Type sim_scb;
+SysTick_Type sim_systick;
+NVIC_Type sim_nvic;
+volatile uint32_t sim_primask = 0;
+
+/******    Linker Symbols    ******/
+// ram_monitor.c scans the stack and heap between the linker symbols, they are placed in sim_ram with the
+// same layout as STM32F072CBTX_FLASH.ld: | stack | .data | .bss | heap | free |
+enum sim_ram_layout {
+	SIM_RAM_SIZE = 16384,
+	SIM_STACK_SIZE = 2048,
+	SIM_DATA_BSS_SIZE = 4096,
+	SIM_STACK_IN_USE = 256 // Stack the "main loop" appears to use at ram_monitor_init()
+};
+
+uint32_t sim_ram[SIM_RAM_SIZE / sizeof(uint32_t)];
+
+__asm__(".globl _sstack, _estack, _sdata, _sramfunc, _eramfunc, _ebss, _end, _eram\n"
+		".set _sstack, sim_ram\n"
+		".set _estack, sim_ram + 2048\n"
+		".set _sdata, sim_ram + 2048\n"
+		".set _sramfunc, sim_ram + 2048\n"
+		".set _eramfunc, sim_ram + 2048\n"
+		".set _ebss, sim_ram + 6144\n"
+		".set _end, sim_ram + 6144\n"
+		".set _eram, sim_ram + 16384\n");
+
+_Static_assert(SIM_STACK_SIZE + SIM_DATA_BSS_SIZE == 6144, "sim_ram layout out of sync with the linker symbols");
+
+/******    File Scope Variables    ******/
+static const uint64_t NEVER = UINT64_MAX;
+
+static sim_config config;
+static sim_stats stats;
+static uint64_t now_ns = 0;
+static uint64_t stop_ns = UINT64_MAX;		   // sim_run_until_ns() end, __WFI() does not dispatch past it
+static uint64_t due_ns[SIM_SOURCE_COUNT];
+static uint64_t plant_ns = 0;				   // Time the plant model has been advanced to
+static uint64_t clamp_release_ns = 0;		   // Last time the thermocouple clamp was released
+static uint8_t heater_pin = 0;
+static uint8_t clamp_engaged = 0;
+static uint32_t random_state = 1;
+static uint8_t faults = 0; // Bit per sim_faults
+static void (*barrier_hook)(void) = NULL;
+static void (*adc_source)(uint16_t *buffer, uint32_t length) = NULL;
+
+/******    Function Prototypes    ******/
+static void plant_sync(void);
+static void pendsv_check(void);
+static uint8_t next_source(void);
+static void dispatch(uint8_t source);
+static void wait_for_interrupt(uint64_t limit_ns);
+static void apply_set_reset(GPIO_TypeDef *port);
+static void set_input(GPIO_TypeDef *port, uint16_t pin, uint8_t level);
+
+/******    Setup and Run    ******/
+sim_config sim_default_config(void) {
+	sim_config defaults = {
+		.seed = 1,
+		.mains_hz = 50,
+		.zc_jitter_us = 20,
+		.vdda_mv = 3300,
+		.mcu_temp_c = 30,
+		.pcb_temp_c = 30,
+		.tool_in_holder = 0,
+		.tip_inserted = 1,
+		.ac_present = 1,
+		.plant = plant_default_config(),
+	};
+	return defaults;
+}
+
+// Resets the simulator to power up. The firmware's own static state is not reset, run one station per process
+void sim_init(const sim_config *new_config) {
+	config = *new_config;
+	memset(&stats, 0, sizeof(stats));
+	memset(&sim_scb, 0, sizeof(sim_scb));
+	memset(&sim_systick, 0, sizeof(sim_systick));
+	memset(&sim_nvic, 0, sizeof(sim_nvic));
+	memset(sim_ram, 0, sizeof(sim_ram));
+	sim_primask = 0;
+	now_ns = 0;
+	stop_ns = NEVER;
+	plant_ns = 0;
+	clamp_release_ns = 0;
+	heater_pin = 0;
+	clamp_engaged = 0;
+	random_state = config.seed ? config.seed : 1;
+	faults = 0;
+
+	for (uint8_t source = 0; source < SIM_SOURCE_COUNT; source++) {
+		due_ns[source] = NEVER;
+	}
+
+	plant_init(&config.plant);
+	display_reset();
+	hal_reset();
+
+	sim_set_tool_in_holder(config.tool_in_holder);
+	sim_set_tip_change(0);
+	sim_set_button(0);
+	sim_set_pcb_temp(config.pcb_temp_c);
+}
+
+void sim_boot(void) {
+	opensolder_init();
+}
+
+void sim_run_ms(uint32_t ms) {
+	sim_run_until_ns(now_ns + (uint64_t)ms * SIM_NS_PER_MS);
+}
+
+void sim_run_until_ns(uint64_t time_ns) {
+	stop_ns = time_ns;
+	while (now_ns < time_ns) {
+		opensolder_main();
+	}
+	stop_ns = NEVER;
+}
+
+uint64_t sim_time_ns(void) {
+	return now_ns;
+}
+
+/******    Stimuli    ******/
+// The stand, tip change and button inputs are pulled up, and read low when active
+void sim_set_tool_in_holder(uint8_t in_holder) {
+	set_input(STAND_GPIO_Port, STAND_Pin, !in_holder);
+}
+
+void sim_set_tip_change(uint8_t active) {
+	set_input(TIP_REMOVER_GPIO_Port, TIP_REMOVER_Pin, !active);
+}
+
+void sim_set_button(uint8_t pressed) {
+	set_input(ENC_SW_GPIO_Port, ENC_SW_Pin, !pressed);
+}
+
+// One step is one count of the encoder timer, the timer sets UIF when the counter wraps
+void sim_rotate_encoder(int32_t steps) {
+	uint32_t count = TIM2->CNT;
+	uint32_t new_count = count + (uint32_t)steps;
+	if (((steps > 0) && (new_count < count)) || ((steps < 0) && (new_count > count))) {
+		TIM2->SR |= TIM_SR_UIF;
+	}
+	TIM2->CNT = new_count;
+}
+
+void sim_set_ac(uint8_t present) {
+	plant_sync();
+	config.ac_present = present;
+	hal_zero_cross_restart();
+}
+
+void sim_set_tip_inserted(uint8_t inserted) {
+	config.tip_inserted = inserted;
+}
+
+void sim_set_load_w(double load_w) {
+	plant_sync();
+	plant_set_load_w(load_w);
+}
+
+void sim_set_pcb_temp(int16_t temp_c) {
+	config.pcb_temp_c = temp_c;
+	hal_pct2075_update();
+}
+
+void sim_set_fault(uint8_t fault, uint8_t active) {
+	if (active) {
+		faults |= 1 << fault;
+	} else {
+		faults &= ~(1 << fault);
+	}
+}
+
+/******    Observation    ******/
+uint8_t sim_heater_on(void) {
+	return heater_pin;
+}
+
+const plant_state *sim_get_plant(void) {
+	plant_sync();
+	return plant_get_state();
+}
+
+const sim_stats *sim_get_stats(void) {
+	plant_sync();
+	return &stats;
+}
+
+/******    Peripheral Models    ******/
+uint8_t sim_fault_active(uint8_t fault) {
+	return (faults >> fault) & 1;
+}
+
+void sim_adc_source(uint16_t *buffer, uint32_t length) {
+	if (adc_source) {
+		adc_source(buffer, length);
+	}
+}
+
+void sim_schedule(uint8_t source, uint64_t time_ns) {
+	due_ns[source] = (time_ns < now_ns) ? now_ns : time_ns;
+}
+
+void sim_cancel(uint8_t source) {
+	due_ns[source] = NEVER;
+}
+
+uint8_t sim_scheduled(uint8_t source) {
+	return due_ns[source] != NEVER;
+}
+
+uint64_t sim_due_ns(uint8_t source) {
+	return due_ns[source];
+}
+
+// Apply BSRR/BRR writes to ODR, and timestamp the pin changes the plant depends on
+void sim_pins_sync(void) {
+	apply_set_reset(GPIOA);
+	apply_set_reset(GPIOB);
+
+	uint8_t heater = (HEATER_GPIO_Port->ODR & HEATER_Pin) != 0;
+	if (heater != heater_pin) {
+		plant_sync();
+		heater_pin = heater;
+		stats.heater_switches += heater;
+	}
+
+	// The clamp pulls PA2 low while it is in output mode
+	uint8_t clamp = ((TIP_CLAMP_GPIO_Port->MODER & GPIO_MODER_MODER2) == GPIO_MODER_MODER2_0) && !(TIP_CLAMP_GPIO_Port->ODR & TIP_CLAMP_Pin);
+	if (clamp_engaged && !clamp) {
+		clamp_release_ns = now_ns;
+	}
+	clamp_engaged = clamp;
+}
+
+uint8_t sim_clamp_engaged(void) {
+	return clamp_engaged;
+}
+
+uint8_t sim_tip_check_high(void) {
+	return ((TIP_CHECK_GPIO_Port->MODER & GPIO_MODER_MODER1) == GPIO_MODER_MODER1_0) && (TIP_CHECK_GPIO_Port->ODR & TIP_CHECK_Pin);
+}
+
+uint64_t sim_clamp_release_ns(void) {
+	return clamp_release_ns;
+}
+
+// xorshift32, deterministic for a given seed
+uint32_t sim_random(void) {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+	return random_state;
+}
+
+// Uniform in [-amplitude, amplitude]
+double sim_random_uniform(double amplitude) {
+	return amplitude * (2.0 * (sim_random() / 4294967295.0) - 1.0);
+}
+
+const sim_config *sim_get_config(void) {
+	return &config;
+}
+
+void sim_set_barrier_hook(void (*hook)(void)) {
+	barrier_hook = hook;
+}
+
+void sim_set_adc_source(void (*source)(uint16_t *buffer, uint32_t length)) {
+	adc_source = source;
+}
+
+/******    Intrinsics    ******/
+void sim_wait_for_interrupt(void) {
+	wait_for_interrupt(stop_ns);
+}
+
+// HAL_Delay() waits for SysTick regardless of the run end, or it would never return
+void sim_wait_for_tick(void) {
+	wait_for_interrupt(NEVER);
+}
+
+void sim_memory_barrier(void) {
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (barrier_hook) {
+		barrier_hook();
+	}
+}
+
+uint32_t sim_get_msp(void) {
+	return (uint32_t)(uintptr_t)((uint8_t *)sim_ram + SIM_STACK_SIZE - SIM_STACK_IN_USE);
+}
+
+// sysmem.c is not part of the host build, the heap is always empty
+void *_sbrk(ptrdiff_t incr) {
+	extern uint8_t _end;
+	(void)incr;
+	return &_end;
+}
+
+/******    Static Functions    ******/
+static void plant_sync(void) {
+	if (now_ns > plant_ns) {
+		uint64_t dt_ns = now_ns - plant_ns;
+		uint8_t heating = heater_pin && config.ac_present;
+		plant_advance(dt_ns * 1e-9, heating);
+		if (heating) {
+			stats.heater_on_ns += dt_ns;
+		}
+		plant_ns = now_ns;
+	}
+}
+
+// The firmware pends PendSV by writing ICSR, it runs when nothing of higher priority is due
+static void pendsv_check(void) {
+	if (SCB->ICSR & SCB_ICSR_PENDSVSET_Msk) {
+		SCB->ICSR &= ~SCB_ICSR_PENDSVSET_Msk;
+		due_ns[SIM_PENDSV] = now_ns;
+	}
+}
+
+static uint8_t next_source(void) {
+	uint8_t next = 0;
+	for (uint8_t source = 1; source < SIM_SOURCE_COUNT; source++) {
+		if (due_ns[source] < due_ns[next]) {
+			next = source;
+		}
+	}
+	return next;
+}
+
+static void dispatch(uint8_t source) {
+	now_ns = due_ns[source];
+	due_ns[source] = NEVER;
+	plant_sync();
+	hal_timers_sync();
+	stats.dispatched++;
+
+	if (source == SIM_ZERO_CROSS) {
+		stats.zero_crosses++;
+	} else if (source == SIM_ADC_DMA) {
+		stats.readings++;
+	}
+
+	if (source == SIM_PENDSV) {
+		adc_process();
+	} else {
+		hal_dispatch(source);
+	}
+
+	sim_pins_sync();
+	pendsv_check();
+}
+
+// Dispatch the next interrupt due before limit_ns, or advance to limit_ns if there is none
+static void wait_for_interrupt(uint64_t limit_ns) {
+	pendsv_check();
+	uint8_t source = next_source();
+
+	if (due_ns[source] > limit_ns) {
+		if (limit_ns > now_ns) {
+			now_ns = limit_ns;
+			plant_sync();
+			hal_timers_sync();
+		}
+		return;
+	}
+	dispatch(source);
+}
+
+static void apply_set_reset(GPIO_TypeDef *port) {
+	port->ODR = (port->ODR | (port->BSRR & 0xFFFF)) & ~(port->BSRR >> 16) & ~port->BRR;
+	port->BSRR = 0;
+	port->BRR = 0;
+}
+
+static void set_input(GPIO_TypeDef *port, uint16_t pin, uint8_t level) {
+	if (level) {
+		port->IDR |= pin;
+	} else {
+		port->IDR &= ~pin;
+	}
+}
@@ -0,0 +1,149 @@
+/*
+ * sim.h
+ *
+ * Discrete-event simulation of the OpenSolder station, running the unmodified firmware on a host
+ *
+ * USAGE:
+ * - Call sim_init() with a configuration (sim_default_config() gives a T245 on 24VAC/50Hz)
+ * - Call sim_boot() to run opensolder_init(), the splash screen delay is simulated
+ * - Call sim_run_ms() to run the main loop, interrupts are dispatched while the firmware sleeps
+ * - Change the inputs with the stimulus functions (sim_set_tool_in_holder() etc.) between runs
+ * - Inject peripheral faults with sim_set_fault(), they stay until cleared
+ * - Read the station with the observation functions, and the display with display.h
+ *
+ * - TIME -
+ * Simulated time is kept in ns. The firmware runs in zero time, only waiting advances the clock:
+ * __WFI() (scheduler_idle()) and HAL_Delay() dispatch the next interrupt source that is due.
+ * The sources are the zero cross EXTI, TIM6, TIM7, TIM14 overflow, ADC DMA completion, SysTick,
+ * PendSV and the I2C interrupt. Sources due at the same time are dispatched in NVIC priority order,
+ * and PendSV runs adc_process() after the interrupt that pended it. Interrupts don't preempt each
+ * other or the main loop, an hour of station operation runs in a few seconds.
+ *
+ * - PERIPHERALS -
+ * The firmware's register accesses go to plain structs (shim/stm32f0xx.h), and hal.c implements
+ * the HAL calls the firmware uses on top of them. After every interrupt the pins are synced:
+ * BSRR/BRR writes are applied to ODR, and the heater, clamp and tip check pin changes are
+ * timestamped for the plant model (plant.h).
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+/******    Includes    ******/
+#include "opensolder.h"
+#include "plant.h"
+#include <stdint.h>
+
+/******    Constants and Objects    ******/
+enum sim_constants {
+	SIM_NS_PER_US = 1000,
+	SIM_NS_PER_MS = 1000000,
+	SIM_CPU_MHZ = 48,
+	SIM_I2C_TRANSFER_US = 400,	// PCT2075 register read at 100kHz
+	SIM_VREFINT_CAL = 1526,		// Typical factory calibration values
+	SIM_TEMPSENSOR_CAL1 = 1755, // 30C
+	SIM_TEMPSENSOR_CAL2 = 1328, // 110C
+	SIM_FAULT_TIMER_DELAY_US = 1500,
+	SIM_FAULT_ADC_NOISE_LSB = 600
+};
+
+// Faults injected in the peripheral models, the firmware is not changed
+enum sim_faults {
+	SIM_FAULT_ADC_NOISE = 0, // Spikes of SIM_FAULT_ADC_NOISE_LSB on every 4th thermocouple sample (noisy thermocouple)
+	SIM_FAULT_ADC_OPEN,		 // All thermocouple samples at full scale (open thermocouple or heater)
+	SIM_FAULT_DMA_DROP,		 // ADC DMA transfer complete interrupts are lost
+	SIM_FAULT_TIMER_DELAY,	 // TIM6 (true zero cross) interrupt serviced SIM_FAULT_TIMER_DELAY_US late
+	SIM_FAULT_I2C_FAIL,		 // PCT2075 reads are not acknowledged
+	SIM_FAULT_ZC_LOSS,		 // Zero cross edges are lost, while AC is still present
+	SIM_FAULT_COUNT
+};
+
+// Interrupt sources, in dispatch order for sources due at the same time (NVIC priority, then IRQ number)
+enum sim_sources {
+	SIM_ZERO_CROSS = 0, // EXTI4_15, priority 0
+	SIM_OS_PIN,			// EXTI4_15, priority 0
+	SIM_TIM6,			// Priority 0
+	SIM_TIM14,			// Priority 0
+	SIM_TIM7,			// Priority 1
+	SIM_ADC_DMA,		// DMA1 channel 1, priority 2
+	SIM_PENDSV,			// Priority 3
+	SIM_SYSTICK,		// Priority 3
+	SIM_I2C,			// Priority 3
+	SIM_SOURCE_COUNT
+};
+
+typedef struct {
+	uint32_t seed;			// Seed of the ADC noise and zero cross jitter
+	uint8_t mains_hz;		// 50 or 60
+	uint16_t zc_jitter_us;	// Random zero cross edge jitter, +-
+	uint16_t vdda_mv;		// Analog supply
+	int16_t mcu_temp_c;		// Internal temperature sensor reading
+	int16_t pcb_temp_c;		// PCT2075 reading
+	uint8_t tool_in_holder; // Initial input levels
+	uint8_t tip_inserted;
+	uint8_t ac_present;
+	plant_config plant;
+} sim_config;
+
+typedef struct {
+	uint64_t heater_on_ns;	   // Time with the heater pin high
+	uint32_t heater_switches; // Heater pin rising edges
+	uint32_t zero_crosses;
+	uint32_t readings;		   // Completed ADC DMA transfers
+	uint32_t dispatched;	   // Interrupts dispatched
+} sim_stats;
+
+/******    Function Declarations    ******/
+// Setup and run
+sim_config sim_default_config(void);
+void sim_init(const sim_config *config);
+void sim_boot(void);
+void sim_run_ms(uint32_t ms);
+void sim_run_until_ns(uint64_t time_ns);
+uint64_t sim_time_ns(void);
+
+// Stimuli
+void sim_set_tool_in_holder(uint8_t in_holder);
+void sim_set_tip_change(uint8_t active);
+void sim_set_button(uint8_t pressed);
+void sim_rotate_encoder(int32_t steps);
+void sim_set_ac(uint8_t present);
+void sim_set_tip_inserted(uint8_t inserted);
+void sim_set_load_w(double load_w);
+void sim_set_pcb_temp(int16_t temp_c);
+void sim_set_fault(uint8_t fault, uint8_t active);
+
+// Observation
+uint8_t sim_heater_on(void);
+const plant_state *sim_get_plant(void);
+const sim_stats *sim_get_stats(void);
+
+// Test hooks
+void sim_set_barrier_hook(void (*hook)(void)); // Called from every __DMB(), to interleave "interrupts" with the main loop
+void sim_set_adc_source(void (*source)(uint16_t *buffer, uint32_t length)); // Called with the samples of every thermocouple transfer, to replace them (replay.h)
+
+// Peripheral models (sim.c and hal.c)
+void sim_schedule(uint8_t source, uint64_t time_ns);
+void sim_cancel(uint8_t source);
+uint8_t sim_scheduled(uint8_t source);
+uint64_t sim_due_ns(uint8_t source);
+void sim_wait_for_tick(void);
+void sim_pins_sync(void);
+uint8_t sim_clamp_engaged(void);
+uint8_t sim_tip_check_high(void);
+uint64_t sim_clamp_release_ns(void);
+uint8_t sim_fault_active(uint8_t fault);
+void sim_adc_source(uint16_t *buffer, uint32_t length);
+uint32_t sim_random(void);
+double sim_random_uniform(double amplitude);
+const sim_config *sim_get_config(void);
+void hal_reset(void);
+void hal_dispatch(uint8_t source);
+void hal_timers_sync(void);
+void hal_zero_cross_restart(void);
+void hal_pct2075_update(void);
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * station.c
+ *
+ * Runs the firmware on the host simulation for a number of simulated hours, and reports the
+ * simulation speed and station statistics
+ *
+ * Usage: opensolder_sim [hours] [seed] [--display]
+ * The tool is used for 10 minutes and placed in the holder for 5, with a 10W soldering load
+ * for 2s every 30s while in use.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "display.h"
+#include "power_stats.h"
+#include "scheduler.h"
+#include "sim.h"
+#include "temperature.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/******    Constants    ******/
+enum station_constants {
+	USE_TIME_S = 600,
+	HOLDER_TIME_S = 300,
+	LOAD_INTERVAL_S = 30,
+	LOAD_TIME_S = 2,
+	LOAD_W = 10
+};
+
+/******    Functions    ******/
+static double wall_time_s(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+	double hours = 1;
+	uint32_t seed = 1;
+	uint8_t show_display = 0;
+	uint8_t positional = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--display") == 0) {
+			show_display = 1;
+		} else if (positional++ == 0) {
+			hours = atof(argv[i]);
+		} else {
+			seed = strtoul(argv[i], NULL, 0);
+		}
+	}
+
+	sim_config config = sim_default_config();
+	config.seed = seed;
+	sim_init(&config);
+
+	double start_s = wall_time_s();
+	sim_boot();
+
+	uint32_t seconds = hours * 3600;
+	for (uint32_t s = 0; s < seconds; s++) {
+		uint32_t cycle_s = s % (USE_TIME_S + HOLDER_TIME_S);
+		uint8_t in_use = cycle_s < USE_TIME_S;
+		sim_set_tool_in_holder(!in_use);
+		sim_set_load_w((in_use && ((cycle_s % LOAD_INTERVAL_S) < LOAD_TIME_S)) ? LOAD_W : 0);
+		sim_run_ms(1000);
+	}
+
+	double elapsed_s = wall_time_s() - start_s;
+	double simulated_s = sim_time_ns() * 1e-9;
+	const sim_stats *stats = sim_get_stats();
+	const plant_state *plant = sim_get_plant();
+
+	printf("simulated         %.0f s\n", simulated_s);
+	printf("wall clock        %.2f s (%.0fx real time)\n", elapsed_s, simulated_s / elapsed_s);
+	printf("state             %u\n", get_system_state());
+	printf("tip temperature   %u C (set %u C), heater model %.1f C, max %.1f C\n", get_station_snapshot()->tip_temp, get_set_temp(), plant->heater_c, plant->max_heater_c);
+	printf("zero crosses      %u\n", stats->zero_crosses);
+	printf("ADC transfers     %u\n", stats->readings);
+	printf("interrupts        %u\n", stats->dispatched);
+	printf("heater            %.1f%% on, %u switch-ons, %.0f J\n", 100.0 * stats->heater_on_ns / sim_time_ns(), stats->heater_switches, plant->energy_j);
+	printf("firmware energy   %u J\n", power_stats_get_energy_j());
+	printf("scheduler         %u overruns\n", scheduler_get_overruns());
+
+	if (show_display) {
+		display_print(stdout);
+	}
+	return 0;
+}
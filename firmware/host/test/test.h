@@ -0,0 +1,60 @@
+/*
+ * test.h
+ *
+ * Minimal test helpers for the host build
+ *
+ * USAGE:
+ * - Write each test as a static void function using the CHECK macros, a failed check is reported
+ *   and the test continues
+ * - Call RUN_TEST() for each test from main(), and return TEST_RESULT()
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+/******    Includes    ******/
+#include <stdio.h>
+
+/******    Macros    ******/
+static int test_failures = 0;
+
+#define CHECK(condition)                                                           \
+	do {                                                                           \
+		if (!(condition)) {                                                        \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			test_failures++;                                                       \
+		}                                                                          \
+	} while (0)
+
+#define CHECK_EQUAL(actual, expected)                                                                        \
+	do {                                                                                                     \
+		long long actual_value = (long long)(actual);                                                        \
+		long long expected_value = (long long)(expected);                                                    \
+		if (actual_value != expected_value) {                                                                \
+			fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, actual_value, expected_value); \
+			test_failures++;                                                                                 \
+		}                                                                                                    \
+	} while (0)
+
+#define CHECK_RANGE(actual, min, max)                                                                              \
+	do {                                                                                                           \
+		double range_value = (double)(actual);                                                                     \
+		if ((range_value < (min)) || (range_value > (max))) {                                                      \
+			fprintf(stderr, "%s:%d: %s is %g, expected %g..%g\n", __FILE__, __LINE__, #actual, range_value, (double)(min), (double)(max)); \
+			test_failures++;                                                                                       \
+		}                                                                                                          \
+	} while (0)
+
+#define RUN_TEST(test)                          \
+	do {                                        \
+		int failures_before = test_failures;    \
+		test();                                 \
+		printf("%s %s\n", (test_failures == failures_before) ? "pass" : "FAIL", #test); \
+	} while (0)
+
+#define TEST_RESULT() (test_failures ? 1 : 0)
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * test_cartridge.c
+ *
+ * Tip resistance estimate, family classification and drift
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "cartridge.h"
+#include "test.h"
+
+/******    Helpers    ******/
+// Tip check rise for a heater resistance, the inverse of the estimate in cartridge_update()
+static uint16_t rise_for(uint32_t resistance_mohm) {
+	return ((uint64_t)resistance_mohm * 4096 * TC_AMP_GAIN + (TIP_CHECK_PULL_OHM * 1000UL / 2)) / (TIP_CHECK_PULL_OHM * 1000UL);
+}
+
+// Checks with the tip settled at tip_temp
+static void check_settled(uint32_t resistance_mohm, uint16_t tip_temp, uint8_t checks) {
+	for (uint8_t i = 0; i < checks; i++) {
+		cartridge_update(rise_for(resistance_mohm), tip_temp, tip_temp);
+	}
+}
+
+static void insert_tip(uint32_t resistance_mohm, uint16_t tip_temp) {
+	cartridge_reset();
+	check_settled(resistance_mohm, tip_temp, CARTRIDGE_MIN_CHECKS);
+}
+
+/******    Tests    ******/
+static void test_unknown_until_classified(void) {
+	cartridge_reset();
+	CHECK_EQUAL(cartridge_get_family(), CARTRIDGE_UNKNOWN);
+	CHECK_EQUAL(cartridge_get_resistance_mohm(), 0);
+	CHECK_EQUAL(cartridge_get_profile()->max_on_periods, MAX_ON_PERIODS);
+
+	check_settled(2500, 300, CARTRIDGE_MIN_CHECKS - 1);
+	CHECK_EQUAL(cartridge_get_family(), CARTRIDGE_UNKNOWN);
+	check_settled(2500, 300, 1);
+	CHECK_EQUAL(cartridge_get_family(), CARTRIDGE_STANDARD);
+}
+
+static void test_estimate(void) {
+	insert_tip(2500, 300);
+	CHECK_RANGE(cartridge_get_resistance_mohm(), 2450, 2550);
+	insert_tip(4000, 300);
+	CHECK_RANGE(cartridge_get_resistance_mohm(), 3950, 4050);
+}
+
+static void test_families(void) {
+	insert_tip(1500, 300);
+	CHECK_EQUAL(cartridge_get_family(), CARTRIDGE_LOW_R);
+	CHECK(cartridge_get_profile()->max_on_periods < MAX_ON_PERIODS);
+	insert_tip(2500, 300);
+	CHECK_EQUAL(cartridge_get_family(), CARTRIDGE_STANDARD);
+	insert_tip(4000, 300);
+	CHECK_EQUAL(cartridge_get_family(), CARTRIDGE_HIGH_R);
+	insert_tip(8000, 300);
+	CHECK_EQUAL(cartridge_get_family(), CARTRIDGE_UNKNOWN);
+
+	// Every profile stays within the power limit of the firmware
+	for (uint8_t family = 0; family < CARTRIDGE_FAMILY_COUNT; family++) {
+		insert_tip(family == CARTRIDGE_LOW_R ? 1500 : family == CARTRIDGE_HIGH_R ? 4000 : 2500, 300);
+		CHECK(cartridge_get_profile()->max_on_periods <= MAX_ON_PERIODS);
+	}
+}
+
+// Drift is only updated near the reference temperature, and flags the cartridge as worn
+static void test_drift(void) {
+	insert_tip(2500, 300);
+	CHECK_EQUAL(cartridge_get_drift_permille(), 0);
+
+	check_settled(3000, 100, 20); // Far from the reference temperature
+	CHECK_EQUAL(cartridge_get_drift_permille(), 0);
+	CHECK(!cartridge_is_worn());
+
+	check_settled(3000, 310, 20);
+	CHECK_RANGE(cartridge_get_drift_permille(), 180, 220);
+	CHECK(cartridge_is_worn());
+
+	cartridge_reset();
+	CHECK(!cartridge_is_worn());
+	CHECK_EQUAL(cartridge_get_family(), CARTRIDGE_UNKNOWN);
+}
+
+// The resistance rises while the tip heats up, those checks must not become the reference
+static void test_reference_settled(void) {
+	cartridge_reset();
+	for (uint16_t tip_temp = 100; tip_temp < 320; tip_temp += 40) {
+		cartridge_update(rise_for(2000 + 2 * tip_temp), tip_temp, 320);
+	}
+	CHECK_EQUAL(cartridge_get_drift_permille(), 0);
+	check_settled(2640, 320, CARTRIDGE_MIN_CHECKS);
+	check_settled(2640, 320, CARTRIDGE_MIN_CHECKS);
+	CHECK_RANGE(cartridge_get_drift_permille(), -5, 5);
+	CHECK(!cartridge_is_worn());
+
+	// After a set temperature change, the checks until the tip is in band again are not used
+	cartridge_update(rise_for(2560), 280, 300);
+	cartridge_update(rise_for(2560), 290, 300);
+	check_settled(2640, 320, CARTRIDGE_MIN_CHECKS);
+	CHECK_RANGE(cartridge_get_drift_permille(), -5, 5);
+
+	// A drift average needs CARTRIDGE_MIN_CHECKS in band checks in a row
+	check_settled(3300, 320, CARTRIDGE_MIN_CHECKS - 1);
+	cartridge_update(rise_for(3300), 320, 0); // Heater off
+	check_settled(3300, 320, CARTRIDGE_MIN_CHECKS - 1);
+	CHECK_RANGE(cartridge_get_drift_permille(), -5, 5);
+	check_settled(3300, 320, 1);
+	CHECK(cartridge_is_worn());
+}
+
+int main(void) {
+	RUN_TEST(test_unknown_until_classified);
+	RUN_TEST(test_estimate);
+	RUN_TEST(test_families);
+	RUN_TEST(test_drift);
+	RUN_TEST(test_reference_settled);
+	return TEST_RESULT();
+}
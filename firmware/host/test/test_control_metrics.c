@@ -0,0 +1,86 @@
+/*
+ * test_control_metrics.c
+ *
+ * Control run metrics from synthetic reading sequences
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "control_metrics.h"
+#include "test.h"
+
+/******    Helpers    ******/
+// One reading every 10ms, the tick is the HAL tick of the host build
+static void reading(uint16_t tip_temp, uint16_t target_temp) {
+	uwTick += 10;
+	control_metrics_update(tip_temp, 0, target_temp);
+}
+
+static void hold(uint16_t tip_temp, uint16_t target_temp, uint32_t ms) {
+	for (uint32_t t = 0; t < ms; t += 10) {
+		reading(tip_temp, target_temp);
+	}
+}
+
+/******    Tests    ******/
+static void test_step_up(void) {
+	uint32_t head = control_log.head;
+	reading(25, 320);
+	const control_run *run = control_metrics_get_run();
+	CHECK_EQUAL(run->status, CONTROL_RUN_RISING);
+	CHECK_EQUAL(run->start_temp, 25);
+
+	// Ramp to the target in 1s with 8 degrees overshoot
+	for (uint16_t temp = 30; temp < 320; temp += 3) {
+		reading(temp, 320);
+	}
+	hold(328, 320, 100);
+	CHECK_EQUAL(run->status, CONTROL_RUN_SETTLING);
+	CHECK_EQUAL(run->overshoot, 8);
+
+	hold(321, 320, CONTROL_SETTLE_HOLD_MS + 100);
+	CHECK_EQUAL(run->status, CONTROL_RUN_SETTLED);
+	CHECK_RANGE(run->rise_time_ms, 900, 1000);
+	CHECK_RANGE(run->settling_time_ms, 1000, 1100); // Last band entry, after the overshoot
+
+	// A load drops the tip 30 degrees below the band for 500ms
+	hold(290, 320, 500);
+	hold(320, 320, 100);
+	CHECK_EQUAL(run->droop, 30);
+	CHECK_RANGE(run->recovery_time_ms, 490, 510);
+	CHECK_EQUAL(run->ripple, 1);
+
+	// Turning the heater off finishes the run into the log
+	reading(320, 0);
+	CHECK_EQUAL(control_log.head, head + 1);
+	CHECK_EQUAL(control_log.runs[head & (CONTROL_LOG_LENGTH - 1)].target_temp, 320);
+}
+
+static void test_step_down(void) {
+	hold(320, 320, 100);
+	hold(320, 160, 10);
+	const control_run *run = control_metrics_get_run();
+	CHECK_EQUAL(run->target_temp, 160);
+	for (uint16_t temp = 320; temp > 150; temp -= 2) {
+		reading(temp, 160);
+	}
+	CHECK_EQUAL(run->overshoot, 8); // Undershoot counts in the step direction
+	hold(160, 160, CONTROL_SETTLE_HOLD_MS + 100);
+	CHECK_EQUAL(run->status, CONTROL_RUN_SETTLED);
+}
+
+static void test_errors_ignored(void) {
+	hold(25, 300, 10);
+	const control_run *run = control_metrics_get_run();
+	hold(ADC_READING_ERROR, 300, 100);
+	CHECK_EQUAL(run->overshoot, 0);
+	CHECK_EQUAL(run->status, CONTROL_RUN_RISING);
+}
+
+int main(void) {
+	RUN_TEST(test_step_up);
+	RUN_TEST(test_step_down);
+	RUN_TEST(test_errors_ignored);
+	return TEST_RESULT();
+}
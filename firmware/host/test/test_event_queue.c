@@ -0,0 +1,83 @@
+/*
+ * test_event_queue.c
+ *
+ * Event queue: order, sequence numbers and dropped events on a full queue
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "event_queue.h"
+#include "test.h"
+
+/******    Helpers    ******/
+static uint8_t push_measurement(uint16_t tip_temp) {
+	event new_event = {.type = EVENT_MEASUREMENT, .data.measurement = {.tip_temp = tip_temp}};
+	return event_push(&new_event);
+}
+
+/******    Tests    ******/
+static void test_empty(void) {
+	event popped;
+	CHECK(!event_pop(&popped));
+}
+
+static void test_fifo_order(void) {
+	for (uint16_t i = 0; i < 5; i++) {
+		CHECK(push_measurement(100 + i));
+	}
+
+	event popped;
+	uint16_t sequence = 0;
+	for (uint16_t i = 0; i < 5; i++) {
+		CHECK(event_pop(&popped));
+		CHECK_EQUAL(popped.type, EVENT_MEASUREMENT);
+		CHECK_EQUAL(popped.data.measurement.tip_temp, 100 + i);
+		if (i) {
+			CHECK_EQUAL(popped.sequence, (uint16_t)(sequence + 1));
+		}
+		sequence = popped.sequence;
+	}
+	CHECK(!event_pop(&popped));
+}
+
+// A full queue drops the new event, and the consumer sees the gap in the sequence numbers
+static void test_full_queue_drops(void) {
+	uint16_t dropped = event_queue_get_dropped();
+	for (uint16_t i = 0; i < EVENT_QUEUE_LENGTH; i++) {
+		CHECK(push_measurement(i));
+	}
+	CHECK(!push_measurement(999));
+	CHECK_EQUAL(event_queue_get_dropped(), dropped + 1);
+
+	event popped;
+	uint16_t last_sequence = 0;
+	for (uint16_t i = 0; i < EVENT_QUEUE_LENGTH; i++) {
+		CHECK(event_pop(&popped));
+		last_sequence = popped.sequence;
+	}
+
+	CHECK(push_measurement(1000));
+	CHECK(event_pop(&popped));
+	CHECK_EQUAL(popped.data.measurement.tip_temp, 1000);
+	CHECK_EQUAL((uint16_t)(popped.sequence - last_sequence), 2);
+}
+
+// The 8 bit indices wrap many times
+static void test_index_wrap(void) {
+	event popped;
+	for (uint16_t i = 0; i < 1000; i++) {
+		CHECK(push_measurement(i));
+		CHECK(event_pop(&popped));
+		CHECK_EQUAL(popped.data.measurement.tip_temp, i);
+	}
+	CHECK(!event_pop(&popped));
+}
+
+int main(void) {
+	RUN_TEST(test_empty);
+	RUN_TEST(test_fifo_order);
+	RUN_TEST(test_full_queue_drops);
+	RUN_TEST(test_index_wrap);
+	return TEST_RESULT();
+}
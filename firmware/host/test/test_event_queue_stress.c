@@ -0,0 +1,238 @@
+/*
+ * test_event_queue_stress.c
+ *
+ * Event queue under interleaved producers and consumer:
+ * - Seeded "interrupts" that push events preempt the consumer at every __DMB() in event_pop(),
+ *   and between the consumer's reads. The consumer is read_events() of opensolder.c, and must end
+ *   every pass with the current tip and AC levels, also when level events were dropped
+ * - A producer and a consumer thread run the queue concurrently, and every event must arrive
+ *   whole, in order, or be counted as dropped
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "event_queue.h"
+#include "sim.h"
+#include "test.h"
+#include <pthread.h>
+#include <sched.h>
+
+/******    File Scope Variables    ******/
+static uint32_t random_state = 12345;
+static uint8_t in_interrupt = 0;
+static uint32_t interrupt_chance = 4; // One in interrupt_chance barriers is preempted
+static uint32_t interrupt_budget = 0; // Interrupts left in this pass, the consumer must be able to drain the queue
+
+// Producer model
+static uint32_t pushed = 0;
+static uint16_t measurement_count = 0;
+static uint16_t current_tip_state = TIP_NOT_DETECTED;
+static uint8_t current_ac_state = OFF;
+
+// Consumer, as read_events()
+static station_snapshot snapshot = {.tip_state = TIP_NOT_DETECTED, .ac_state = OFF, .sequence = UINT16_MAX};
+static uint32_t popped = 0;
+static uint16_t last_measurement = 0;
+static uint8_t order_errors = 0;
+
+/******    Helpers    ******/
+static uint32_t next_random(void) {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+	return random_state;
+}
+
+// The producer interrupt: a few events, levels change at random
+static void interrupt(void) {
+	in_interrupt = 1;
+	uint8_t count = 1 + next_random() % 3;
+	for (uint8_t i = 0; i < count; i++) {
+		event new_event = {0};
+		switch (next_random() % 4) {
+			case 0:
+				current_tip_state = (next_random() & 1) ? TIP_DETECTED : TIP_NOT_DETECTED;
+				new_event.type = EVENT_TIP_STATE;
+				new_event.data.tip_state = current_tip_state;
+				break;
+			case 1:
+				current_ac_state = next_random() & 1;
+				new_event.type = EVENT_AC_STATE;
+				new_event.data.ac_state = current_ac_state;
+				break;
+			default:
+				new_event.type = EVENT_MEASUREMENT;
+				new_event.data.measurement.tip_temp = ++measurement_count;
+				new_event.data.measurement.on_periods = measurement_count & 0xFF;
+				break;
+		}
+		event_push(&new_event);
+		pushed++;
+	}
+	in_interrupt = 0;
+}
+
+static void maybe_interrupt(void) {
+	if (!in_interrupt && interrupt_budget && ((next_random() % interrupt_chance) == 0)) {
+		interrupt_budget--;
+		interrupt();
+	}
+}
+
+static void read_events(void) {
+	event new_event;
+	while (event_pop(&new_event)) {
+		popped++;
+		if ((int16_t)(new_event.sequence - snapshot.sequence) <= 0) {
+			order_errors++;
+		}
+		snapshot.lost_events += (uint16_t)(new_event.sequence - snapshot.sequence - 1);
+		snapshot.sequence = new_event.sequence;
+
+		switch (new_event.type) {
+			case EVENT_MEASUREMENT:
+				if (((int16_t)(new_event.data.measurement.tip_temp - last_measurement) <= 0) || (new_event.data.measurement.on_periods != (new_event.data.measurement.tip_temp & 0xFF))) {
+					order_errors++;
+				}
+				last_measurement = new_event.data.measurement.tip_temp;
+				break;
+			case EVENT_TIP_STATE:
+				snapshot.tip_state = new_event.data.tip_state;
+				break;
+			case EVENT_AC_STATE:
+				snapshot.ac_state = new_event.data.ac_state;
+				break;
+		}
+		maybe_interrupt(); // Preempted between two pops
+	}
+
+	uint16_t level;
+	if (event_get_level(EVENT_TIP_STATE, &level)) {
+		snapshot.tip_state = level;
+	}
+	if (event_get_level(EVENT_AC_STATE, &level)) {
+		snapshot.ac_state = level;
+	}
+}
+
+/******    Tests    ******/
+static void test_interleaved(void) {
+	sim_set_barrier_hook(maybe_interrupt);
+	uint32_t stale_passes = 0;
+
+	for (uint32_t pass = 0; pass < 200000; pass++) {
+		// Now and then the main loop is held up, and the queue overflows
+		interrupt_chance = ((pass % 1000) < 50) ? 1 : 4;
+		interrupt_budget = 16;
+		uint32_t blocked = ((pass % 5000) == 0) ? 40 : 0;
+		for (uint32_t i = 0; i < blocked; i++) {
+			interrupt();
+		}
+
+		read_events();
+		if ((snapshot.tip_state != current_tip_state) || (snapshot.ac_state != current_ac_state)) {
+			stale_passes++;
+		}
+		maybe_interrupt();
+	}
+	sim_set_barrier_hook(NULL);
+	interrupt_budget = 0;
+	read_events();
+
+	CHECK_EQUAL(order_errors, 0);
+	CHECK_EQUAL(stale_passes, 0);
+	CHECK_EQUAL((uint16_t)(popped + event_queue_get_dropped()), (uint16_t)pushed); // The drop counter is 16 bit
+	CHECK_EQUAL(snapshot.lost_events, event_queue_get_dropped());
+	CHECK(event_queue_get_dropped() > 0); // The overflow path was exercised
+}
+
+/******    Threads    ******/
+enum thread_constants {
+	THREAD_EVENTS = 2000000
+};
+
+static volatile uint8_t producer_done = 0;
+static uint16_t producer_last_tip_state = 0;
+
+static void *producer_thread(void *argument) {
+	for (uint32_t i = 1; i <= THREAD_EVENTS; i++) {
+		event new_event = {0};
+		if ((i % 7) == 0) {
+			producer_last_tip_state = (i / 7) & 1 ? TIP_DETECTED : TIP_NOT_DETECTED;
+			new_event.type = EVENT_TIP_STATE;
+			new_event.data.tip_state = producer_last_tip_state;
+		} else {
+			new_event.type = EVENT_MEASUREMENT;
+			new_event.data.measurement.tip_temp = i & 0xFFFF;
+			new_event.data.measurement.on_periods = (i * 31) & 0xFF;
+		}
+		if (!event_push(&new_event)) {
+			sched_yield(); // Let the consumer catch up, the gaps in the sequence stay short
+		}
+	}
+	producer_done = 1;
+	return NULL;
+}
+
+static void test_threads(void) {
+	uint16_t dropped_before = event_queue_get_dropped();
+	event drain;
+	while (event_pop(&drain)) {
+	}
+
+	pthread_t producer;
+	pthread_create(&producer, NULL, producer_thread, NULL);
+
+	uint32_t received = 0;
+	uint32_t torn = 0;
+	uint32_t out_of_order = 0;
+	uint16_t previous_sequence = 0;
+	uint16_t sequence_offset = 0; // Sequence number minus payload, the same for every event
+	uint8_t offset_known = 0;
+	uint8_t first = 1;
+	event new_event;
+
+	for (;;) {
+		uint8_t done = producer_done; // Read before popping, the last events are then always seen
+		if (!event_pop(&new_event)) {
+			if (done) {
+				break;
+			}
+			sched_yield();
+			continue;
+		}
+		received++;
+		if (!first && ((int16_t)(new_event.sequence - previous_sequence) <= 0)) {
+			out_of_order++;
+		}
+		previous_sequence = new_event.sequence;
+
+		if (new_event.type == EVENT_MEASUREMENT) {
+			uint16_t index = new_event.data.measurement.tip_temp;
+			if (!offset_known) {
+				sequence_offset = new_event.sequence - index;
+				offset_known = 1;
+			}
+			if (((uint16_t)(new_event.sequence - index) != sequence_offset) || (new_event.data.measurement.on_periods != ((index * 31) & 0xFF))) {
+				torn++;
+			}
+		}
+		first = 0;
+	}
+	pthread_join(producer, NULL);
+
+	uint16_t level = 0;
+	CHECK(event_get_level(EVENT_TIP_STATE, &level));
+	CHECK_EQUAL(level, producer_last_tip_state);
+	CHECK_EQUAL(torn, 0);
+	CHECK_EQUAL(out_of_order, 0);
+	CHECK_EQUAL((uint16_t)(received + event_queue_get_dropped() - dropped_before), (uint16_t)THREAD_EVENTS);
+	CHECK(received > 0);
+}
+
+int main(void) {
+	RUN_TEST(test_interleaved);
+	RUN_TEST(test_threads);
+	return TEST_RESULT();
+}
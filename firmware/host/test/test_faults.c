@@ -0,0 +1,159 @@
+/*
+ * test_faults.c
+ *
+ * Fault campaign on the simulated station: every fault class of sim_set_fault() is injected while
+ * the station heats in ON state, and the time until the firmware detects it and cuts the heater is
+ * measured. The station must recover to ON state when the fault is cleared.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "pct2075.h"
+#include "sim.h"
+#include "temperature.h"
+#include "test.h"
+
+/******    Constants    ******/
+enum fault_test_constants {
+	FAULT_SETTLE_MS = 10000,	   // In ON state before the injection
+	FAULT_DURATION_MS = PCB_TEMP_READ_INTERVAL_MS + 500, // At least one PCB temperature reading
+	FAULT_HEATER_CUT_MAX_MS = 60,  // From injection to the last heater on, for the faults that must cut it
+	FAULT_RECOVERY_MS = 5000,
+	FAULT_NOT_DETECTED = 0xFFFFFFFF
+};
+
+/******    File Scope Variables    ******/
+static const char *const fault_names[SIM_FAULT_COUNT] = {
+	[SIM_FAULT_ADC_NOISE] = "ADC noise",
+	[SIM_FAULT_ADC_OPEN] = "open thermocouple",
+	[SIM_FAULT_DMA_DROP] = "dropped ADC DMA",
+	[SIM_FAULT_TIMER_DELAY] = "late timer interrupt",
+	[SIM_FAULT_I2C_FAIL] = "I2C failure",
+	[SIM_FAULT_ZC_LOSS] = "lost zero cross",
+};
+
+typedef struct {
+	uint32_t detection_ms;
+	uint32_t heater_cut_ms; // Last heater on after the injection
+	double max_heater_c; // Plant temperature, the reading may be what the fault corrupts
+	uint8_t recovered;
+} fault_result;
+
+static fault_result results[SIM_FAULT_COUNT];
+
+/******    Helpers    ******/
+// Returns SET when the firmware has reacted to the fault
+static uint8_t fault_detected(uint8_t fault) {
+	const station_snapshot *station = get_station_snapshot();
+
+	switch (fault) {
+		case SIM_FAULT_ADC_NOISE:
+		case SIM_FAULT_ADC_OPEN:
+			return (station->tip_state != TIP_DETECTED) || (get_system_state() != ON_STATE);
+		case SIM_FAULT_DMA_DROP:
+			return get_system_state() == ERROR_STATE;
+		case SIM_FAULT_I2C_FAIL:
+			return pct2075_get_temperature() == PCT2075_READ_ERROR;
+		case SIM_FAULT_ZC_LOSS:
+			return station->ac_state == OFF;
+		default:
+			return RESET; // A late timer interrupt is not detected, the heater is only switched late
+	}
+}
+
+// Runs until ON state, returns SET if it was reached in time
+static uint8_t run_until_on(uint32_t timeout_ms) {
+	for (uint32_t ms = 0; ms <= timeout_ms; ms++) {
+		if (get_system_state() == ON_STATE) {
+			return SET;
+		}
+		sim_run_ms(1);
+	}
+	return RESET;
+}
+
+static fault_result inject(uint8_t fault) {
+	fault_result result = {.detection_ms = FAULT_NOT_DETECTED};
+
+	sim_run_ms(FAULT_SETTLE_MS);
+	sim_set_fault(fault, 1);
+	for (uint32_t ms = 1; ms <= FAULT_DURATION_MS; ms++) {
+		sim_run_ms(1);
+		if (sim_heater_on()) {
+			result.heater_cut_ms = ms;
+		}
+		if ((result.detection_ms == FAULT_NOT_DETECTED) && fault_detected(fault)) {
+			result.detection_ms = ms;
+		}
+		if (sim_get_plant()->heater_c > result.max_heater_c) {
+			result.max_heater_c = sim_get_plant()->heater_c;
+		}
+	}
+	sim_set_fault(fault, 0);
+	result.recovered = run_until_on(FAULT_RECOVERY_MS);
+	return result;
+}
+
+static void print_results(void) {
+	printf("%-22s %12s %14s %13s %10s\n", "fault", "detected ms", "heater cut ms", "max heater C", "recovered");
+	for (uint8_t fault = 0; fault < SIM_FAULT_COUNT; fault++) {
+		const fault_result *result = &results[fault];
+		if (result->detection_ms == FAULT_NOT_DETECTED) {
+			printf("%-22s %12s", fault_names[fault], "-");
+		} else {
+			printf("%-22s %12u", fault_names[fault], result->detection_ms);
+		}
+		printf(" %14u %13.1f %10s\n", result->heater_cut_ms, result->max_heater_c, result->recovered ? "yes" : "no");
+	}
+}
+
+/******    Tests    ******/
+static void test_campaign(void) {
+	sim_boot();
+	CHECK(run_until_on(5000));
+
+	for (uint8_t fault = 0; fault < SIM_FAULT_COUNT; fault++) {
+		results[fault] = inject(fault);
+	}
+	print_results();
+}
+
+// The heater must be cut when the temperature reading or the zero cross is lost
+static void test_heater_cut(void) {
+	const uint8_t must_cut[] = {SIM_FAULT_ADC_OPEN, SIM_FAULT_DMA_DROP, SIM_FAULT_ZC_LOSS};
+	for (uint8_t i = 0; i < sizeof(must_cut); i++) {
+		CHECK(results[must_cut[i]].detection_ms <= FAULT_DURATION_MS);
+		CHECK(results[must_cut[i]].heater_cut_ms <= FAULT_HEATER_CUT_MAX_MS);
+	}
+}
+
+static void test_degraded(void) {
+	// Noise spikes must not run away with the tip temperature
+	CHECK(results[SIM_FAULT_ADC_NOISE].max_heater_c < DEFAULT_TEMP + 20);
+	// Without PCB temperature readings the heater keeps running
+	CHECK(results[SIM_FAULT_I2C_FAIL].detection_ms <= FAULT_DURATION_MS);
+	CHECK(results[SIM_FAULT_I2C_FAIL].heater_cut_ms > FAULT_HEATER_CUT_MAX_MS);
+	// A late timer interrupt is measured, and the heater keeps regulating
+	CHECK(get_zc_latency_max_us() >= SIM_FAULT_TIMER_DELAY_US);
+	CHECK(results[SIM_FAULT_TIMER_DELAY].heater_cut_ms > FAULT_HEATER_CUT_MAX_MS);
+	CHECK_RANGE(results[SIM_FAULT_TIMER_DELAY].max_heater_c, DEFAULT_TEMP - 10, DEFAULT_TEMP + 10);
+}
+
+static void test_recovery(void) {
+	for (uint8_t fault = 0; fault < SIM_FAULT_COUNT; fault++) {
+		CHECK(results[fault].recovered);
+	}
+	CHECK(pct2075_get_temperature() != PCT2075_READ_ERROR);
+}
+
+int main(void) {
+	sim_config config = sim_default_config();
+	sim_init(&config);
+
+	RUN_TEST(test_campaign);
+	RUN_TEST(test_heater_cut);
+	RUN_TEST(test_degraded);
+	RUN_TEST(test_recovery);
+	return TEST_RESULT();
+}
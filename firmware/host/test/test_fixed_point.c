@@ -0,0 +1,74 @@
+/*
+ * test_fixed_point.c
+ *
+ * Fixed-point helpers against double precision references
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "fixed_point.h"
+#include "test.h"
+#include <math.h>
+
+/******    Tests    ******/
+// FIXED_DIV_CONST() is exact for 12 bit values and divisors up to 256
+static void test_div_const(void) {
+#define CHECK_DIVISOR(divisor)                                    \
+	for (uint32_t x = 0; x < 4096; x++) {                         \
+		if (FIXED_DIV_CONST(x, divisor) != x / (divisor)) {       \
+			CHECK_EQUAL(FIXED_DIV_CONST(x, divisor), x / (divisor)); \
+			break;                                                \
+		}                                                         \
+	}
+	CHECK_DIVISOR(1);
+	CHECK_DIVISOR(3);
+	CHECK_DIVISOR(5);
+	CHECK_DIVISOR(7);
+	CHECK_DIVISOR(10);
+	CHECK_DIVISOR(75);
+	CHECK_DIVISOR(100);
+	CHECK_DIVISOR(255);
+	CHECK_DIVISOR(256);
+#undef CHECK_DIVISOR
+}
+
+static void test_sin_cos(void) {
+	double max_error = 0;
+	for (int32_t degrees = -720; degrees <= 720; degrees++) {
+		double reference = sin(degrees * M_PI / 180.0);
+		double error = fabs(fixed_sin_deg(degrees) / 32768.0 - reference);
+		max_error = (error > max_error) ? error : max_error;
+		CHECK_EQUAL(fixed_cos_deg(degrees), fixed_sin_deg(degrees + 90));
+	}
+	CHECK_RANGE(max_error, 0, 0.002);
+	CHECK_EQUAL(fixed_sin_deg(90), Q15_ONE);
+	CHECK_EQUAL(fixed_sin_deg(0), 0);
+	CHECK_EQUAL(fixed_sin_deg(270), -Q15_ONE);
+}
+
+static void test_multiply(void) {
+	CHECK_EQUAL(q15_mul_sat(Q15_MINUS_ONE, Q15_MINUS_ONE), Q15_ONE);
+	CHECK_EQUAL(q15_mul_sat(Q15_ONE, Q15_ONE), Q15_ONE - 1);
+	CHECK_EQUAL(q15_mul(1000, 16384), 500);
+	CHECK_EQUAL(q15_mul(-1000, 16384), -500);
+	CHECK_EQUAL(q15_mul(INT16_MIN, Q15_MINUS_ONE), INT16_MAX);
+	CHECK_EQUAL(q15_mul(3, 16384), 2); // 1.5 rounds up
+}
+
+static void test_lerp_and_saturate(void) {
+	CHECK_EQUAL(fixed_lerp(100, 200, 0), 100);
+	CHECK_EQUAL(fixed_lerp(100, 200, 16384), 150);
+	CHECK_EQUAL(fixed_lerp(200, 100, 16384), 150);
+	CHECK_EQUAL(fixed_saturate(5, 0, 3), 3);
+	CHECK_EQUAL(fixed_saturate(-5, 0, 3), 0);
+	CHECK_EQUAL(fixed_saturate(2, 0, 3), 2);
+}
+
+int main(void) {
+	RUN_TEST(test_div_const);
+	RUN_TEST(test_sin_cos);
+	RUN_TEST(test_multiply);
+	RUN_TEST(test_lerp_and_saturate);
+	return TEST_RESULT();
+}
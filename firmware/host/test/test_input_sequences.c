@@ -0,0 +1,198 @@
+/*
+ * test_input_sequences.c
+ *
+ * Random input sequences on the simulated station: tool holder, tip change and button levels,
+ * encoder rotation (the counter starts at 0, so turning back crosses the wrap), tip, AC, PCB
+ * temperature, load and time. After every millisecond:
+ * - The heater is only on in ON or STANDBY state, or until the next zero cross after leaving them
+ * - The set temperature is within MIN_TEMP..MAX_TEMP, and equals the sum of the encoder steps
+ * - No INVARIANT() in the firmware has failed
+ *
+ * The station is booted once, and every sequence runs in a process forked from it, so each starts
+ * from the same state. A failing sequence is written to a file, run it again with
+ * test_input_sequences <file>. The sequence runner is a libFuzzer entry point, and aborts on a failed
+ * check. Linked with -fsanitize=fuzzer (clang) instead of this main(), every input continues from
+ * the state the previous one left.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "invariant.h"
+#include "sim.h"
+#include "temperature.h"
+#include "test.h"
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/******    Constants    ******/
+enum sequence_constants {
+	SEQUENCES = 1000,
+	SEQUENCE_LENGTH = 64, // Bytes, two per action
+	ENCODER_SETTLE_MS = 2 * INPUT_TASK_PERIOD_MS,
+	HEATER_OFF_MARGIN_US = 2000 // Zero cross jitter and TIM6 delay
+};
+
+enum actions {
+	ACTION_TOOL_HOLDER = 0,
+	ACTION_TIP_CHANGE,
+	ACTION_BUTTON,
+	ACTION_ENCODER,
+	ACTION_TIP_INSERTED,
+	ACTION_AC,
+	ACTION_PCB_TEMP,
+	ACTION_LOAD,
+	ACTION_RUN_MS,
+	ACTION_RUN_100MS,
+	ACTION_COUNT
+};
+
+/******    File Scope Variables    ******/
+static int32_t model_set_temp;
+static uint64_t encoder_read_ns; // The input task has read the last rotation by then
+static uint64_t heating_ns;		 // Last time in ON or STANDBY state
+static uint32_t failures;
+
+/******    Helpers    ******/
+static void check_station(void) {
+	// heater_off() lets the heater run to the end of the half cycle
+	uint8_t state = get_system_state();
+	uint64_t half_cycle_ns = 1000000000ULL / (2 * sim_get_config()->mains_hz);
+	if ((state == ON_STATE) || (state == STANDBY_STATE)) {
+		heating_ns = sim_time_ns();
+	} else if (sim_heater_on() && ((sim_time_ns() - heating_ns) > half_cycle_ns + (uint64_t)HEATER_OFF_MARGIN_US * SIM_NS_PER_US)) {
+		fprintf(stderr, "heater on in state %u at %.3f s\n", state, sim_time_ns() * 1e-9);
+		failures++;
+	}
+	if ((get_set_temp() < MIN_TEMP) || (get_set_temp() > MAX_TEMP) || ((sim_time_ns() >= encoder_read_ns) && (get_set_temp() != model_set_temp))) {
+		fprintf(stderr, "set temperature %u, expected %d\n", get_set_temp(), model_set_temp);
+		failures++;
+	}
+	if (invariant_get_violations()) {
+		fprintf(stderr, "invariant %u violated\n", invariant_get_last());
+		failures++;
+	}
+}
+
+static void run_checked(uint32_t ms) {
+	for (uint32_t t = 0; (t < ms) && !failures; t++) {
+		sim_run_ms(1);
+		check_station();
+	}
+}
+
+// Decodes the input into actions and runs them, aborts if a check fails
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	model_set_temp = get_set_temp();
+	encoder_read_ns = 0;
+	heating_ns = sim_time_ns();
+	failures = 0;
+
+	for (size_t i = 0; (i + 1 < size) && !failures; i += 2) {
+		uint8_t argument = data[i + 1];
+		switch (data[i] % ACTION_COUNT) {
+			case ACTION_TOOL_HOLDER:
+				sim_set_tool_in_holder(argument & 1);
+				break;
+			case ACTION_TIP_CHANGE:
+				sim_set_tip_change(argument & 1);
+				break;
+			case ACTION_BUTTON:
+				sim_set_button(argument & 1);
+				break;
+			case ACTION_ENCODER:
+				// Read by the input task before the next action, the model then clamps the same way
+				sim_rotate_encoder((int8_t)argument);
+				model_set_temp += TEMP_STEPS * (int8_t)argument;
+				model_set_temp = (model_set_temp > MAX_TEMP) ? MAX_TEMP : (model_set_temp < MIN_TEMP) ? MIN_TEMP : model_set_temp;
+				encoder_read_ns = sim_time_ns() + (uint64_t)ENCODER_SETTLE_MS * SIM_NS_PER_MS;
+				run_checked(ENCODER_SETTLE_MS);
+				break;
+			case ACTION_TIP_INSERTED:
+				sim_set_tip_inserted(argument & 1);
+				break;
+			case ACTION_AC:
+				sim_set_ac((argument % 4) != 0);
+				break;
+			case ACTION_PCB_TEMP:
+				sim_set_pcb_temp(((argument % 4) == 0) ? PCB_OVERHEAT_TEMP + 5 : 40);
+				break;
+			case ACTION_LOAD:
+				sim_set_load_w(argument % 40);
+				break;
+			case ACTION_RUN_MS:
+				run_checked(1 + argument);
+				break;
+			default:
+				run_checked(100 * (1 + argument % 30));
+				break;
+		}
+	}
+	if (failures) {
+		abort();
+	}
+	return 0;
+}
+
+// Runs the sequence in a child of the booted station, returns 1 if it failed
+static int run_forked(const uint8_t *data, size_t size) {
+	fflush(stdout);
+	fflush(stderr);
+	pid_t child = fork();
+	if (child == 0) {
+		LLVMFuzzerTestOneInput(data, size);
+		_exit(0);
+	}
+	int status = 0;
+	waitpid(child, &status, 0);
+	return (WIFEXITED(status) && (WEXITSTATUS(status) == 0)) ? 0 : 1;
+}
+
+/******    Tests    ******/
+static void test_random_sequences(void) {
+	uint8_t data[SEQUENCE_LENGTH];
+	uint32_t failed = 0;
+
+	for (uint32_t sequence = 0; sequence < SEQUENCES; sequence++) {
+		for (uint8_t i = 0; i < SEQUENCE_LENGTH; i++) {
+			data[i] = sim_random();
+		}
+		if (run_forked(data, SEQUENCE_LENGTH)) {
+			char name[64];
+			snprintf(name, sizeof(name), "failed_sequence_%u.bin", sequence);
+			FILE *file = fopen(name, "wb");
+			if (file) {
+				fwrite(data, 1, SEQUENCE_LENGTH, file);
+				fclose(file);
+			}
+			fprintf(stderr, "sequence %u failed, written to %s\n", sequence, name);
+			failed++;
+		}
+	}
+	CHECK_EQUAL(failed, 0);
+}
+
+int main(int argc, char **argv) {
+	sim_config config = sim_default_config();
+	sim_init(&config);
+	sim_boot();
+
+	if (argc > 1) {
+		// Run one sequence from a file, in this process
+		uint8_t data[4096];
+		FILE *file = fopen(argv[1], "rb");
+		if (!file) {
+			perror(argv[1]);
+			return 1;
+		}
+		size_t size = fread(data, 1, sizeof(data), file);
+		fclose(file);
+		LLVMFuzzerTestOneInput(data, size);
+		printf("pass %s\n", argv[1]);
+		return 0;
+	}
+
+	RUN_TEST(test_random_sequences);
+	return TEST_RESULT();
+}
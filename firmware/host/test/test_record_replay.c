@@ -0,0 +1,206 @@
+/*
+ * test_record_replay.c
+ *
+ * Round trip of a session through record_log and the replayer (replay.h): a session recorded on the
+ * simulated station replays without mismatches, and changed samples or flags in the session are found.
+ * The recording and every replay run in a forked process, each on a station booted from power up
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "opensolder.h"
+#include "replay.h"
+#include "sim.h"
+#include "temperature.h"
+#include "test.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/******    Constants    ******/
+enum replay_test_constants {
+	SESSION_READINGS = 4000,
+	CHANGED_READING = 2500, // Changed samples start at this sequence number
+	CHANGED_COUNT = 10,
+	CHANGED_OFFSET_LSB = 300
+};
+
+/******    File Scope Variables    ******/
+static char session_path[] = "/tmp/opensolder_session_XXXXXX";
+static replay_session session;
+
+/******    Helpers    ******/
+// Inputs change right after a reading, the replay applies them at the same point
+static void record_session(void) {
+	replay_session recorded = {0};
+	sim_config config = sim_default_config();
+	sim_init(&config);
+	sim_boot();
+
+	for (uint32_t reading = 0; reading < SESSION_READINGS; reading++) {
+		if (!replay_run_to_reading(REPLAY_READING_TIMEOUT_MS)) {
+			_exit(1);
+		}
+		replay_capture(&recorded);
+
+		switch (reading) {
+			case 1000:
+				sim_set_tool_in_holder(1);
+				break;
+			case 1800:
+				sim_set_tool_in_holder(0);
+				break;
+			case 2200:
+				sim_rotate_encoder(6);
+				break;
+			case 2600:
+				sim_set_load_w(20);
+				break;
+			case 2800:
+				sim_set_load_w(0);
+				sim_set_button(1);
+				break;
+			case 2820:
+				sim_set_button(0);
+				break;
+			case 3200:
+				sim_set_tip_change(1);
+				break;
+			case 3300:
+				sim_set_tip_change(0);
+				break;
+			default:
+				break;
+		}
+	}
+	_exit(replay_save(session_path, &recorded) ? 0 : 1);
+}
+
+// Replays the session in a child process, the result comes back through a pipe
+static replay_result replay_forked(const replay_session *replayed, FILE *log) {
+	replay_result result = {.timeout = SET};
+	int pipe_fd[2];
+	if (pipe(pipe_fd)) {
+		return result;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	pid_t child = fork();
+	if (child == 0) {
+		close(pipe_fd[0]);
+		sim_config config = sim_default_config();
+		sim_init(&config);
+		replay_result child_result = replay_run(replayed, log);
+		_exit(write(pipe_fd[1], &child_result, sizeof(child_result)) == sizeof(child_result) ? 0 : 1);
+	}
+	close(pipe_fd[1]);
+	if (read(pipe_fd[0], &result, sizeof(result)) != sizeof(result)) {
+		result = (replay_result){.timeout = SET};
+	}
+	close(pipe_fd[0]);
+	waitpid(child, NULL, 0);
+	return result;
+}
+
+/******    Tests    ******/
+static void test_record(void) {
+	CHECK(mkstemp(session_path) >= 0);
+	fflush(stdout);
+	pid_t child = fork();
+	if (child == 0) {
+		record_session();
+	}
+	int status = 0;
+	waitpid(child, &status, 0);
+	CHECK(WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+
+	CHECK(replay_load(session_path, &session));
+	remove(session_path);
+	// The boot readings before the first replay_capture() are overwritten in the ring
+	CHECK_RANGE(session.count, SESSION_READINGS, SESSION_READINGS + RECORD_LENGTH);
+	CHECK_EQUAL(session.records[session.count - 1].sequence - session.records[0].sequence + 1, session.count);
+}
+
+static void test_round_trip(void) {
+	replay_result result = replay_forked(&session, stderr);
+	CHECK(!result.timeout);
+	CHECK_EQUAL(result.compared, session.count);
+	CHECK_EQUAL(result.mismatches, 0);
+	CHECK_EQUAL(result.gaps, 0);
+}
+
+// Changed samples must change the replayed readings, and the readings after them
+static void test_changed_samples(void) {
+	replay_session changed = {.records = malloc(session.count * sizeof(replay_record)), .count = session.count};
+	memcpy(changed.records, session.records, session.count * sizeof(replay_record));
+	uint32_t first = CHANGED_READING - session.records[0].sequence;
+	for (uint32_t i = first; i < first + CHANGED_COUNT; i++) {
+		for (uint8_t sample = 0; sample < changed.records[i].entry.sample_count; sample++) {
+			changed.records[i].entry.samples[sample] += CHANGED_OFFSET_LSB;
+		}
+	}
+
+	replay_result result = replay_forked(&changed, NULL);
+	CHECK(!result.timeout);
+	CHECK(result.mismatches >= CHANGED_COUNT);
+	CHECK_EQUAL(result.first_mismatch, CHANGED_READING);
+	replay_free(&changed);
+}
+
+// The session runs past TIP_CHECK_RUN_INTERVAL in ON state, so it holds tip check readings
+static void test_tip_check_recorded(void) {
+	uint32_t flagged = 0;
+	for (uint32_t i = 0; i < session.count; i++) {
+		flagged += !!(session.records[i].entry.flags & RECORD_FLAG_TIP_CHECK);
+	}
+	CHECK(session.count > TIP_CHECK_RUN_INTERVAL);
+	CHECK(flagged > 0);
+}
+
+// A flipped tip check flag is a mismatch at that reading, even with the same samples
+static void test_flipped_tip_check(void) {
+	replay_session flipped = {.records = malloc(session.count * sizeof(replay_record)), .count = session.count};
+	memcpy(flipped.records, session.records, session.count * sizeof(replay_record));
+	uint32_t last = session.count - 1;
+	while ((last > 0) && !(flipped.records[last].entry.flags & RECORD_FLAG_TIP_CHECK)) {
+		last--;
+	}
+	flipped.records[last].entry.flags ^= RECORD_FLAG_TIP_CHECK;
+
+	replay_result result = replay_forked(&flipped, NULL);
+	CHECK(!result.timeout);
+	CHECK_EQUAL(result.mismatches, 1);
+	CHECK_EQUAL(result.first_mismatch, flipped.records[last].sequence);
+	replay_free(&flipped);
+}
+
+// A session with a gap replays, the plant fills the missing readings
+static void test_gap(void) {
+	replay_session gap = {.records = malloc(session.count * sizeof(replay_record)), .count = 0};
+	for (uint32_t i = 0; i < session.count; i++) {
+		if ((session.records[i].sequence < 1500) || (session.records[i].sequence >= 1600)) {
+			gap.records[gap.count++] = session.records[i];
+		}
+	}
+
+	replay_result result = replay_forked(&gap, stderr);
+	CHECK(!result.timeout);
+	CHECK_EQUAL(result.gaps, 100);
+	CHECK_EQUAL(result.compared, gap.count);
+	CHECK_EQUAL(result.mismatches, 0); // The plant is deterministic, and gives the recorded samples
+	replay_free(&gap);
+}
+
+int main(void) {
+	RUN_TEST(test_record);
+	RUN_TEST(test_round_trip);
+	RUN_TEST(test_changed_samples);
+	RUN_TEST(test_tip_check_recorded);
+	RUN_TEST(test_flipped_tip_check);
+	RUN_TEST(test_gap);
+	replay_free(&session);
+	return TEST_RESULT();
+}
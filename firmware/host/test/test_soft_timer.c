@@ -0,0 +1,107 @@
+/*
+ * test_soft_timer.c
+ *
+ * Timer wheel: expiry on the right tick, stop, restart, timers longer than the wheel
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "soft_timer.h"
+#include "test.h"
+
+/******    File Scope Variables    ******/
+static uint32_t tick = 0;
+
+/******    Helpers    ******/
+static void advance(uint32_t ms) {
+	tick += ms;
+	soft_timer_tick(tick);
+}
+
+/******    Tests    ******/
+static void test_expires_on_time(void) {
+	soft_timer timer = {0};
+	CHECK(!soft_timer_running(&timer));
+
+	soft_timer_start(&timer, 10);
+	CHECK(soft_timer_running(&timer));
+	advance(9);
+	CHECK(!soft_timer_expired(&timer));
+	advance(1);
+	CHECK(soft_timer_expired(&timer));
+
+	// Expired stays expired until restarted or stopped
+	advance(100);
+	CHECK(soft_timer_expired(&timer));
+	soft_timer_stop(&timer);
+	CHECK(!soft_timer_expired(&timer) && !soft_timer_running(&timer));
+}
+
+static void test_zero_delay_expires_on_next_tick(void) {
+	soft_timer timer = {0};
+	soft_timer_start(&timer, 0);
+	CHECK(soft_timer_running(&timer));
+	advance(1);
+	CHECK(soft_timer_expired(&timer));
+}
+
+static void test_stop_and_restart(void) {
+	soft_timer timer = {0};
+	soft_timer_start(&timer, 5);
+	advance(3);
+	soft_timer_stop(&timer);
+	advance(10);
+	CHECK(!soft_timer_expired(&timer));
+
+	soft_timer_start(&timer, 5);
+	advance(3);
+	soft_timer_start(&timer, 5); // Restart pushes the expiry out
+	advance(3);
+	CHECK(soft_timer_running(&timer));
+	advance(2);
+	CHECK(soft_timer_expired(&timer));
+}
+
+// Timers in the same slot, and timers that stay in their slot for several wheel rounds
+static void test_long_and_colliding_timers(void) {
+	soft_timer short_timer = {0};
+	soft_timer long_timer = {0};
+	soft_timer_start(&short_timer, SOFT_TIMER_WHEEL_SLOTS);
+	soft_timer_start(&long_timer, 5 * SOFT_TIMER_WHEEL_SLOTS);
+
+	advance(SOFT_TIMER_WHEEL_SLOTS);
+	CHECK(soft_timer_expired(&short_timer));
+	CHECK(soft_timer_running(&long_timer));
+
+	advance(4 * SOFT_TIMER_WHEEL_SLOTS - 1);
+	CHECK(soft_timer_running(&long_timer));
+	advance(1);
+	CHECK(soft_timer_expired(&long_timer));
+}
+
+// soft_timer_tick() catches up on every tick it missed
+static void test_tick_catch_up(void) {
+	soft_timer timers[SOFT_TIMER_WHEEL_SLOTS * 2] = {0};
+	for (uint32_t i = 0; i < SOFT_TIMER_WHEEL_SLOTS * 2; i++) {
+		soft_timer_start(&timers[i], i + 1);
+	}
+
+	advance(SOFT_TIMER_WHEEL_SLOTS);
+	for (uint32_t i = 0; i < SOFT_TIMER_WHEEL_SLOTS * 2; i++) {
+		CHECK_EQUAL(soft_timer_expired(&timers[i]), i < SOFT_TIMER_WHEEL_SLOTS);
+	}
+	advance(SOFT_TIMER_WHEEL_SLOTS);
+	for (uint32_t i = 0; i < SOFT_TIMER_WHEEL_SLOTS * 2; i++) {
+		CHECK(soft_timer_expired(&timers[i]));
+	}
+}
+
+int main(void) {
+	RUN_TEST(test_expires_on_time);
+	RUN_TEST(test_zero_delay_expires_on_next_tick);
+	RUN_TEST(test_stop_and_restart);
+	RUN_TEST(test_long_and_colliding_timers);
+	RUN_TEST(test_tick_catch_up);
+	return TEST_RESULT();
+}
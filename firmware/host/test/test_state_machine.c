@@ -0,0 +1,353 @@
+/*
+ * test_state_machine.c
+ *
+ * The state table of opensolder.c, exhaustively:
+ * - The table itself: parents, depth, targets, and every state reachable and left again
+ * - Every transition from every state it applies to, with the exit and entry order read back from
+ *   the trace ring
+ * - Every guard input combination in every state, against a model of the diagram in opensolder.c
+ * - A random walk on the simulated station, where a composite state must never be the active state
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "display.h"
+#include "sim.h"
+#include "test.h"
+#include "trace.h"
+
+// Included for the state table and the state machine internals
+#include "opensolder.c"
+
+/******    Helpers    ******/
+enum test_constants {
+	WALK_MINUTES = 20,
+	MAX_TRACED = 2 * STATE_DEPTH_MAX + 1 // One transition: the state change, the exits and the entries
+};
+
+typedef struct {
+	uint8_t event;
+	uint8_t state;
+} traced_event;
+
+static uint8_t is_composite(uint8_t state) {
+	for (uint8_t child = 0; child < STATE_COUNT; child++) {
+		if (state_table[child].parent == state) {
+			return SET;
+		}
+	}
+	return RESET;
+}
+
+// The state and its parents, outermost first. Returns the depth
+static uint8_t ancestors(uint8_t state, uint8_t path[STATE_DEPTH_MAX]) {
+	uint8_t reversed[STATE_DEPTH_MAX];
+	uint8_t depth = 0;
+	for (; (state != NO_STATE) && (depth < STATE_DEPTH_MAX); state = state_table[state].parent) {
+		reversed[depth++] = state;
+	}
+	for (uint8_t i = 0; i < depth; i++) {
+		path[i] = reversed[depth - 1 - i];
+	}
+	return depth;
+}
+
+// Returns SET if the table has a transition from the state, or one of its parents, to the target
+static uint8_t transition_listed(uint8_t state, uint8_t target) {
+	for (; state != NO_STATE; state = state_table[state].parent) {
+		for (const state_transition *transition = state_table[state].transitions; transition->guard != NULL; transition++) {
+			if (transition->target == target) {
+				return SET;
+			}
+		}
+	}
+	return RESET;
+}
+
+// State machine events logged since mark, returns the number of events
+static uint8_t read_trace(uint32_t mark, traced_event *events, uint8_t max) {
+	uint8_t count = 0;
+	for (uint32_t i = mark; i != trace_log.head; i++) {
+		uint32_t word = trace_log.entries[i & (TRACE_LENGTH - 1)];
+		uint8_t event = (word >> 16) & 0xFF;
+		if ((event == TRACE_STATE) || (event == TRACE_STATE_EXIT) || (event == TRACE_STATE_ENTRY)) {
+			if (count < max) {
+				events[count] = (traced_event){.event = event, .state = word >> 24};
+			}
+			count++;
+		}
+	}
+	return count;
+}
+
+static void set_timer_expired(soft_timer *const timer, uint8_t expired) {
+	soft_timer_stop(timer);
+	if (expired) {
+		timer->state = SOFT_TIMER_EXPIRED;
+	}
+}
+
+// Guard inputs, one bit each
+enum input_bits {
+	INPUT_FAULT = 1 << 0,
+	INPUT_TIP_DETECTED = 1 << 1,
+	INPUT_INSERT_EXPIRED = 1 << 2,
+	INPUT_TIP_CHANGE = 1 << 3,
+	INPUT_TOOL_IN_HOLDER = 1 << 4,
+	INPUT_STANDBY_EXPIRED = 1 << 5,
+	INPUT_COMBINATIONS = 1 << 6
+};
+
+// The state after one pass, from the diagram in opensolder.c rather than the table
+static uint8_t model_next_state(uint8_t state, uint8_t inputs) {
+	uint8_t tip_removed = (inputs & INPUT_TIP_CHANGE) || !(inputs & INPUT_TIP_DETECTED);
+
+	if (state == ERROR_STATE) {
+		return (inputs & INPUT_FAULT) ? ERROR_STATE : INIT_STATE;
+	}
+	if (inputs & INPUT_FAULT) {
+		return ERROR_STATE;
+	}
+	if (state == INIT_STATE) {
+		return TIP_CHANGE_STATE;
+	}
+	if (state == TIP_CHANGE_STATE) {
+		return (!tip_removed && (inputs & INPUT_INSERT_EXPIRED)) ? OFF_STATE : TIP_CHANGE_STATE;
+	}
+	if (tip_removed) {
+		return TIP_CHANGE_STATE;
+	}
+	switch (state) {
+		case OFF_STATE:
+			return (inputs & INPUT_TOOL_IN_HOLDER) ? OFF_STATE : ON_STATE;
+		case ON_STATE:
+			return (inputs & INPUT_TOOL_IN_HOLDER) ? STANDBY_STATE : ON_STATE;
+		default: // STANDBY_STATE
+			if (!(inputs & INPUT_TOOL_IN_HOLDER)) {
+				return ON_STATE;
+			}
+			return (inputs & INPUT_STANDBY_EXPIRED) ? OFF_STATE : STANDBY_STATE;
+	}
+}
+
+/******    Tests    ******/
+// Random stimuli on the running station, the state and every traced transition must be valid
+static void test_random_walk(void) {
+	uint32_t invalid_state = 0;
+	uint32_t unlisted = 0;
+	uint32_t transitions = 0;
+	uint8_t visited[STATE_COUNT] = {0};
+	uint32_t mark = trace_log.head;
+
+	for (uint32_t step = 0; step < WALK_MINUTES * 60 * 2; step++) {
+		switch (sim_random() % 8) {
+			case 0:
+			case 1:
+			case 2:
+				sim_set_tool_in_holder(sim_random() & 1);
+				break;
+			case 3:
+				sim_set_tip_inserted((sim_random() % 4) != 0);
+				break;
+			case 4:
+				sim_set_tip_change((sim_random() % 4) == 0);
+				break;
+			case 5:
+				sim_set_ac((sim_random() % 8) != 0);
+				break;
+			case 6:
+				sim_set_pcb_temp(((sim_random() % 8) == 0) ? PCB_OVERHEAT_TEMP + 5 : 40);
+				break;
+			default:
+				break;
+		}
+
+		for (uint8_t ms = 0; ms < 50; ms++) {
+			sim_run_ms(10);
+			uint8_t state = get_system_state();
+			if ((state >= STATE_COUNT) || is_composite(state)) {
+				invalid_state++;
+			} else {
+				visited[state] = 1;
+			}
+
+			// The ring holds the last TRACE_LENGTH events, read it before it wraps
+			for (; mark != trace_log.head; mark++) {
+				uint32_t word = trace_log.entries[mark & (TRACE_LENGTH - 1)];
+				if (((word >> 16) & 0xFF) == TRACE_STATE) {
+					uint8_t data = word >> 24;
+					transitions++;
+					if (!transition_listed(data >> 4, data & 0x0F)) {
+						unlisted++;
+					}
+				}
+			}
+		}
+	}
+
+	CHECK_EQUAL(invalid_state, 0);
+	CHECK_EQUAL(unlisted, 0);
+	CHECK(transitions > 100);
+	for (uint8_t state = 0; state < STATE_COUNT; state++) {
+		if (!is_composite(state)) {
+			CHECK(visited[state]);
+		}
+	}
+}
+
+static void test_table(void) {
+	uint8_t reachable[STATE_COUNT] = {[INIT_STATE] = 1};
+	uint8_t leaves_init[STATE_COUNT] = {[INIT_STATE] = 1};
+
+	for (uint8_t state = 0; state < STATE_COUNT; state++) {
+		CHECK((state_table[state].parent < STATE_COUNT) || (state_table[state].parent == NO_STATE));
+		CHECK(state_table[state].transitions != NULL);
+
+		// The parent chain ends within STATE_DEPTH_MAX, so there are no loops
+		uint8_t depth = 0;
+		for (uint8_t parent = state; parent != NO_STATE; parent = state_table[parent].parent) {
+			if (++depth > STATE_DEPTH_MAX) {
+				break;
+			}
+		}
+		CHECK(depth <= STATE_DEPTH_MAX);
+
+		// Composite states are never a target
+		for (const state_transition *transition = state_table[state].transitions; transition->guard != NULL; transition++) {
+			CHECK(transition->target < STATE_COUNT);
+			CHECK(!is_composite(transition->target));
+		}
+	}
+
+	// Every state is reachable from INIT_STATE, and can get back to it
+	for (uint8_t pass = 0; pass < STATE_COUNT; pass++) {
+		for (uint8_t from = 0; from < STATE_COUNT; from++) {
+			for (uint8_t to = 0; to < STATE_COUNT; to++) {
+				if (is_composite(from) || !transition_listed(from, to)) {
+					continue;
+				}
+				reachable[to] |= reachable[from];
+				leaves_init[from] |= leaves_init[to];
+			}
+		}
+	}
+	for (uint8_t state = 0; state < STATE_COUNT; state++) {
+		if (!is_composite(state)) {
+			CHECK(reachable[state]);
+			CHECK(leaves_init[state]);
+		}
+	}
+}
+
+// Every transition, from every state it applies to: exits innermost first up to the common parent, then entries outermost first
+static void test_transition_order(void) {
+	uint32_t checked = 0;
+	station_fault = AC_NOT_DETECTED; // Drawn by error_entry()
+
+	for (uint8_t source = 0; source < STATE_COUNT; source++) {
+		for (const state_transition *transition = state_table[source].transitions; transition->guard != NULL; transition++) {
+			for (uint8_t from = 0; from < STATE_COUNT; from++) {
+				if (is_composite(from) || !state_contains(source, from)) {
+					continue;
+				}
+				uint8_t target = transition->target;
+
+				uint8_t from_path[STATE_DEPTH_MAX];
+				uint8_t target_path[STATE_DEPTH_MAX];
+				uint8_t from_depth = ancestors(from, from_path);
+				uint8_t target_depth = ancestors(target, target_path);
+				uint8_t common = 0;
+				while ((common < from_depth) && (common < target_depth) && (from_path[common] == target_path[common])) {
+					common++;
+				}
+
+				traced_event expected[MAX_TRACED];
+				uint8_t expected_count = 0;
+				expected[expected_count++] = (traced_event){.event = TRACE_STATE, .state = (from << 4) | target};
+				for (uint8_t i = from_depth; i > common; i--) {
+					expected[expected_count++] = (traced_event){.event = TRACE_STATE_EXIT, .state = from_path[i - 1]};
+				}
+				for (uint8_t i = common; i < target_depth; i++) {
+					expected[expected_count++] = (traced_event){.event = TRACE_STATE_ENTRY, .state = target_path[i]};
+				}
+
+				system_state = from;
+				uint32_t mark = trace_log.head;
+				state_transition_to(target);
+				traced_event traced[MAX_TRACED];
+				uint8_t traced_count = read_trace(mark, traced, MAX_TRACED);
+
+				CHECK_EQUAL(get_system_state(), target);
+				CHECK_EQUAL(traced_count, expected_count);
+				for (uint8_t i = 0; (i < traced_count) && (i < expected_count); i++) {
+					if ((traced[i].event != expected[i].event) || (traced[i].state != expected[i].state)) {
+						fprintf(stderr, "%u -> %u: event %u is %u/%u, expected %u/%u\n", from, target, i, traced[i].event, traced[i].state, expected[i].event, expected[i].state);
+						test_failures++;
+					}
+				}
+				checked++;
+			}
+		}
+	}
+	CHECK(checked >= 10);
+}
+
+// One state machine pass for every guard input combination in every state
+static void test_guards(void) {
+	uint32_t mismatches = 0;
+	uint32_t extra_transitions = 0;
+
+	for (uint8_t state = 0; state < STATE_COUNT; state++) {
+		if (is_composite(state)) {
+			continue;
+		}
+		for (uint8_t inputs = 0; inputs < INPUT_COMBINATIONS; inputs++) {
+			// Level inputs go through the event queue, like adc_process() and the SysTick callback
+			event level = {.type = EVENT_AC_STATE, .data.ac_state = (inputs & INPUT_FAULT) ? OFF : ON};
+			event_push(&level);
+			level = (event){.type = EVENT_TIP_STATE, .data.tip_state = (inputs & INPUT_TIP_DETECTED) ? TIP_DETECTED : TIP_NOT_DETECTED};
+			event_push(&level);
+			measurement_tick = HAL_GetTick();
+
+			tip_change_state = (inputs & INPUT_TIP_CHANGE) ? SET : RESET;
+			tool_holder_state = (inputs & INPUT_TOOL_IN_HOLDER) ? SET : RESET;
+			set_timer_expired(&tip_insert_timer, inputs & INPUT_INSERT_EXPIRED);
+			set_timer_expired(&standby_timer, inputs & INPUT_STANDBY_EXPIRED);
+			system_state = state;
+
+			uint32_t mark = trace_log.head;
+			state_machine();
+			traced_event traced[MAX_TRACED];
+			uint8_t traced_count = read_trace(mark, traced, MAX_TRACED);
+
+			uint8_t expected = model_next_state(state, inputs);
+			if (get_system_state() != expected) {
+				fprintf(stderr, "state %u, inputs 0x%02x: %u, expected %u\n", state, inputs, get_system_state(), expected);
+				mismatches++;
+			}
+			uint8_t changes = 0;
+			for (uint8_t i = 0; (i < traced_count) && (i < MAX_TRACED); i++) {
+				changes += traced[i].event == TRACE_STATE;
+			}
+			if (changes != (expected != state)) {
+				extra_transitions++;
+			}
+		}
+	}
+	CHECK_EQUAL(mismatches, 0);
+	CHECK_EQUAL(extra_transitions, 0);
+}
+
+int main(void) {
+	sim_config config = sim_default_config();
+	sim_init(&config);
+	sim_boot();
+
+	// The station runs first, the other tests set the state machine variables directly
+	RUN_TEST(test_random_walk);
+	RUN_TEST(test_table);
+	RUN_TEST(test_transition_order);
+	RUN_TEST(test_guards);
+	return TEST_RESULT();
+}
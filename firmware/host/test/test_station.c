@@ -0,0 +1,157 @@
+/*
+ * test_station.c
+ *
+ * The whole firmware on the simulated station: boot, heat up, standby, encoder, tip removal and faults.
+ * The firmware keeps its state between the tests, they run in order on one station
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "display.h"
+#include "power_stats.h"
+#include "sim.h"
+#include "temperature.h"
+#include "test.h"
+
+/******    Helpers    ******/
+// Run until the state is reached, returns the time it took in ms, or timeout_ms + 1
+static uint32_t run_until_state(uint8_t state, uint32_t timeout_ms) {
+	for (uint32_t ms = 0; ms <= timeout_ms; ms += 10) {
+		if (get_system_state() == state) {
+			return ms;
+		}
+		sim_run_ms(10);
+	}
+	return timeout_ms + 1;
+}
+
+// Run and return the highest heater model temperature
+static double run_max_heater_c(uint32_t ms) {
+	double max_c = 0;
+	for (uint32_t t = 0; t < ms; t += 10) {
+		sim_run_ms(10);
+		if (sim_get_plant()->heater_c > max_c) {
+			max_c = sim_get_plant()->heater_c;
+		}
+	}
+	return max_c;
+}
+
+static uint8_t heater_stays_off(uint32_t ms) {
+	uint64_t on_ns = sim_get_stats()->heater_on_ns;
+	sim_run_ms(ms);
+	return sim_get_stats()->heater_on_ns == on_ns;
+}
+
+/******    Tests    ******/
+static void test_boot(void) {
+	sim_boot();
+	CHECK(display_is_on());
+	CHECK(display_contains("Set") && display_contains("Tip")); // The splash screen is replaced at the end of opensolder_init()
+	CHECK_RANGE(sim_time_ns() * 1e-9, 1.0, 1.5); // Splash screen
+	CHECK_EQUAL(get_system_state(), INIT_STATE);
+	CHECK(!sim_heater_on());
+}
+
+// The tip is detected, and the station turns on TIP_CHANGE_DELAY_MS later with the tool out of the holder
+static void test_heat_up(void) {
+	CHECK(run_until_state(ON_STATE, 3000) <= 3000);
+	sim_run_ms(DISPLAY_TASK_PERIOD_MS);
+	CHECK(display_contains("ON state"));
+
+	double max_c = run_max_heater_c(10000);
+	CHECK_RANGE(get_station_snapshot()->tip_temp, DEFAULT_TEMP - 10, DEFAULT_TEMP + 10);
+	CHECK_RANGE(sim_get_plant()->heater_c, DEFAULT_TEMP - 10, DEFAULT_TEMP + 10);
+	CHECK(max_c < DEFAULT_TEMP + 20);
+	CHECK(display_contains("320'"));
+	CHECK(power_stats_get_histogram()[POWER_HISTOGRAM_BINS - 1] >= 1); // The heat-up runs at the highest duty of the cartridge
+	CHECK_RANGE(get_zc_period_us(), 9900, 10100);
+}
+
+static void test_standby(void) {
+	sim_set_tool_in_holder(1);
+	CHECK(run_until_state(STANDBY_STATE, 500) <= 500);
+	sim_run_ms(DISPLAY_TASK_PERIOD_MS);
+	CHECK(display_contains("Standby"));
+	sim_run_ms(30000);
+	CHECK_RANGE(get_station_snapshot()->tip_temp, STANDBY_TEMP - 10, STANDBY_TEMP + 10);
+
+	// Lifting the tool only counts after STANDBY_DELAY_MS
+	sim_set_tool_in_holder(0);
+	CHECK(run_until_state(ON_STATE, 1000) >= STANDBY_DELAY_MS - 20);
+}
+
+static void test_encoder(void) {
+	sim_rotate_encoder(4);
+	sim_run_ms(100);
+	CHECK_EQUAL(get_set_temp(), DEFAULT_TEMP + 4 * TEMP_STEPS);
+	sim_rotate_encoder(-2);
+	sim_run_ms(100);
+	CHECK_EQUAL(get_set_temp(), DEFAULT_TEMP + 2 * TEMP_STEPS);
+
+	// Limited to MAX_TEMP and MIN_TEMP
+	sim_rotate_encoder(1000);
+	sim_run_ms(100);
+	CHECK_EQUAL(get_set_temp(), MAX_TEMP);
+	sim_rotate_encoder(-1000);
+	sim_run_ms(100);
+	CHECK_EQUAL(get_set_temp(), MIN_TEMP);
+	sim_rotate_encoder((DEFAULT_TEMP + 2 * TEMP_STEPS - MIN_TEMP) / TEMP_STEPS);
+	sim_run_ms(100);
+	CHECK_EQUAL(get_set_temp(), DEFAULT_TEMP + 2 * TEMP_STEPS);
+	sim_run_ms(10000);
+	CHECK_RANGE(get_station_snapshot()->tip_temp, DEFAULT_TEMP, DEFAULT_TEMP + 20);
+}
+
+static void test_tip_removal(void) {
+	sim_set_tip_inserted(0);
+	CHECK(run_until_state(TIP_CHANGE_STATE, 1000) <= 1000);
+	CHECK(heater_stays_off(3000));
+	CHECK(display_contains("Insert tip"));
+
+	sim_set_tip_inserted(1);
+	CHECK(run_until_state(ON_STATE, 5000) <= 5000);
+	sim_run_ms(5000);
+	CHECK_RANGE(get_station_snapshot()->tip_temp, DEFAULT_TEMP, DEFAULT_TEMP + 20);
+}
+
+static void test_ac_loss(void) {
+	sim_set_ac(0);
+	CHECK(run_until_state(ERROR_STATE, 200) <= 200);
+	CHECK(display_contains("AC not detected"));
+	CHECK(heater_stays_off(1000));
+
+	sim_set_ac(1);
+	CHECK(run_until_state(ON_STATE, 5000) <= 5000);
+}
+
+static void test_pcb_overheat(void) {
+	sim_run_ms(1000);
+	sim_set_pcb_temp(PCB_OVERHEAT_TEMP + 5);
+	CHECK(!sim_heater_on()); // The OS interrupt cuts the heater at once
+	CHECK(run_until_state(ERROR_STATE, 100) <= 100);
+	CHECK(display_contains("! Overheating !"));
+	CHECK(heater_stays_off(2000));
+
+	// Released below the hysteresis temperature only
+	sim_set_pcb_temp(PCB_OVERHEAT_TEMP - 1);
+	sim_run_ms(500);
+	CHECK_EQUAL(get_system_state(), ERROR_STATE);
+	sim_set_pcb_temp(PCB_OVERHEAT_HYST_TEMP - 5);
+	CHECK(run_until_state(ON_STATE, 5000) <= 5000);
+}
+
+int main(void) {
+	sim_config config = sim_default_config();
+	sim_init(&config);
+
+	RUN_TEST(test_boot);
+	RUN_TEST(test_heat_up);
+	RUN_TEST(test_standby);
+	RUN_TEST(test_encoder);
+	RUN_TEST(test_tip_removal);
+	RUN_TEST(test_ac_loss);
+	RUN_TEST(test_pcb_overheat);
+	return TEST_RESULT();
+}
@@ -0,0 +1,137 @@
+/*
+ * test_tick_wrap.c
+ *
+ * The 32 bit HAL tick wraps after 49.7 days. Soft timers and the station are run across the wrap
+ * with the tick (and the timer wheel) started just below 0xFFFFFFFF
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "display.h"
+#include "sim.h"
+#include "temperature.h"
+#include "test.h"
+
+// Included for wheel_tick, the timer wheel starts at tick 0 on the device
+#include "soft_timer.c"
+
+/******    Helpers    ******/
+static uint32_t tick = 0;
+
+static void start_tick(uint32_t start) {
+	tick = start;
+	wheel_tick = start;
+}
+
+static void advance(uint32_t ms) {
+	tick += ms;
+	soft_timer_tick(tick);
+}
+
+static uint32_t run_until_state(uint8_t state, uint32_t timeout_ms) {
+	for (uint32_t ms = 0; ms <= timeout_ms; ms += 10) {
+		if (get_system_state() == state) {
+			return ms;
+		}
+		sim_run_ms(10);
+	}
+	return timeout_ms + 1;
+}
+
+// Run until the HAL tick is at target, counted as a signed distance so it works across the wrap
+static void run_until_tick(uint32_t target) {
+	while ((int32_t)(HAL_GetTick() - target) < 0) {
+		sim_run_ms(1);
+	}
+}
+
+/******    Soft Timer Tests    ******/
+static void test_timer_across_wrap(void) {
+	start_tick(0xFFFFFFFFU - 5);
+	soft_timer timer = {0};
+	soft_timer_start(&timer, 10);
+	CHECK_EQUAL(timer.expiry_tick, 4);
+
+	advance(5); // 0xFFFFFFFF
+	CHECK(soft_timer_running(&timer));
+	advance(4); // 3
+	CHECK(soft_timer_running(&timer));
+	advance(1);
+	CHECK(soft_timer_expired(&timer));
+}
+
+static void test_timers_around_wrap(void) {
+	for (uint32_t offset = 0; offset < 3 * SOFT_TIMER_WHEEL_SLOTS; offset++) {
+		start_tick(0U - offset);
+		soft_timer timers[4] = {0};
+		static const uint32_t delays[4] = {1, SOFT_TIMER_WHEEL_SLOTS - 1, SOFT_TIMER_WHEEL_SLOTS + 3, 1000};
+		for (uint8_t i = 0; i < 4; i++) {
+			soft_timer_start(&timers[i], delays[i]);
+		}
+
+		for (uint32_t ms = 1; ms <= 1000; ms++) {
+			advance(1);
+			for (uint8_t i = 0; i < 4; i++) {
+				if (soft_timer_expired(&timers[i]) != (ms >= delays[i])) {
+					CHECK_EQUAL(soft_timer_expired(&timers[i]), ms >= delays[i]);
+					return;
+				}
+			}
+		}
+	}
+}
+
+// A timer as long as the standby time, started before the wrap. It stays in its slot for many wheel rounds
+static void test_long_timer_across_wrap(void) {
+	start_tick(0xFFFFFFFFU - 150000);
+	soft_timer timer = {0};
+	soft_timer_start(&timer, 300000);
+	advance(299999);
+	CHECK(soft_timer_running(&timer));
+	advance(1);
+	CHECK(soft_timer_expired(&timer));
+}
+
+/******    Station Tests    ******/
+// The tool is lifted 100ms before the wrap, STANDBY_DELAY_MS runs across it
+static void test_standby_delay_across_wrap(void) {
+	sim_config config = sim_default_config();
+	sim_init(&config);
+	uwTick = 0U - 60000;
+	start_tick(uwTick);
+
+	sim_boot();
+	CHECK(run_until_state(ON_STATE, 5000) <= 5000);
+	sim_set_tool_in_holder(1);
+	CHECK(run_until_state(STANDBY_STATE, 500) <= 500);
+	run_until_tick(0U - 100);
+	sim_set_tool_in_holder(0);
+	CHECK_RANGE(run_until_state(ON_STATE, 1000), STANDBY_DELAY_MS - 20, STANDBY_DELAY_MS + 50);
+	CHECK((int32_t)HAL_GetTick() > 0);
+}
+
+// Readings, the display refresh and the measurement timeout keep working after the wrap
+static void test_station_after_wrap(void) {
+	sim_run_ms(10000);
+	CHECK_EQUAL(get_system_state(), ON_STATE);
+	CHECK_RANGE(get_station_snapshot()->tip_temp, DEFAULT_TEMP - 10, DEFAULT_TEMP + 10);
+
+	uint32_t frames = display_frames();
+	sim_run_ms(1000);
+	CHECK_RANGE(display_frames() - frames, 20, 40);
+
+	sim_set_ac(0);
+	CHECK(run_until_state(ERROR_STATE, 200) <= 200);
+	sim_set_ac(1);
+	CHECK(run_until_state(ON_STATE, 5000) <= 5000);
+}
+
+int main(void) {
+	RUN_TEST(test_timer_across_wrap);
+	RUN_TEST(test_timers_around_wrap);
+	RUN_TEST(test_long_timer_across_wrap);
+	RUN_TEST(test_standby_delay_across_wrap);
+	RUN_TEST(test_station_after_wrap);
+	return TEST_RESULT();
+}
@@ -0,0 +1,73 @@
+/*
+ * benchmark.h
+ *
+ * Microbenchmarks of the CPU bound display, ADC and input kernels
+ *
+ * USAGE:
+ * - Build with BENCHMARK_ENABLE defined as 1, opensolder_init() then calls benchmark_run() once before the scheduler starts
+ * - Halt the MCU and read the results with the debugger, e.g. in gdb: print benchmark_results
+ * - The host build times the same kernels (benchmark_kernels) with the host clock, see firmware/host/kernels.c
+ *
+ * Each kernel is run a fixed number of times with interrupts masked, and timed with the
+ * microsecond timebase (timebase.h). The result is the average number of CPU cycles per call,
+ * at the core clock the benchmark ran at. A batch must take less than one timebase period (65ms),
+ * the SPI bound display kernels use fewer iterations for that reason.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+/******    Includes    ******/
+#include "stm32f0xx_hal.h"
+
+/******    Constants and Objects    ******/
+// Benchmarks are off by default, they mask interrupts for up to 65ms at startup. Define BENCHMARK_ENABLE as 1 to run them
+#ifndef BENCHMARK_ENABLE
+#define BENCHMARK_ENABLE 0
+#endif
+
+enum benchmark_ids {
+	BENCHMARK_ADC_STATS = 0,		  // adc_calculate_channel_stats(), on the last ADC buffer
+	BENCHMARK_ADC_DEVIATION,		  // adc_deviation_check()
+	BENCHMARK_WRITE_CHAR_6X8,		  // ssd1306_WriteChar() for each font
+	BENCHMARK_WRITE_CHAR_7X10,		  //
+	BENCHMARK_WRITE_CHAR_11X18,		  //
+	BENCHMARK_WRITE_CHAR_16X26,		  //
+	BENCHMARK_FILLED_RECTANGLE,		  // ssd1306_DrawFilledRectangle(), 120x8 pixels (about the power bar)
+	BENCHMARK_UPDATE_SCREEN,		  // ssd1306_UpdateScreen(), SPI transfer of the whole frame buffer
+	BENCHMARK_UPDATE_DISPLAY,		  // update_display(), default display including the flush
+	BENCHMARK_BUTTON_SCAN,			  // button_scan()
+	BENCHMARK_COUNT
+};
+
+typedef struct {
+	const char *name;
+	void (*kernel)(void);
+	uint16_t iterations;	 // Per batch
+	uint16_t bytes_per_call; // Bytes sent to the display per call, 0 for kernels that don't send
+} benchmark_kernel;
+
+typedef struct {
+	uint16_t iterations;
+	uint32_t total_us;		  // Time for all iterations
+	uint32_t cycles_per_call; // Average CPU cycles per call
+	uint16_t bytes_per_call;  // Bytes sent to the display per call, 0 for kernels that don't send
+} benchmark_result;
+
+/******    Function Declarations    ******/
+#if BENCHMARK_ENABLE
+extern benchmark_result benchmark_results[BENCHMARK_COUNT];
+extern const benchmark_kernel benchmark_kernels[BENCHMARK_COUNT];
+
+void benchmark_run(void);
+void benchmark_init(void);
+
+// Kernels that are static in other modules, wrapped for the benchmark
+void adc_stats_benchmark(void);
+void adc_deviation_benchmark(void);
+#endif
+
+#endif
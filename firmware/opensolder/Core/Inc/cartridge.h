@@ -0,0 +1,72 @@
+/*
+ * cartridge.h
+ *
+ * Tip cartridge resistance estimate, wear tracking and family classification
+ *
+ * USAGE:
+ * - Call cartridge_update() from tip_check() with every tip check reading where a tip was detected,
+ *   with the temperature the heater regulates to (0 when off)
+ * - Call cartridge_reset() when the tip is removed
+ * - cartridge_get_profile() gives the control profile of the detected family, used by power_control()
+ *
+ * With TIP_CHECK driven high through TIP_CHECK_PULL_OHM, the heater and thermocouple in series form a
+ * divider, and the amplifier output rises with the series resistance. The rise above the previous
+ * thermocouple reading is TIP_CHECK_PULL_OHM * R_tip / (R_pull + R_tip) * gain of the supply, and as
+ * R_tip is a few ohms, R_tip = rise / 4096 * TIP_CHECK_PULL_OHM / TC_AMP_GAIN. The supply cancels out.
+ *
+ * The estimate is averaged over checks. After CARTRIDGE_MIN_CHECKS the family is classified from the
+ * resistance. The heater resistance rises with temperature, so the reference and the drift are only
+ * taken at a steady temperature: from the average of CARTRIDGE_MIN_CHECKS checks in a row with the tip
+ * within CARTRIDGE_REFERENCE_BAND of the target. A check out of band restarts the average, so checks
+ * while heating up or after a set temperature change are never used. The first average is kept as the
+ * reference together with the target, the later ones update the drift when the target is within
+ * CARTRIDGE_DRIFT_TEMP_BAND of the reference temperature. A cartridge that has drifted more than
+ * CARTRIDGE_WORN_PERMILLE is flagged as worn. The reference is kept in RAM, so drift is tracked from the
+ * tip insertion until the tip is removed or the station is powered off.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef CARTRIDGE_H
+#define CARTRIDGE_H
+
+/******    Includes    ******/
+#include "opensolder.h"
+
+/******    Constants and Objects    ******/
+enum cartridge_constants {
+	CARTRIDGE_AVERAGE_SHIFT = 2,	 // Rolling average over ~2^2 tip checks
+	CARTRIDGE_MIN_CHECKS = 4,		 // Tip checks before the family is classified, and in band checks per drift average
+	CARTRIDGE_REFERENCE_BAND = 5,	 // Max distance of the tip from the target for a reference or drift check, as CONTROL_SETTLE_BAND
+	CARTRIDGE_DRIFT_TEMP_BAND = 20,	 // Max distance from the reference temperature for a drift update
+	CARTRIDGE_WORN_PERMILLE = 100	 // Drift from the reference resistance that flags the cartridge as worn
+};
+
+// Families are told apart by the heater resistance. Ranges are from bench measurements, tune as more cartridges are measured
+enum cartridge_families {
+	CARTRIDGE_UNKNOWN = 0, // Not classified yet, or outside all ranges. Uses the default control profile
+	CARTRIDGE_LOW_R,	   // Low resistance, high power cartridges
+	CARTRIDGE_STANDARD,	   // Standard C245 cartridges
+	CARTRIDGE_HIGH_R,	   // High resistance, low power cartridges
+	CARTRIDGE_FAMILY_COUNT
+};
+
+typedef struct {
+	const char *name;
+	uint16_t min_mohm;		   // Resistance range of the family
+	uint16_t max_mohm;		   //
+	uint8_t max_on_periods;	   // Max heater half cycles between two readings, at most MAX_ON_PERIODS
+	uint8_t error_per_period;  // Temperature error in degrees per heater half cycle
+} cartridge_profile;
+
+/******    Function Declarations    ******/
+void cartridge_update(uint16_t rise, uint16_t tip_temp, uint16_t target_temp);
+void cartridge_reset(void);
+uint16_t cartridge_get_resistance_mohm(void); // Averaged estimate, 0 if no tip has been measured
+int16_t cartridge_get_drift_permille(void);	  // Change from the reference resistance
+uint8_t cartridge_get_family(void);
+uint8_t cartridge_is_worn(void);
+const cartridge_profile *cartridge_get_profile(void);
+
+#endif
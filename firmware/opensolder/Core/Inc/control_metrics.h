@@ -0,0 +1,70 @@
+/*
+ * control_metrics.h
+ *
+ * Heat-up, overshoot, settling and load recovery of the temperature control
+ *
+ * USAGE:
+ * - Call control_metrics_update() with every temperature reading, and the temperature the heater regulates to (0 when off)
+ * - A run starts every time the target changes: heater turned on, set temperature changed, standby entered or left
+ * - Read the run in progress (or the last one) with control_metrics_get_run()
+ * - Finished runs are kept in control_log. Halt the MCU and dump it with the debugger, e.g. in gdb:
+ *   dump binary value control.bin control_log
+ * - Decode the dump with firmware/tools/control_decode.py control.bin, it prints CSV or JSON
+ *
+ * The tip is in band when the reading is within CONTROL_SETTLE_BAND of the target, and settled when it
+ * has stayed in band for CONTROL_SETTLE_HOLD_MS. After settling, a reading below the band is counted
+ * as a thermal load: the largest drop and the longest time out of band are recorded.
+ * Energy is estimated from the heater half cycles and the full heater power (power_stats.h).
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef CONTROL_METRICS_H
+#define CONTROL_METRICS_H
+
+/******    Includes    ******/
+#include "opensolder.h"
+
+/******    Constants and Objects    ******/
+enum control_metrics_constants {
+	CONTROL_SETTLE_BAND = 5,		 // Max deviation from the target in degrees while in band
+	CONTROL_SETTLE_HOLD_MS = 2000,	 // Time in band before the tip is settled
+	CONTROL_LOG_LENGTH = 8,			 // Number of finished runs kept in control_log, must be a power of two
+	CONTROL_LOG_MAGIC = 0x4354524C, // "CTRL", marks the start of a control_log dump
+
+	CONTROL_RUN_IDLE = 0, // No run since power up
+	CONTROL_RUN_RISING,	  // Not yet in band
+	CONTROL_RUN_SETTLING, // In band, waiting for CONTROL_SETTLE_HOLD_MS
+	CONTROL_RUN_SETTLED
+};
+
+// Keep the layout in sync with RUN_FORMAT in firmware/tools/control_decode.py
+typedef struct {
+	uint16_t start_temp;	   // Tip temperature at the start of the run
+	uint16_t target_temp;	   //
+	uint16_t rise_time_ms;	   // Start until the first reading in band
+	uint16_t settling_time_ms; // Start until the reading entered the band for good
+	int16_t overshoot;		   // Largest excursion past the target in the step direction, before settling
+	uint16_t ripple;		   // Peak to peak of the in band readings after settling
+	uint16_t droop;			   // Largest drop below the target after settling (thermal load)
+	uint16_t recovery_time_ms; // Longest time below the band after settling
+	uint32_t duration_ms;	   //
+	uint32_t energy_mj;		   // Estimated heater energy
+	uint32_t full_power_ms;	   // Time with the max heater half cycles of the cartridge profile between readings
+	uint8_t status;			   // How far the run got (CONTROL_RUN_RISING ... CONTROL_RUN_SETTLED)
+} control_run;
+
+typedef struct {
+	uint32_t magic;
+	volatile uint32_t head; // Total number of finished runs, the next run is written to head % CONTROL_LOG_LENGTH
+	control_run runs[CONTROL_LOG_LENGTH];
+} control_log_buffer;
+
+/******    Function Declarations    ******/
+extern control_log_buffer control_log;
+
+void control_metrics_update(uint16_t tip_temp, uint8_t on_periods, uint16_t target_temp);
+const control_run *control_metrics_get_run(void);
+
+#endif
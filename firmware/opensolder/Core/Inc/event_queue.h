@@ -0,0 +1,66 @@
+/*
+ * event_queue.h
+ *
+ * Lock-free single producer, single consumer event queue
+ *
+ * USAGE:
+ * - Call event_push() from the producer context, it returns RESET if the queue is full
+ * - Call event_pop() from the consumer context until it returns RESET
+ * - Compare event.sequence with the previous one to detect dropped events
+ * - After popping, call event_get_level() for the level events (tip state, AC state), in case one was dropped
+ *
+ * The producer only writes queue_head, and the consumer only writes queue_tail, so no critical
+ * sections are needed. All producers must run in the same context, or at the same interrupt
+ * priority so they can't preempt each other. In OpenSolder that is SysTick and PendSV (priority 3),
+ * and the consumer is the main loop.
+ *
+ * EVENT_TIP_STATE and EVENT_AC_STATE carry a level rather than a change. event_push() latches the
+ * latest level of these before the queue full check, so a consumer that lost one of them (e.g. while
+ * the main loop is held up by the splash screen) still ends up with the current level. The latch is
+ * never older than the newest queued event of the same type, so reading it after the queue is empty
+ * gives the current level.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+/******    Includes    ******/
+#include "stm32f0xx_hal.h"
+
+/******    Constants and Objects    ******/
+enum event_queue_constants {
+	EVENT_QUEUE_LENGTH = 16 // Must be a power of two
+};
+
+enum event_types {
+	EVENT_MEASUREMENT = 0, // New tip temperature reading
+	EVENT_TIP_STATE,	   // Result of a tip check, or a forced error
+	EVENT_AC_STATE,		   // Zero cross detection lost or restored
+	EVENT_BUTTON,		   // Front button released
+	EVENT_TYPE_COUNT
+};
+
+typedef struct {
+	uint16_t sequence; // Increased for every event the producer tries to push, also when the queue is full
+	uint8_t type;	   // event_types
+	union {
+		struct {
+			uint16_t tip_temp;
+			uint8_t on_periods;
+		} measurement;
+		uint16_t tip_state; // TIP_DETECTED, TIP_NOT_DETECTED or TIP_CHECK_ERROR
+		uint8_t ac_state;	// ON or OFF
+		uint8_t button;		// SHORT_PRESS or LONG_PRESS
+	} data;
+} event;
+
+/******    Function Declarations    ******/
+uint8_t event_push(event *const self);
+uint8_t event_pop(event *const self);
+uint8_t event_get_level(uint8_t type, uint16_t *level);
+uint16_t event_queue_get_dropped(void);
+
+#endif
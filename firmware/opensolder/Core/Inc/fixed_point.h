@@ -0,0 +1,74 @@
+/*
+ * fixed_point.h
+ *
+ * Fixed-point math helpers, so the firmware doesn't need soft-float on the Cortex-M0
+ *
+ * USAGE:
+ * - Fractions are stored as q15_t, where Q15_ONE (32767) is ~1.0 and -32768 is -1.0
+ * - Use q15_mul() to scale a value by a fraction, and fixed_lerp() to interpolate
+ * - Use FIXED_DIV_CONST() to divide by a constant without calling the division helper (no hardware divide on the M0)
+ * - Use fixed_sin_deg() / fixed_cos_deg() for trigonometry on whole degrees
+ *
+ * Float and double are not allowed in the firmware, the linker script fails the build if a
+ * soft-float helper (__aeabi_fmul, __aeabi_dadd etc.) is referenced.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+/******    Includes    ******/
+#include <stdint.h>
+
+/******    Constants and Types    ******/
+typedef int16_t q15_t;
+
+enum fixed_point_constants {
+	Q15_SHIFT = 15,
+	Q15_ONE = INT16_MAX,
+	Q15_MINUS_ONE = INT16_MIN,
+	FIXED_RECIPROCAL_SHIFT = 20
+};
+
+/*
+ * Divide a non-negative value by a constant with a multiply and a shift. The reciprocal is rounded up,
+ * which gives exactly x / divisor for 0 <= x < 4096 (12 bit, e.g. an ADC reading) and divisors up to 256.
+ * The divisor must be a compile time constant, so the reciprocal is folded by the compiler.
+ */
+#define FIXED_RECIPROCAL(divisor) ((((uint32_t)1 << FIXED_RECIPROCAL_SHIFT) + (divisor) - 1) / (divisor))
+#define FIXED_DIV_CONST(x, divisor) ((uint32_t)((uint32_t)(x) * FIXED_RECIPROCAL(divisor)) >> FIXED_RECIPROCAL_SHIFT)
+
+/******    Functions    ******/
+static inline int32_t fixed_saturate(int32_t value, int32_t min, int32_t max) {
+	if (value > max) {
+		return max;
+	} else if (value < min) {
+		return min;
+	}
+	return value;
+}
+
+// Product of two Q15 fractions, rounded. Saturates -1.0 * -1.0 to Q15_ONE
+static inline q15_t q15_mul_sat(q15_t a, q15_t b) {
+	int32_t product = ((int32_t)a * b + (1 << (Q15_SHIFT - 1))) >> Q15_SHIFT;
+	return (q15_t)fixed_saturate(product, Q15_MINUS_ONE, Q15_ONE);
+}
+
+// Scale an integer by a Q15 fraction, rounded. Saturates to the int16_t range
+static inline int16_t q15_mul(int16_t value, q15_t fraction) {
+	int32_t product = ((int32_t)value * fraction + (1 << (Q15_SHIFT - 1))) >> Q15_SHIFT;
+	return (int16_t)fixed_saturate(product, INT16_MIN, INT16_MAX);
+}
+
+// Linear interpolation from a to b, position is a fraction from 0 (a) to Q15_ONE (b)
+static inline int32_t fixed_lerp(int32_t a, int32_t b, q15_t position) {
+	return a + (((b - a) * position) >> Q15_SHIFT);
+}
+
+/******    Function Declarations    ******/
+q15_t fixed_sin_deg(int32_t degrees);
+q15_t fixed_cos_deg(int32_t degrees);
+
+#endif
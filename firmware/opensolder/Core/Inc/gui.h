@@ -12,10 +12,22 @@
 #include "opensolder.h"
 #include "ssd1306.h"
 
+/******    Constants   ******/
+enum debug_pages {
+	DEBUG_PAGE_OFF = 0, // Default display
+	DEBUG_PAGE_RUNTIME, // CPU load, latencies and measurement diagnostics, a long press selects the ADC profile
+	DEBUG_PAGE_MEMORY,	// Stack high-water mark and RAM usage
+	DEBUG_PAGE_CONTROL, // Heat-up and settling of the last temperature step
+	DEBUG_PAGE_POWER,	// Heater duty, power and energy
+	DEBUG_PAGE_COUNT
+};
+
 /******    Global Function Declarations    ******/
 void init_display(uint16_t timeout);
 void update_display(void);
 void display_message(uint16_t message_code); // Use message code from opensolder_messages enum
 void draw_default_display(void);
+void draw_debug_display(uint8_t page);
+void update_debug_display(uint8_t page);
 
 #endif
@@ -0,0 +1,61 @@
+/*
+ * invariant.h
+ *
+ * Runtime checks of properties that must always hold
+ *
+ * USAGE:
+ * - Call INVARIANT(condition, id) where the property must hold, it compiles to nothing if INVARIANT_ENABLE is 0
+ * - A violation is counted, logged as TRACE_INVARIANT and kept as the last violated id
+ * - Read the results with invariant_get_violations() and invariant_get_last(), or with the debugger
+ *
+ * The checks only observe, they don't change the behaviour of the firmware. The safety paths
+ * (heater interlock, overheat and AC loss) are handled where they are, the checks show if one of
+ * them was bypassed. INVARIANT() may be used in any context, also ISRs.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef INVARIANT_H
+#define INVARIANT_H
+
+/******    Includes    ******/
+#include "stm32f0xx_hal.h"
+
+/******    Constants and Objects    ******/
+// Checks are enabled in Debug builds by default, define INVARIANT_ENABLE as 0 or 1 to override
+#ifndef INVARIANT_ENABLE
+#ifdef DEBUG
+#define INVARIANT_ENABLE 1
+#else
+#define INVARIANT_ENABLE 0
+#endif
+#endif
+
+enum invariant_ids {
+	INVARIANT_NONE = 0,
+	INVARIANT_HEATER_STATE,	   // Heater only switched on in ON or STANDBY state, with a tip detected
+	INVARIANT_SET_TEMP,		   // Set temperature within MIN_TEMP..MAX_TEMP
+	INVARIANT_ENCODER_DELTA,   // Sum of the encoder deltas equals the counter movement, also across the counter wrap
+	INVARIANT_STATE,		   // Active state is a valid leaf state, never a parent state
+	INVARIANT_EVENT_SEQUENCE   // Event sequence numbers never go backwards
+};
+
+/******    Function Declarations    ******/
+uint16_t invariant_get_violations(void);
+uint8_t invariant_get_last(void);
+
+#if INVARIANT_ENABLE
+void invariant_violation(uint8_t id);
+
+#define INVARIANT(condition, id)     \
+	do {                             \
+		if (!(condition)) {          \
+			invariant_violation(id); \
+		}                            \
+	} while (0)
+#else
+#define INVARIANT(condition, id) ((void)0)
+#endif
+
+#endif
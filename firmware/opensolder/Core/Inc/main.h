@@ -87,6 +87,7 @@ void Error_Handler(void);
 #define STAND_GPIO_Port GPIOB
 #define OS_Pin GPIO_PIN_9
 #define OS_GPIO_Port GPIOB
+#define OS_EXTI_IRQn EXTI4_15_IRQn
 
 /* USER CODE BEGIN Private defines */
 
@@ -12,18 +12,26 @@
 #include "main.h"
 #include <stdint.h>
 
-/******    Constants   ******/
-enum PCT2075_constants {
-	PCT2075_I2C_ADDR = 0x92U, // 1001 001 << 1
-	PCT2075_TEMP_REG = 0x00U, // Temperature register pointer
-	PCT2075_CONF_REG = 0x01U, // Configuration register pointer
-	PCT2075_HYST_REG = 0x02U, // Hysteresis register pointer
-	PCT2075_OS_REG = 0x03U,	  // Over-temperature shutdown register pointer
-	PCT2075_IDLE_REG = 0x01U  // Idle register pointer
-};
+/******    Macros    ******/
+// Functions marked RAMFUNC are copied to RAM with .data at startup, and run without flash wait states.
+// long_call only makes the calls from flash to them reach (RAM is more than 16MB away). Calls from them out
+// to flash, e.g. into the HAL, rely on the veneers the linker adds: look for *_veneer in the .map file after
+// adding such a call. Define RAMFUNC_ENABLE as 0 to keep them in flash
+#ifndef RAMFUNC_ENABLE
+#define RAMFUNC_ENABLE 1
+#endif
 
+#if RAMFUNC_ENABLE
+#define RAMFUNC __attribute__((section(".RamFunc"), long_call, noinline))
+#else
+#define RAMFUNC
+#endif
+
+/******    Constants   ******/
 enum opensolder_constants {
-	TIP_CHECK_INTERVAL = 50,		   // Number of half mains cycles between each tip check (value of 50 cycles * 10ms = 500ms tipcheck interval)
+	TIP_CHECK_INTERVAL = 50,		   // Number of half mains cycles between each tip check without a tip, in standby, off and tip change (value of 50 cycles * 10ms = 500ms tipcheck interval)
+	TIP_CHECK_RUN_INTERVAL = 1000,	   // Number of half mains cycles between each tip check while heating, tip presence is taken from the normal readings
+	TIP_CHECK_MIN_INTERVAL = 5,		   // Minimum number of half mains cycles between two tip checks, for requested checks
 	TIP_CHANGE_DELAY_MS = 2000,		   // Delay after tip_change_sense is set before turning heater on
 	DISPLAY_BRIGHTNESS = 255,		   // Sets display contrast/brightness, value 0-255
 	DISPLAY_UPDATE_TICKS = 500,		   // Refresh rate for updating tip_temp, set higher to remove jitter
@@ -38,11 +46,53 @@ enum opensolder_constants {
 	STANDBY_TEMP = 160,				   // Tip temperature when handle is in holder
 	STANDBY_TIME_S = 300,			   // Number of seconds to keep tip at elevated standby temperature, before turning heater off
 	STANDBY_DELAY_MS = 300,			   // Delay from lifting the tool holder before turning heater on
-	ADC_BUFFER_LENGTH = 50,			   // Number of ADC samples to take every reading
+	HEATER_SUPPLY_MV = 24000,		   // Nominal heater supply (24VAC transformer, RMS), used for power estimates
+	TIP_RESISTANCE_MOHM = 2500,		   // Nominal T245 heater resistance, used for power estimates until the tip is measured
+	TIP_CHECK_PULL_OHM = 10000,		   // TIP_CHECK series resistor (R4), used for the tip resistance estimate
+	TC_AMP_GAIN = 221,				   // Thermocouple amplifier gain (1 + R6 / R7), used for the tip resistance estimate
+	ADC_BUFFER_LENGTH = 50,			   // Samples per channel the ADC buffer can hold, must fit the sample count of the largest measurement profile
+	ADC_DEFAULT_PROFILE = 0,		   // Measurement profile used at startup, index into adc_profiles[] (see adc_profile_constants)
+	TIP_CLAMP_DELAY_US = 2000,		   // Delay from heater off to releasing the thermocouple clamp (first TIM7 period)
+	SETTLE_DELAY_US = 2000,			   // Default delay from clamp release to ADC start (second TIM7 period), replaced by settle calibration
+	SETTLE_DELAY_MIN_US = 500,		   // Shortest settle delay the calibration may program
+	SETTLE_DELAY_MAX_US = 4000,		   // Longest settle delay the calibration may program
+	SETTLE_MARGIN_US = 250,			   // Added to the measured settle time
+	SETTLE_TRACE_LENGTH = 210,		   // Number of thermocouple samples captured after clamp release during settle calibration (~3.8ms)
+	SETTLE_FINAL_SAMPLES = 48,		   // Number of samples at the end of the trace used as the settled value
+	SETTLE_TOLERANCE = 8,			   // Max deviation from the settled value, in ADC LSB
 	ADC_MAX_DEVIATION = 200,		   // Maximum deviation allowed in the ADC sample buffer. Any value out of range gives the reading an error
 	ADC_NO_TIP_MIN_VALUE = 4000,	   // Lowest expected temp reading with no tip inserted and TIP_CHECK pin high. Used for tip detection
 	ADC_TIP_MAX_VALUE = 3800,		   // Max expected temp reading with tip inserted. Must be higher that MAX_TEMP reading. Used for tip detection
-	AC_DETECTION_INTERVAL_MS = 12	   // Max expected time between each AC interrupt
+	AC_DETECTION_INTERVAL_MS = 12,	   // Max expected time between each AC interrupt
+	MEASUREMENT_TIMEOUT_MS = 200,	   // Max time between two temperature readings while AC is present, before it is a fault
+	PCB_TEMP_READ_INTERVAL_MS = 2000,  // Time between each PCB temperature reading
+	CONTROL_TASK_PERIOD_MS = 20,	   // State machine runs on every temperature reading, and at least this often (AC loss detection)
+	INPUT_TASK_PERIOD_MS = 10,		   // Encoder and sensor reading interval
+	SENSOR_SCAN_INTERVAL_MS = 10,	   // Button debounce scan interval, from the SysTick callback (see DEBOUNCE_TICKS)
+	DISPLAY_TASK_PERIOD_MS = 33,	   // Display refresh interval (30Hz)
+	RAM_MONITOR_TASK_PERIOD_MS = 1000, // Stack high-water mark and heap usage scan interval
+	POWER_STATS_PERIOD_MS = 1000,	   // Heater duty and energy aggregation interval
+	ISR_TIME_SAMPLES = 256,			   // Number of timer ISRs averaged for get_isr_time_ns()
+	PCB_OVERHEAT_TEMP = 80,			   // PCB temperature where the PCT2075 OS pin cuts the heater
+	PCB_OVERHEAT_HYST_TEMP = 70		   // PCB temperature where the PCT2075 OS pin is released again
+};
+
+enum adc_profile_constants {
+	ADC_PROFILE_PRECISE = 0, // 50 samples at 239.5 cycles, ~0.9ms window
+	ADC_PROFILE_BALANCED,	 // 32 samples at 71.5 cycles, ~190us window
+	ADC_PROFILE_FAST,		 // 16 samples at 71.5 cycles, ~100us window
+	ADC_PROFILE_COUNT
+};
+
+// ADC channels. The thermocouple is converted alone, then the internal channels in a short scan, in the order
+// they are converted (ADC_SCAN_DIRECTION_FORWARD, lowest channel first)
+enum adc_channel_constants {
+	ADC_CH_THERMOCOUPLE = 0, // ADC_CHANNEL_0
+	ADC_CH_TEMPSENSOR,		 // ADC_CHANNEL_TEMPSENSOR (16), MCU internal temperature sensor
+	ADC_CH_VREFINT,			 // ADC_CHANNEL_VREFINT (17), internal reference for supply correction
+	ADC_CHANNEL_COUNT,
+	ADC_INTERNAL_CHANNEL_COUNT = ADC_CHANNEL_COUNT - ADC_CH_TEMPSENSOR,
+	ADC_INTERNAL_SCANS = 4 // Scans of the internal channels after each reading, averaged
 };
 
 enum opensolder_messages {
@@ -54,10 +104,33 @@ enum opensolder_messages {
 	TIP_CHECK_ERROR,
 	AC_NOT_DETECTED,
 	OVERHEATING,
+	MEASUREMENT_TIMEOUT,
 	ADC_READING_ERROR = 999 // Constant to check tip_temp for an error. Also displays 999 on display in case of a reading error
 };
 
-enum my_states { INIT_STATE, TIP_CHANGE_STATE, OFF_STATE, ON_STATE, STANDBY_STATE, ERROR_STATE };
+enum my_states {
+	INIT_STATE,
+	TIP_CHANGE_STATE,
+	OFF_STATE,
+	ON_STATE,
+	STANDBY_STATE,
+	ERROR_STATE,
+	TIP_PRESENT_STATE, // Parent of OFF, ON and STANDBY, never the active state
+	RUN_STATE,		   // Parent of all states except ERROR, never the active state
+	STATE_COUNT,
+	NO_STATE = STATE_COUNT,
+	STATE_DEPTH_MAX = 3 // Max number of nested states
+};
+
+// Measurement state as seen by the main loop, only updated from the event queue
+typedef struct {
+	uint16_t tip_temp;
+	uint16_t tip_state;
+	uint8_t on_periods;
+	uint8_t ac_state;
+	uint16_t sequence;	  // Sequence number of the last consumed event
+	uint16_t lost_events; // Events lost on a full queue, counted from gaps in the sequence numbers
+} station_snapshot;
 
 /******    Global Variables    ******/
 extern ADC_HandleTypeDef hadc;
@@ -65,11 +138,14 @@ extern I2C_HandleTypeDef hi2c1;
 extern TIM_HandleTypeDef htim2;
 extern TIM_HandleTypeDef htim6;
 extern TIM_HandleTypeDef htim7;
+extern TIM_HandleTypeDef htim14;
 
 /******    Global Function Declarations    ******/
 void opensolder_init(void);
 void opensolder_main(void);
 void sensor_scan(void);
+void measurement_complete(void);
 uint8_t get_system_state(void);
+const station_snapshot *get_station_snapshot(void);
 
 #endif
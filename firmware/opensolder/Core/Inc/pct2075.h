@@ -0,0 +1,41 @@
+/*
+ * pct2075.h
+ *
+ * Non-blocking driver for the PCT2075 I2C temperature sensor
+ *
+ * USAGE:
+ * - Enable the I2C event interrupt and configure the OS pin as a falling edge EXTI
+ * - Call pct2075_init() once to program the over-temperature limits and do a first (blocking) read
+ * - Call pct2075_read_start() periodically, it returns immediately and the result arrives in the I2C interrupt
+ * - Call pct2075_get_temperature() to get the last temperature reading
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef PCT2075_H
+#define PCT2075_H
+
+/******    Includes    ******/
+#include "stm32f0xx_hal.h"
+
+/******    Constants   ******/
+enum PCT2075_constants {
+	PCT2075_I2C_ADDR = 0x92U, // 1001 001 << 1
+	PCT2075_TEMP_REG = 0x00U, // Temperature register pointer
+	PCT2075_CONF_REG = 0x01U, // Configuration register pointer
+	PCT2075_HYST_REG = 0x02U, // Hysteresis register pointer
+	PCT2075_OS_REG = 0x03U,	  // Over-temperature shutdown register pointer
+	PCT2075_IDLE_REG = 0x04U, // Idle register pointer
+
+	PCT2075_CONF_OS_QUEUE_2 = 0x08U, // OS fault queue of 2, comparator mode, OS active low
+	PCT2075_TIMEOUT_MS = 10,		 // Timeout for the blocking transfers in pct2075_init()
+	PCT2075_READ_ERROR = 999		 // Returned by pct2075_get_temperature() if the last read failed
+};
+
+/******    Function Declarations    ******/
+void pct2075_init(I2C_HandleTypeDef *hi2c, int8_t os_temp, int8_t hyst_temp);
+void pct2075_read_start(void);
+int16_t pct2075_get_temperature(void);
+
+#endif
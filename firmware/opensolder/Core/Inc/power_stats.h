@@ -0,0 +1,62 @@
+/*
+ * power_stats.h
+ *
+ * Heater energy and duty accounting
+ *
+ * USAGE:
+ * - Call power_stats_half_cycle() from the zero cross ISR every mains half cycle, and power_stats_fired() when the heater is switched on
+ * - Call power_stats_update() every POWER_STATS_PERIOD_MS from the main loop, it aggregates the ISR counters
+ * - Read the results with the getters
+ *
+ * The ISR only increments two counters. The main loop takes the difference since the last update and gives
+ * the half cycles per second, the duty of the last period and its rolling average, a histogram of the time
+ * spent at each duty, and the heater power. Power is estimated from the nominal heater supply voltage and
+ * the tip resistance: full power is V^2 / R, scaled by the duty.
+ * The heater is off in the half cycle of each reading, so the highest duty is max_on_periods of the
+ * cartridge profile (cartridge.h) out of max_on_periods + 1 half cycles. The histogram is relative to it.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef POWER_STATS_H
+#define POWER_STATS_H
+
+/******    Includes    ******/
+#include "stm32f0xx_hal.h"
+
+/******    Constants and Objects    ******/
+enum power_stats_constants {
+	POWER_HISTOGRAM_BINS = 11, // 10% of the highest duty per bin, rounded, the last bin is at the highest duty
+	POWER_AVERAGE_SHIFT = 3	   // Rolling average over ~2^3 update periods
+};
+
+typedef struct {
+	volatile uint32_t half_cycles; // Mains half cycles since power up
+	volatile uint32_t fired;	   // Half cycles with the heater on
+} power_counters;
+
+/******    Function Declarations    ******/
+extern power_counters power_stats_counters;
+
+static inline void power_stats_half_cycle(void) {
+	power_stats_counters.half_cycles++;
+}
+
+static inline void power_stats_fired(void) {
+	power_stats_counters.fired++;
+}
+
+void power_stats_update(void);
+uint16_t power_stats_get_half_cycles_per_s(void);
+uint16_t power_stats_get_fired_per_s(void);
+uint16_t power_stats_get_duty(void);		 // Duty of the last period in 0.1%
+uint16_t power_stats_get_average_duty(void); // Rolling average duty in 0.1%
+uint16_t power_stats_get_watts(void);		 // Rolling average heater power
+uint16_t power_stats_get_peak_watts(void);	 // Highest power over one period since power up
+uint32_t power_stats_get_energy_j(void);	 // Heater energy since power up
+uint32_t power_stats_get_full_power_w(void); // Heater power at 100% duty
+uint16_t power_stats_get_max_duty(void);	 // Highest duty with the cartridge profile in 0.1%
+const uint32_t *power_stats_get_histogram(void); // Seconds spent at each duty, POWER_HISTOGRAM_BINS entries
+
+#endif
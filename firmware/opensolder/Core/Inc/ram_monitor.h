@@ -0,0 +1,41 @@
+/*
+ * ram_monitor.h
+ *
+ * Stack high-water mark and RAM usage
+ *
+ * USAGE:
+ * - Call ram_monitor_init() early, it paints the unused part of the stack with STACK_PAINT
+ * - Call ram_monitor_scan() periodically, it updates the stack high-water mark and the heap usage
+ * - Read the results with the getters, all sizes are in bytes
+ *
+ * The stack is placed at the start of RAM by the linker script, so an overflow faults
+ * instead of corrupting other data. The high-water mark shows how close it has been.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef RAM_MONITOR_H
+#define RAM_MONITOR_H
+
+/******    Includes    ******/
+#include "stm32f0xx_hal.h"
+
+/******    Constants   ******/
+enum ram_monitor_constants {
+	STACK_PAINT_MARGIN = 8 // Words below the current stack pointer left unpainted by ram_monitor_init()
+};
+
+#define STACK_PAINT 0xC5C5C5C5U
+
+/******    Function Declarations    ******/
+void ram_monitor_init(void);
+void ram_monitor_scan(void);
+uint16_t ram_monitor_get_stack_size(void);
+uint16_t ram_monitor_get_stack_used(void);
+uint16_t ram_monitor_get_static_ram(void);
+uint16_t ram_monitor_get_ramfunc_size(void);
+uint16_t ram_monitor_get_heap_used(void);
+uint16_t ram_monitor_get_free(void);
+
+#endif
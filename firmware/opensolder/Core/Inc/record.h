@@ -0,0 +1,77 @@
+/*
+ * record.h
+ *
+ * Recording of the raw thermocouple readings and control decisions in a RAM ring buffer
+ *
+ * USAGE:
+ * - Build with RECORD_ENABLE defined as 1, adc_process() then records every reading
+ * - Dump record_log with the debugger, e.g. in gdb: dump binary value record.bin record_log
+ *   The ring holds the last RECORD_LENGTH readings. Dumps taken repeatedly while the MCU runs
+ *   (e.g. with OpenOCD or pyOCD) can be joined into one session on the record sequence numbers
+ * - Decode the dumps with firmware/tools/record_decode.py record1.bin record2.bin ...
+ * - Replay a session saved with record_decode.py --save through the firmware with the host build,
+ *   firmware/host/build/opensolder_replay session.bin
+ *
+ * Each record holds the raw thermocouple samples of one reading, the zero cross timestamp of the
+ * half cycle it was taken in, the resulting tip temperature, tip state and heater decision, and the
+ * raw levels of the front panel inputs. A reading is recorded from adc_process() only, so the
+ * ring has a single writer.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef RECORD_H
+#define RECORD_H
+
+/******    Includes    ******/
+#include "opensolder.h"
+
+/******    Constants and Objects    ******/
+// Recording takes RECORD_LENGTH * 112 bytes of RAM, and is off by default. Define RECORD_ENABLE as 1 to enable it
+#ifndef RECORD_ENABLE
+#define RECORD_ENABLE 0
+#endif
+
+enum record_constants {
+	RECORD_LENGTH = 16,		  // Number of records, must be a power of two
+	RECORD_MAGIC = 0x52435244, // "RCRD", marks the start of a record_log dump
+
+	// Bits in record_entry.flags
+	RECORD_FLAG_HOLDER = 0x01,	   // STAND pin level
+	RECORD_FLAG_TIP_CHANGE = 0x02, // TIP_REMOVER pin level
+	RECORD_FLAG_BUTTON = 0x04,	   // ENC_SW pin level
+	RECORD_FLAG_TIP_CHECK = 0x80   // The reading was a tip check, not a temperature reading
+};
+
+// Keep the layout in sync with RECORD_FORMAT in firmware/tools/record_decode.py
+typedef struct {
+	uint32_t zc_us;		   // Timebase value of the zero cross before the reading
+	uint16_t tip_temp;	   // Tip temperature after the reading
+	uint16_t encoder;	   // Encoder timer counter (TIM2->CNT)
+	uint8_t sample_count;  // Number of valid samples
+	uint8_t on_periods;	   // Heater decision, number of half cycles the heater is on before the next reading
+	uint8_t tip_state;	   // opensolder_messages
+	uint8_t flags;		   // RECORD_FLAG_x
+	uint16_t samples[ADC_BUFFER_LENGTH]; // Raw thermocouple samples
+} record_entry;
+
+typedef struct {
+	uint32_t magic;
+	volatile uint32_t head; // Total number of records, the next record is written to head % RECORD_LENGTH
+	record_entry entries[RECORD_LENGTH];
+} record_buffer;
+
+/******    Function Declarations    ******/
+#if RECORD_ENABLE
+extern record_buffer record_log;
+
+void record_reading(const uint16_t *buffer, uint8_t sample_count, uint32_t zc_us, uint16_t tip_temp, uint8_t on_periods, uint8_t tip_state, uint8_t tip_check);
+
+#define RECORD(buffer, sample_count, zc_us, tip_temp, on_periods, tip_state, tip_check) \
+	record_reading((buffer), (sample_count), (zc_us), (tip_temp), (on_periods), (tip_state), (tip_check))
+#else
+#define RECORD(buffer, sample_count, zc_us, tip_temp, on_periods, tip_state, tip_check) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * scheduler.h
+ *
+ * Cooperative run-to-completion task scheduler for embedded systems
+ *
+ * USAGE:
+ * - Create an array of task objects, ordered from highest to lowest priority
+ * - Call scheduler_init() with the task array
+ * - Call scheduler_run() from the main loop, it runs the highest priority ready task and returns
+ * - Call task_signal() (also from an ISR) to release an event triggered task
+ * - Call scheduler_idle() when scheduler_run() returns RESET, it sleeps (WFI) until the next interrupt
+ *
+ * A task is released every period_ms, and/or when it is signalled. If a task finishes later than
+ * deadline_ms after its release, or a periodic release is missed, its overrun counter is increased.
+ *
+ * The time spent sleeping is measured with the microsecond timebase (timebase.h), and gives the CPU
+ * load over windows of CPU_LOAD_WINDOW_MS. The periodic releases rely on SysTick to wake the core.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+/******    Includes    ******/
+#include "stm32f0xx_hal.h"
+
+/******    Constants and Objects    ******/
+enum scheduler_constants {
+	CPU_LOAD_WINDOW_MS = 1000 // Time window for the CPU load measurement
+};
+
+typedef struct {
+	void (*run)(void);
+	uint16_t period_ms;	  // Time between periodic releases, 0 for event triggered only
+	uint16_t deadline_ms; // Max time from release to completion
+	uint32_t release_tick;
+	volatile uint8_t event_flag;
+	volatile uint32_t event_tick;
+	uint16_t overruns;
+	uint16_t max_response_ms;
+} task;
+
+/******    Function Declarations    ******/
+void scheduler_init(task *tasks, uint8_t task_count);
+uint8_t scheduler_run(void);
+void scheduler_idle(void);
+void task_signal(task *const self);
+uint16_t scheduler_get_overruns(void);
+uint8_t scheduler_get_cpu_load(void);
+
+#endif
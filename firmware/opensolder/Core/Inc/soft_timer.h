@@ -0,0 +1,50 @@
+/*
+ * soft_timer.h
+ *
+ * Timer wheel for millisecond software timers
+ *
+ * USAGE:
+ * - Create a soft_timer object, it starts out stopped
+ * - Call soft_timer_tick() with the current tick from the tick interrupt (SysTick callback)
+ * - Call soft_timer_start() to (re)start a timer, and soft_timer_stop() to cancel it
+ * - Poll soft_timer_expired() or soft_timer_running(). An expired timer stays expired until it is restarted or stopped
+ *
+ * Timers are hashed into SOFT_TIMER_WHEEL_SLOTS lists on their expiry tick, so start, stop and expire
+ * are O(1). A timer longer than the wheel stays in its slot for more than one round, and expires
+ * when (int32_t)(tick - expiry_tick) >= 0, which is safe across the 32 bit tick wrap.
+ * Start and stop may be called from the main loop and from the tick context.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef SOFT_TIMER_H
+#define SOFT_TIMER_H
+
+/******    Includes    ******/
+#include "stm32f0xx_hal.h"
+
+/******    Constants and Objects    ******/
+enum soft_timer_constants {
+	SOFT_TIMER_WHEEL_SLOTS = 16, // Must be a power of two
+
+	SOFT_TIMER_STOPPED = 0,
+	SOFT_TIMER_RUNNING,
+	SOFT_TIMER_EXPIRED
+};
+
+typedef struct soft_timer {
+	struct soft_timer *next;
+	struct soft_timer *prev;
+	uint32_t expiry_tick;
+	volatile uint8_t state;
+} soft_timer;
+
+/******    Function Declarations    ******/
+void soft_timer_start(soft_timer *const self, uint32_t delay_ms);
+void soft_timer_stop(soft_timer *const self);
+uint8_t soft_timer_running(soft_timer *const self);
+uint8_t soft_timer_expired(soft_timer *const self);
+void soft_timer_tick(uint32_t tick);
+
+#endif
@@ -56,6 +56,8 @@ void EXTI4_15_IRQHandler(void);
 void DMA1_Channel1_IRQHandler(void);
 void TIM6_DAC_IRQHandler(void);
 void TIM7_IRQHandler(void);
+void TIM14_IRQHandler(void);
+void I2C1_IRQHandler(void);
 /* USER CODE BEGIN EFP */
 
 /* USER CODE END EFP */
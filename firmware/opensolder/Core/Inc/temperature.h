@@ -12,13 +12,23 @@
 #include "opensolder.h"
 
 /******    Global Function Declarations    ******/
+void adc_init(void);
+void adc_process(void);
 uint8_t tip_check(void);
-int16_t read_pcb_temperature(void);
-uint16_t get_tip_temp(void);
 uint16_t get_set_temp(void);
-uint8_t get_tip_state(void);
-uint32_t get_ac_delay_tick(void);
-uint8_t get_power_bar_value(void);
+uint16_t get_target_temp(void);
+uint8_t get_overheat_state(void);
+uint16_t get_zc_latency_max_us(void);
+uint16_t get_zc_period_us(void);
+uint16_t get_isr_time_ns(void);
+uint16_t get_settle_delay_us(void);
+void settle_calibration_request(void);
+void tip_check_request(void);
+void set_adc_profile(uint8_t profile);
+uint8_t get_adc_profile(void);
+uint16_t get_adc_noise(void);
+uint16_t get_vdda_mv(void);
+int16_t get_mcu_temperature(void);
 void set_new_temp(uint16_t new_temp);
 void heater_off(void);
 void error_handler(void);
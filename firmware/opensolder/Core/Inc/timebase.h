@@ -0,0 +1,31 @@
+/*
+ * timebase.h
+ *
+ * 32 bit microsecond timebase from a 16 bit hardware timer
+ *
+ * USAGE:
+ * - Configure a timer to count in 1us steps with a period of 0xFFFF, and enable its update interrupt
+ * - Call timebase_init() once with the timer handle, it starts the timer
+ * - Call timebase_interrupt() from HAL_TIM_PeriodElapsedCallback(), it extends the counter in software
+ * - Call timebase_get_us() from any context to get the time since init
+ *
+ * The value wraps every ~71 minutes, so only use differences: (uint32_t)(end - start).
+ * The update interrupt should have the highest priority, but timebase_get_us() also handles an
+ * overflow that is still pending (called from an ISR with the same or higher priority).
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+/******    Includes    ******/
+#include "stm32f0xx_hal.h"
+
+/******    Function Declarations    ******/
+void timebase_init(TIM_HandleTypeDef *htim);
+void timebase_interrupt(TIM_HandleTypeDef *htim);
+uint32_t timebase_get_us(void);
+
+#endif
@@ -0,0 +1,80 @@
+/*
+ * trace.h
+ *
+ * Timestamped event trace in a RAM ring buffer
+ *
+ * USAGE:
+ * - Call TRACE(event, data) where something should be timed, it compiles to nothing if TRACE_ENABLE is 0
+ * - Halt the MCU and dump trace_log with the debugger, e.g. in gdb: dump binary value trace.bin trace_log
+ * - Decode the dump with firmware/tools/trace_decode.py trace.bin
+ *
+ * Each entry is one word: the low 16 bits of the microsecond timebase (TIM14 counter), the event id
+ * and 8 bits of event data. Logging an event is a handful of instructions with interrupts masked,
+ * so it can be used in any ISR. The decoder unwraps the 16 bit timestamps, so there must be less
+ * than 65ms between two logged events (the zero cross events take care of that while AC is present).
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/******    Includes    ******/
+#include "stm32f0xx_hal.h"
+
+/******    Constants and Objects    ******/
+// Tracing is enabled in Debug builds by default, define TRACE_ENABLE as 0 or 1 to override
+#ifndef TRACE_ENABLE
+#ifdef DEBUG
+#define TRACE_ENABLE 1
+#else
+#define TRACE_ENABLE 0
+#endif
+#endif
+
+enum trace_constants {
+	TRACE_LENGTH = 256,		 // Number of entries, must be a power of two
+	TRACE_MAGIC = 0x54524345 // "TRCE", marks the start of a trace_log dump
+};
+
+// Event ids, keep in sync with EVENTS in firmware/tools/trace_decode.py
+enum trace_events {
+	TRACE_ZC_EDGE = 1,	 // Zero cross EXTI
+	TRACE_TIM6,			 // True zero cross, data = interrupt latency in us
+	TRACE_HEATER_ON,	 // data = on periods left
+	TRACE_HEATER_OFF,	 //
+	TRACE_CLAMP_RELEASE, // First TIM7 period, thermocouple clamp released
+	TRACE_ADC_START,	 // data = measurement profile
+	TRACE_ADC_COMPLETE,	 // DMA transfer complete
+	TRACE_STATE,		 // State machine transition, data = previous state << 4 | new state (my_states)
+	TRACE_DISPLAY_BEGIN, // Display flush started
+	TRACE_DISPLAY_END,	 // Display flush done
+	TRACE_INVARIANT,	 // Invariant violated, data = invariant id (invariant_ids)
+	TRACE_STATE_EXIT,	 // State left by a transition, innermost first, data = state (my_states)
+	TRACE_STATE_ENTRY	 // State entered by a transition, outermost first, data = state (my_states)
+};
+
+typedef struct {
+	uint32_t magic;
+	volatile uint32_t head; // Total number of logged events, the next entry is written to head % TRACE_LENGTH
+	uint32_t entries[TRACE_LENGTH];
+} trace_buffer;
+
+/******    Function Declarations    ******/
+#if TRACE_ENABLE
+extern trace_buffer trace_log;
+
+static inline void trace_event(uint8_t event, uint8_t data) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	trace_log.entries[trace_log.head++ & (TRACE_LENGTH - 1)] = TIM14->CNT | ((uint32_t)event << 16) | ((uint32_t)data << 24);
+	__set_PRIMASK(primask);
+}
+
+#define TRACE(event, data) trace_event((event), (uint8_t)(data))
+#else
+#define TRACE(event, data) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * benchmark.c
+ *
+ * Microbenchmarks of the CPU bound display, ADC and input kernels
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "benchmark.h"
+
+#if BENCHMARK_ENABLE
+#include "opensolder.h"
+#include "button.h"
+#include "gui.h"
+#include "ssd1306.h"
+#include "timebase.h"
+
+/******    Constants    ******/
+enum benchmark_file_constants {
+	FRAME_BYTES = (SSD1306_HEIGHT / 8) * (3 + SSD1306_WIDTH) // Each of the 8 display pages is 3 command bytes and one row of data
+};
+
+/******    Local Function Declarations    ******/
+static void benchmark_batch(uint8_t id);
+static void write_char_6x8(void);
+static void write_char_7x10(void);
+static void write_char_11x18(void);
+static void write_char_16x26(void);
+static void filled_rectangle(void);
+static void scan_button(void);
+
+/******    Global Variables    ******/
+benchmark_result benchmark_results[BENCHMARK_COUNT];
+
+const benchmark_kernel benchmark_kernels[BENCHMARK_COUNT] = {
+	[BENCHMARK_ADC_STATS] = {"adc_stats", adc_stats_benchmark, 100, 0},
+	[BENCHMARK_ADC_DEVIATION] = {"adc_deviation", adc_deviation_benchmark, 100, 0},
+	[BENCHMARK_WRITE_CHAR_6X8] = {"write_char_6x8", write_char_6x8, 100, 0},
+	[BENCHMARK_WRITE_CHAR_7X10] = {"write_char_7x10", write_char_7x10, 100, 0},
+	[BENCHMARK_WRITE_CHAR_11X18] = {"write_char_11x18", write_char_11x18, 100, 0},
+	[BENCHMARK_WRITE_CHAR_16X26] = {"write_char_16x26", write_char_16x26, 100, 0},
+	[BENCHMARK_FILLED_RECTANGLE] = {"filled_rectangle", filled_rectangle, 100, 0},
+	[BENCHMARK_UPDATE_SCREEN] = {"update_screen", ssd1306_UpdateScreen, 8, FRAME_BYTES},
+	[BENCHMARK_UPDATE_DISPLAY] = {"update_display", update_display, 8, FRAME_BYTES},
+	[BENCHMARK_BUTTON_SCAN] = {"button_scan", scan_button, 100, 0},
+};
+
+/******    File Scope Variables    ******/
+static button benchmark_button;
+
+/******    Functions    ******/
+void benchmark_run(void) {
+	benchmark_init();
+	for (uint8_t id = 0; id < BENCHMARK_COUNT; id++) {
+		benchmark_batch(id);
+	}
+
+	// Leave a clean frame buffer for the state machine
+	ssd1306_Fill(Black);
+}
+
+// State the kernels use, call before running them
+void benchmark_init(void) {
+	button_init(&benchmark_button, ENC_SW_GPIO_Port, ENC_SW_Pin, INVERTED);
+}
+
+static void benchmark_batch(uint8_t id) {
+	const benchmark_kernel *const entry = &benchmark_kernels[id];
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	uint32_t start_us = timebase_get_us();
+	for (uint16_t i = 0; i < entry->iterations; i++) {
+		entry->kernel();
+	}
+	uint32_t total_us = timebase_get_us() - start_us;
+
+	__set_PRIMASK(primask);
+
+	benchmark_results[id].iterations = entry->iterations;
+	benchmark_results[id].total_us = total_us;
+	benchmark_results[id].cycles_per_call = total_us * (SystemCoreClock / 1000000) / entry->iterations;
+	benchmark_results[id].bytes_per_call = entry->bytes_per_call;
+}
+
+static void write_char_6x8(void) {
+	ssd1306_SetCursor(0, 0);
+	ssd1306_WriteChar('8', Font_6x8, White);
+}
+
+static void write_char_7x10(void) {
+	ssd1306_SetCursor(0, 0);
+	ssd1306_WriteChar('8', Font_7x10, White);
+}
+
+static void write_char_11x18(void) {
+	ssd1306_SetCursor(0, 0);
+	ssd1306_WriteChar('8', Font_11x18, White);
+}
+
+static void write_char_16x26(void) {
+	ssd1306_SetCursor(0, 0);
+	ssd1306_WriteChar('8', Font_16x26, White);
+}
+
+static void filled_rectangle(void) {
+	ssd1306_DrawFilledRectangle(4, 40, 123, 47, White);
+}
+
+static void scan_button(void) {
+	button_scan(&benchmark_button);
+}
+#endif
@@ -0,0 +1,114 @@
+/*
+ * cartridge.c
+ *
+ * Tip cartridge resistance estimate, wear tracking and family classification
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "cartridge.h"
+
+/******    Local Function Declarations    ******/
+static uint8_t cartridge_classify(uint16_t resistance_mohm);
+
+/******    File Scope Variables    ******/
+static const cartridge_profile profiles[CARTRIDGE_FAMILY_COUNT] = {
+	[CARTRIDGE_UNKNOWN] = {"?", 0, 0, MAX_ON_PERIODS, 10},
+	[CARTRIDGE_LOW_R] = {"LowR", 1000, 1899, MAX_ON_PERIODS - 1, 15},
+	[CARTRIDGE_STANDARD] = {"C245", 1900, 3199, MAX_ON_PERIODS, 10},
+	[CARTRIDGE_HIGH_R] = {"HighR", 3200, 6000, MAX_ON_PERIODS, 6},
+};
+
+// Only written from adc_process(), read from the main loop
+static uint32_t resistance_q4;		   // Rolling average in mOhm, 4 fractional bits
+static uint16_t check_count;		   // Tip checks since the tip was inserted
+static uint32_t band_sum_mohm;		   // Sum of the last in band checks in a row
+static uint8_t band_checks;			   //
+static uint16_t reference_mohm;		   // Average of the first CARTRIDGE_MIN_CHECKS in band checks, 0 until then
+static uint16_t reference_temp;		   // Target temperature at that time
+static volatile uint16_t resistance_mohm;
+static volatile int16_t drift_permille;
+static volatile uint8_t family = CARTRIDGE_UNKNOWN;
+
+/******    Functions    ******/
+// rise is the tip check reading minus the previous thermocouple reading, in ADC LSB
+void cartridge_update(uint16_t rise, uint16_t tip_temp, uint16_t target_temp) {
+	uint32_t sample_mohm = ((uint32_t)rise * (TIP_CHECK_PULL_OHM * 1000UL / TC_AMP_GAIN)) >> 12;
+
+	if (check_count == 0) {
+		resistance_q4 = sample_mohm << 4;
+	} else {
+		resistance_q4 = resistance_q4 - (resistance_q4 >> CARTRIDGE_AVERAGE_SHIFT) + ((sample_mohm << 4) >> CARTRIDGE_AVERAGE_SHIFT);
+	}
+	resistance_mohm = resistance_q4 >> 4;
+	if (check_count < UINT16_MAX) {
+		check_count++;
+	}
+
+	if (check_count == CARTRIDGE_MIN_CHECKS) {
+		family = cartridge_classify(resistance_mohm);
+	}
+
+	// The reference and the drift are taken from CARTRIDGE_MIN_CHECKS in band checks in a row
+	int16_t error = (int16_t)(tip_temp - target_temp);
+	if (!target_temp || (error > CARTRIDGE_REFERENCE_BAND) || (error < -CARTRIDGE_REFERENCE_BAND)) {
+		band_sum_mohm = 0;
+		band_checks = 0;
+		return;
+	}
+	band_sum_mohm += sample_mohm;
+	if (++band_checks < CARTRIDGE_MIN_CHECKS) {
+		return;
+	}
+	uint16_t band_mohm = band_sum_mohm / CARTRIDGE_MIN_CHECKS;
+	band_sum_mohm = 0;
+	band_checks = 0;
+
+	int16_t temp_difference = (int16_t)(target_temp - reference_temp);
+	if (!reference_mohm) {
+		reference_mohm = band_mohm;
+		reference_temp = target_temp;
+	} else if ((temp_difference <= CARTRIDGE_DRIFT_TEMP_BAND) && (temp_difference >= -CARTRIDGE_DRIFT_TEMP_BAND)) {
+		drift_permille = ((int32_t)band_mohm - reference_mohm) * 1000 / reference_mohm;
+	}
+}
+
+void cartridge_reset(void) {
+	check_count = 0;
+	band_sum_mohm = 0;
+	band_checks = 0;
+	reference_mohm = 0;
+	resistance_mohm = 0;
+	drift_permille = 0;
+	family = CARTRIDGE_UNKNOWN;
+}
+
+uint16_t cartridge_get_resistance_mohm(void) {
+	return resistance_mohm;
+}
+
+int16_t cartridge_get_drift_permille(void) {
+	return drift_permille;
+}
+
+uint8_t cartridge_get_family(void) {
+	return family;
+}
+
+uint8_t cartridge_is_worn(void) {
+	return (drift_permille > CARTRIDGE_WORN_PERMILLE) || (drift_permille < -CARTRIDGE_WORN_PERMILLE);
+}
+
+const cartridge_profile *cartridge_get_profile(void) {
+	return &profiles[family];
+}
+
+static uint8_t cartridge_classify(uint16_t resistance_mohm) {
+	for (uint8_t i = CARTRIDGE_UNKNOWN + 1; i < CARTRIDGE_FAMILY_COUNT; i++) {
+		if ((resistance_mohm >= profiles[i].min_mohm) && (resistance_mohm <= profiles[i].max_mohm)) {
+			return i;
+		}
+	}
+	return CARTRIDGE_UNKNOWN;
+}
@@ -0,0 +1,138 @@
+/*
+ * control_metrics.c
+ *
+ * Heat-up, overshoot, settling and load recovery of the temperature control
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "control_metrics.h"
+#include "cartridge.h"
+#include "power_stats.h"
+#include "temperature.h"
+
+/******    Local Function Declarations    ******/
+static void run_start(uint32_t tick, uint16_t tip_temp, uint16_t target_temp);
+static void run_finish(void);
+static uint16_t ms_saturate(uint32_t ms);
+
+/******    Global Variables    ******/
+control_log_buffer control_log = {.magic = CONTROL_LOG_MAGIC};
+
+/******    File Scope Variables    ******/
+static control_run run;		   // Run in progress, or the last finished run
+static uint16_t active_target; // Target of the run in progress, 0 if no run
+static uint32_t start_tick;	   //
+static uint32_t band_tick;	   // Tick of the last band entry, or band exit after settling
+static uint8_t in_band;		   // Previous reading was in band
+static int8_t step_direction;  // 1 for a step up, -1 for a step down
+static uint16_t ripple_min;	   //
+static uint16_t ripple_max;	   //
+
+/******    Functions    ******/
+void control_metrics_update(uint16_t tip_temp, uint8_t on_periods, uint16_t target_temp) {
+	uint32_t tick = HAL_GetTick();
+
+	if (target_temp != active_target) {
+		if (active_target) {
+			run_finish();
+		}
+		if (target_temp) {
+			run_start(tick, tip_temp, target_temp);
+		}
+		active_target = target_temp;
+	}
+
+	if (!active_target || (tip_temp == ADC_READING_ERROR)) {
+		return;
+	}
+
+	// Half cycle period, limited so the first reading after an AC loss doesn't count the whole outage
+	uint32_t half_cycle_us = get_zc_period_us();
+	if (half_cycle_us > (AC_DETECTION_INTERVAL_MS * 1000)) {
+		half_cycle_us = AC_DETECTION_INTERVAL_MS * 1000;
+	}
+	run.energy_mj += on_periods * power_stats_get_full_power_w() * half_cycle_us / 1000;
+	if (on_periods >= cartridge_get_profile()->max_on_periods) {
+		run.full_power_ms += on_periods * half_cycle_us / 1000;
+	}
+	run.duration_ms = tick - start_tick;
+
+	int16_t error = (int16_t)(tip_temp - run.target_temp);
+	uint8_t reading_in_band = (error <= CONTROL_SETTLE_BAND) && (error >= -CONTROL_SETTLE_BAND);
+
+	switch (run.status) {
+		case CONTROL_RUN_RISING:
+		case CONTROL_RUN_SETTLING:
+			if ((error * step_direction) > run.overshoot) {
+				run.overshoot = error * step_direction;
+			}
+
+			if (!reading_in_band) {
+				break;
+			}
+			if (run.status == CONTROL_RUN_RISING) {
+				run.rise_time_ms = ms_saturate(tick - start_tick);
+				run.status = CONTROL_RUN_SETTLING;
+			}
+			if (!in_band) {
+				band_tick = tick;
+			} else if ((tick - band_tick) >= CONTROL_SETTLE_HOLD_MS) {
+				run.settling_time_ms = ms_saturate(band_tick - start_tick);
+				run.status = CONTROL_RUN_SETTLED;
+				ripple_min = tip_temp;
+				ripple_max = tip_temp;
+			}
+			break;
+
+		case CONTROL_RUN_SETTLED:
+			if (reading_in_band) {
+				if (!in_band) {
+					uint16_t recovery_time_ms = ms_saturate(tick - band_tick);
+					if (recovery_time_ms > run.recovery_time_ms) {
+						run.recovery_time_ms = recovery_time_ms;
+					}
+				}
+				if (tip_temp < ripple_min) {
+					ripple_min = tip_temp;
+				} else if (tip_temp > ripple_max) {
+					ripple_max = tip_temp;
+				}
+				run.ripple = ripple_max - ripple_min;
+			} else {
+				if (in_band) {
+					band_tick = tick;
+				}
+				if ((error < 0) && (-error > run.droop)) {
+					run.droop = -error;
+				}
+			}
+			break;
+
+		default:
+			break;
+	}
+	in_band = reading_in_band;
+}
+
+const control_run *control_metrics_get_run(void) {
+	return &run;
+}
+
+static void run_start(uint32_t tick, uint16_t tip_temp, uint16_t target_temp) {
+	run = (control_run){.start_temp = tip_temp, .target_temp = target_temp, .status = CONTROL_RUN_RISING};
+	start_tick = tick;
+	in_band = RESET;
+	step_direction = (target_temp >= tip_temp) ? 1 : -1;
+}
+
+// Store the run in control_log, it is also kept in run for the display until the next run starts
+static void run_finish(void) {
+	control_log.runs[control_log.head & (CONTROL_LOG_LENGTH - 1)] = run;
+	control_log.head++;
+}
+
+static uint16_t ms_saturate(uint32_t ms) {
+	return (ms > UINT16_MAX) ? UINT16_MAX : ms;
+}
@@ -23,19 +23,12 @@ void encoder_init(encoder *const self, TIM_TypeDef *timer) {
 uint8_t encoder_event(encoder *const self) {
 	uint32_t tmp_CNT = self->timer->CNT;
 	if (tmp_CNT != self->value) {
-		uint8_t overflow_state = encoder_overflow_check(self);
-		if (overflow_state == OVERFLOW) {
-			self->state = INCREASE;
-		} else if (overflow_state == UNDERFLOW) {
-			self->state = DECREASE;
-		} else {
-			if (tmp_CNT > self->value) {
-				self->state = INCREASE;
-			} else {
-				self->state = DECREASE;
-			}
-		}
-		self->delta = tmp_CNT - self->value;
+		// The unsigned difference is the signed step count, also across a counter wrap.
+		// Steps not yet read with get_encoder_delta() are kept, so no steps are lost between two reads
+		int32_t delta = (int32_t)(tmp_CNT - self->value);
+		encoder_overflow_check(self);
+		self->state = (delta > 0) ? INCREASE : DECREASE;
+		self->delta = self->flag ? (self->delta + delta) : delta;
 		self->value = tmp_CNT;
 		self->flag = SET;
 	} else {
@@ -0,0 +1,72 @@
+/*
+ * event_queue.c
+ *
+ * Lock-free single producer, single consumer event queue
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "event_queue.h"
+
+/******    File Scope Variables    ******/
+static event queue[EVENT_QUEUE_LENGTH];
+static volatile uint8_t queue_head = 0; // Next slot to write, only written by the producer
+static volatile uint8_t queue_tail = 0; // Next slot to read, only written by the consumer
+static uint16_t push_sequence = 0;
+static volatile uint16_t dropped_events = 0;
+static volatile uint16_t latched_levels[EVENT_TYPE_COUNT]; // Latest level of each level event type, only written by the producer
+static volatile uint8_t latched_types = 0;					// Bit per event type that has latched a level
+
+/******    Functions    ******/
+// Producer: copy the event into the queue and stamp it with the next sequence number
+uint8_t event_push(event *const self) {
+	self->sequence = push_sequence++;
+
+	// Latch level events before the full check, a dropped level can then be recovered with event_get_level()
+	if (self->type == EVENT_TIP_STATE) {
+		latched_levels[EVENT_TIP_STATE] = self->data.tip_state;
+		latched_types |= 1 << EVENT_TIP_STATE;
+	} else if (self->type == EVENT_AC_STATE) {
+		latched_levels[EVENT_AC_STATE] = self->data.ac_state;
+		latched_types |= 1 << EVENT_AC_STATE;
+	}
+
+	uint8_t head = queue_head;
+	if ((uint8_t)(head - queue_tail) >= EVENT_QUEUE_LENGTH) {
+		dropped_events++;
+		return RESET;
+	}
+
+	queue[head & (EVENT_QUEUE_LENGTH - 1)] = *self;
+	__DMB(); // The event must be written before the consumer can see the new head
+	queue_head = head + 1;
+	return SET;
+}
+
+// Consumer: copy the oldest event out of the queue, returns RESET if the queue is empty
+uint8_t event_pop(event *const self) {
+	uint8_t tail = queue_tail;
+	if (tail == queue_head) {
+		return RESET;
+	}
+
+	__DMB(); // Don't read the event before the head that published it
+	*self = queue[tail & (EVENT_QUEUE_LENGTH - 1)];
+	__DMB(); // The event must be copied before the producer can reuse the slot
+	queue_tail = tail + 1;
+	return SET;
+}
+
+// Consumer: latest level of a level event type, returns RESET if no event of the type has been pushed yet
+uint8_t event_get_level(uint8_t type, uint16_t *level) {
+	if (!(latched_types & (1 << type))) {
+		return RESET;
+	}
+	*level = latched_levels[type];
+	return SET;
+}
+
+uint16_t event_queue_get_dropped(void) {
+	return dropped_events;
+}
@@ -0,0 +1,53 @@
+/*
+ * fixed_point.c
+ *
+ * Fixed-point math helpers, so the firmware doesn't need soft-float on the Cortex-M0
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "fixed_point.h"
+
+/******    Constants    ******/
+enum sine_table_constants {
+	SINE_TABLE_STEP = 5, // Degrees between two table entries
+	SINE_TABLE_LENGTH = 90 / SINE_TABLE_STEP + 1
+};
+
+// First quadrant of sin() in Q15, the other quadrants are mirrored
+static const q15_t sine_table[SINE_TABLE_LENGTH] = {
+	0,	   2856,  5690,	 8481,	11207, 13848, 16383, 18794, 21062, 23170,
+	25101, 26841, 28377, 29697, 30791, 31650, 32269, 32642, 32767,
+};
+
+/******    Functions    ******/
+// sin() of an angle in whole degrees, interpolated between the table entries (max error ~0.1%)
+q15_t fixed_sin_deg(int32_t degrees) {
+	degrees %= 360;
+	if (degrees < 0) {
+		degrees += 360;
+	}
+
+	// Mirror into the first quadrant
+	uint8_t negative = (degrees >= 180);
+	if (negative) {
+		degrees -= 180;
+	}
+	if (degrees > 90) {
+		degrees = 180 - degrees;
+	}
+
+	uint8_t index = FIXED_DIV_CONST(degrees, SINE_TABLE_STEP);
+	q15_t value = sine_table[index];
+	uint8_t remainder = degrees - index * SINE_TABLE_STEP;
+	if (remainder) {
+		value = fixed_lerp(value, sine_table[index + 1], remainder * (Q15_ONE / SINE_TABLE_STEP));
+	}
+
+	return negative ? -value : value;
+}
+
+q15_t fixed_cos_deg(int32_t degrees) {
+	return fixed_sin_deg(degrees + 90);
+}
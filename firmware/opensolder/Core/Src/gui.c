@@ -8,8 +8,17 @@
  */
 
 #include "gui.h"
+#include "cartridge.h"
+#include "control_metrics.h"
+#include "invariant.h"
+#include "pct2075.h"
+#include "power_stats.h"
+#include "ram_monitor.h"
+#include "scheduler.h"
+#include "soft_timer.h"
 #include "ssd1306.h"
 #include "temperature.h"
+#include "trace.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -26,6 +35,11 @@ typedef struct {
 /******    Local Function Declarations    ******/
 static void draw_init_display(void);
 static void write_string(ssd1306_string string);
+static void flush_display(void);
+static void write_runtime_page(ssd1306_string line);
+static void write_memory_page(ssd1306_string line);
+static void write_control_page(ssd1306_string line);
+static void write_power_page(ssd1306_string line);
 
 /******    File Scope Variables    ******/
 enum display_constants {
@@ -88,6 +102,12 @@ enum display_constants {
 	MSG_TEXT_X = MSG_R_X1 + MSG_OFFSET,
 	MSG_TEXT_Y = MSG_R_Y1 + MSG_OFFSET + 1,
 	MSG_TEXT_MAX_LEN = (DISPLAY_WIDTH - 4 * MSG_OFFSET - 2) / 7,
+
+	// Debug screen text pos
+	DEBUG_TEXT_X = EDGE_OFFSET,
+	DEBUG_TEXT_Y = EDGE_OFFSET,
+	DEBUG_LINE_HEIGHT = 9,
+	DEBUG_TEXT_MAX_LEN = (DISPLAY_WIDTH - 2 * EDGE_OFFSET) / 6,
 };
 
 static ssd1306_string s_opensolder = {INIT_TEXT_X, INIT_TEXT_Y, &Font_11x18, White, "OpenSolder\0", 10};
@@ -101,6 +121,8 @@ static ssd1306_string tip_temp_val = {TIP_VAL_X, TIP_VAL_Y, &Font_11x18, White,
 
 static ssd1306_string power_bar_text = {PB_TEXT_X, PB_TEXT_Y, &Font_6x8, White, "\0", PB_TEXT_MAX_LEN};
 static ssd1306_string message_text = {MSG_TEXT_X, MSG_TEXT_Y, &Font_7x10, White, "\0", MSG_TEXT_MAX_LEN};
+static ssd1306_string debug_text = {DEBUG_TEXT_X, DEBUG_TEXT_Y, &Font_6x8, White, "\0", DEBUG_TEXT_MAX_LEN};
+static const char *const adc_profile_names[ADC_PROFILE_COUNT] = {[ADC_PROFILE_PRECISE] = "prec", [ADC_PROFILE_BALANCED] = "bal", [ADC_PROFILE_FAST] = "fast"};
 
 /******    Functions    ******/
 // Draw the default display image
@@ -119,12 +141,19 @@ void draw_init_display(void) {
 
 	// Read ambient temperature and concaternate to s_ambient.string
 	char s_buffer[STR_ARRAY_MAX_LEN];
-	snprintf(s_buffer, sizeof(s_buffer), "%d'C", read_pcb_temperature());
+	snprintf(s_buffer, sizeof(s_buffer), "%d'C", pct2075_get_temperature());
 	strcat(s_ambient.string, s_buffer);
 
 	write_string(s_firmware);
 	write_string(s_ambient);
+	flush_display();
+}
+
+// Send the framebuffer to the display
+static void flush_display(void) {
+	TRACE(TRACE_DISPLAY_BEGIN, 0);
 	ssd1306_UpdateScreen();
+	TRACE(TRACE_DISPLAY_END, 0);
 }
 
 void write_string(ssd1306_string string) {
@@ -152,33 +181,36 @@ void draw_default_display(void) {
 	write_string(set_temp_val);
 	write_string(tip_temp_text);
 	write_string(tip_temp_val);
-	ssd1306_UpdateScreen();
+	flush_display();
 }
 
 void update_display(void) {
-	static uint32_t display_update_tick = 0;
+	static soft_timer tip_temp_timer;
 	static uint16_t prev_tip_temp = 0;
 	static uint16_t power_bar_value = 0;
+	const station_snapshot *station = get_station_snapshot();
 
 	// Update set_temp
 	snprintf(set_temp_val.string, set_temp_val.length + 1, "%d'C", get_set_temp());
 	write_string(set_temp_val);
 
 	// Keep rapid changing elements like tip_temp from creating display jitter
-	if ((HAL_GetTick() > display_update_tick)
-			|| (get_tip_temp() < prev_tip_temp - 1)
-			|| (get_tip_temp() > prev_tip_temp + 1)) {
-		display_update_tick = HAL_GetTick() + DISPLAY_UPDATE_TICKS;
-		prev_tip_temp = get_tip_temp();
+	if (!soft_timer_running(&tip_temp_timer)
+			|| (station->tip_temp < prev_tip_temp - 1)
+			|| (station->tip_temp > prev_tip_temp + 1)) {
+		soft_timer_start(&tip_temp_timer, DISPLAY_UPDATE_TICKS);
+		prev_tip_temp = station->tip_temp;
 
-		snprintf(tip_temp_val.string, tip_temp_val.length + 1, "%d'C", get_tip_temp());
+		snprintf(tip_temp_val.string, tip_temp_val.length + 1, "%d'C", station->tip_temp);
 		write_string(tip_temp_val);
 
 		// Clear powerbar
 		ssd1306_DrawFilledRectangle(PB_R_X1 + 1, PB_R_Y1 + 1, PB_R_X2 - 1, PB_R_Y2 - 1, Black);
 
-		// Draw powerbar
-		power_bar_value = (uint16_t)get_power_bar_value() * (PB_R_X2 - PB_R_X1 - 1) / MAX_ON_PERIODS + PB_R_X1;
+		// Draw powerbar, full at the max heater half cycles of the cartridge profile
+		uint8_t max_on_periods = cartridge_get_profile()->max_on_periods;
+		uint8_t on_periods = (station->on_periods > max_on_periods) ? max_on_periods : station->on_periods;
+		power_bar_value = (uint16_t)on_periods * (PB_R_X2 - PB_R_X1 - 1) / max_on_periods + PB_R_X1;
 		ssd1306_DrawFilledRectangle(PB_R_X1, PB_R_Y1 + 1, power_bar_value, PB_R_Y2 - 1, White);
 	}
 
@@ -209,7 +241,154 @@ void update_display(void) {
 	// DEBUG END - display current state
 
 	// Update the display with the new values
-	ssd1306_UpdateScreen();
+	flush_display();
+}
+
+void draw_debug_display(uint8_t page) {
+	ssd1306_Fill(Black);
+	update_debug_display(page);
+}
+
+// Show diagnostics, one value per line
+void update_debug_display(uint8_t page) {
+	switch (page) {
+		case DEBUG_PAGE_RUNTIME:
+			write_runtime_page(debug_text);
+			break;
+		case DEBUG_PAGE_MEMORY:
+			write_memory_page(debug_text);
+			break;
+		case DEBUG_PAGE_CONTROL:
+			write_control_page(debug_text);
+			break;
+		case DEBUG_PAGE_POWER:
+			write_power_page(debug_text);
+			break;
+		default:
+			break;
+	}
+	flush_display();
+}
+
+static void write_runtime_page(ssd1306_string line) {
+	snprintf(line.string, line.length + 1, "CPU load:   %d%%", scheduler_get_cpu_load());
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "Ovr/lost/inv: %d/%d/%d", scheduler_get_overruns(), get_station_snapshot()->lost_events, invariant_get_violations());
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "ZC: %dus / %dus", get_zc_latency_max_us(), get_zc_period_us());
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "Settle:     %dus", get_settle_delay_us());
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "ADC %-4s noise: %d", adc_profile_names[get_adc_profile()], get_adc_noise());
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "VDDA:       %dmV", get_vdda_mv());
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "MCU/PCB:    %d/%d'C", get_mcu_temperature(), pct2075_get_temperature());
+	write_string(line);
+}
+
+static void write_memory_page(ssd1306_string line) {
+	snprintf(line.string, line.length + 1, "Stack:  %d/%dB", ram_monitor_get_stack_used(), ram_monitor_get_stack_size());
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "Static: %dB", ram_monitor_get_static_ram());
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "Heap:   %dB", ram_monitor_get_heap_used());
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "Free:   %dB", ram_monitor_get_free());
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "RamFunc: %dB", ram_monitor_get_ramfunc_size());
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "Timer ISR: %dns", get_isr_time_ns());
+	write_string(line);
+}
+
+static void write_control_page(ssd1306_string line) {
+	const control_run *run = control_metrics_get_run();
+
+	snprintf(line.string, line.length + 1, "Step: %d->%d'C", run->start_temp, run->target_temp);
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "Rise:   %dms", run->rise_time_ms);
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "Over:   %d'C", run->overshoot);
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "Settle: %dms", run->settling_time_ms);
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "Ripple: %d'C", run->ripple);
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "Load: -%d'C %dms", run->droop, run->recovery_time_ms);
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "%dJ full %dms", (int)(run->energy_mj / 1000), (int)run->full_power_ms);
+	write_string(line);
+}
+
+static void write_power_page(ssd1306_string line) {
+	const uint32_t *histogram = power_stats_get_histogram();
+	uint32_t total_s = 0;
+	for (uint8_t i = 0; i < POWER_HISTOGRAM_BINS; i++) {
+		total_s += histogram[i];
+	}
+
+	snprintf(line.string, line.length + 1, "Fired: %d/%d /s", power_stats_get_fired_per_s(), power_stats_get_half_cycles_per_s());
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "Duty: %d%% avg %d%%", power_stats_get_duty() / 10, power_stats_get_average_duty() / 10);
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "Power: %dW avg", power_stats_get_watts());
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "Peak: %dW/%dW", power_stats_get_peak_watts(), (int)power_stats_get_full_power_w());
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "Energy: %dJ", (int)power_stats_get_energy_j());
+	write_string(line);
+
+	// Share of the time at the highest duty of the cartridge, a tip that is always at full power is too small for the job
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "At max: %d%%", total_s ? (int)(histogram[POWER_HISTOGRAM_BINS - 1] * 100 / total_s) : 0);
+	write_string(line);
+
+	line.y += DEBUG_LINE_HEIGHT;
+	snprintf(line.string, line.length + 1, "Tip: %dmR %s%s", cartridge_get_resistance_mohm(), cartridge_get_profile()->name, cartridge_is_worn() ? " worn" : "");
+	write_string(line);
 }
 
 void display_message(uint16_t message_code) {
@@ -226,6 +405,9 @@ void display_message(uint16_t message_code) {
 		case OVERHEATING:
 			snprintf(message_text.string, message_text.length + 1, "! Overheating !");
 			break;
+		case MEASUREMENT_TIMEOUT:
+			snprintf(message_text.string, message_text.length + 1, "No temp reading");
+			break;
 		default:
 			snprintf(message_text.string, message_text.length + 1, "Unknown error");
 			break;
@@ -234,5 +416,5 @@ void display_message(uint16_t message_code) {
 	ssd1306_Fill(Black);
 	ssd1306_DrawRectangle(MSG_R_X1, MSG_R_Y1, MSG_R_X2, MSG_R_Y2, White);
 	write_string(message_text);
-	ssd1306_UpdateScreen();
+	flush_display();
 }
@@ -0,0 +1,35 @@
+/*
+ * invariant.c
+ *
+ * Runtime checks of properties that must always hold
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "invariant.h"
+#include "trace.h"
+
+/******    File Scope Variables    ******/
+static volatile uint16_t violations = 0;
+static volatile uint8_t last_violation = INVARIANT_NONE;
+
+/******    Functions    ******/
+#if INVARIANT_ENABLE
+void invariant_violation(uint8_t id) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	violations++;
+	last_violation = id;
+	__set_PRIMASK(primask);
+	TRACE(TRACE_INVARIANT, id);
+}
+#endif
+
+uint16_t invariant_get_violations(void) {
+	return violations;
+}
+
+uint8_t invariant_get_last(void) {
+	return last_violation;
+}
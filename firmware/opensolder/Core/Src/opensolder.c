@@ -15,18 +15,71 @@
  */
 
 #include "opensolder.h"
+#include "benchmark.h"
 #include "button.h"
+#include "control_metrics.h"
 #include "encoder.h"
+#include "event_queue.h"
 #include "gui.h"
+#include "invariant.h"
+#include "pct2075.h"
+#include "power_stats.h"
+#include "ram_monitor.h"
+#include "scheduler.h"
+#include "soft_timer.h"
+#include "timebase.h"
+#include "trace.h"
 #include "temperature.h"
 
 /******    Local Function Declarations    ******/
 static void state_machine(void);
+static void state_transition_to(uint8_t target);
+static void state_enter(uint8_t common_parent, uint8_t state);
+static uint8_t state_contains(uint8_t state, uint8_t child_state);
+static uint8_t state_active(uint8_t state);
+static uint8_t read_fault(void);
+static uint8_t always(void);
+static uint8_t fault_detected(void);
+static uint8_t fault_cleared(void);
+static uint8_t tip_inserted(void);
+static uint8_t tip_removed(void);
+static uint8_t tool_lifted(void);
+static uint8_t tool_in_holder(void);
+static uint8_t standby_expired(void);
+static void init_entry(void);
+static void tip_change_entry(void);
+static void tip_change_run(void);
+static void tip_change_exit(void);
+static void standby_entry(void);
+static void standby_exit(void);
+static void error_entry(void);
+static void error_run(void);
 static void init_mmi(void);
 static void read_mmi(void);
+static void read_events(void);
+static uint8_t sensor_release_delay(button *const sensor, soft_timer *const timer, uint8_t state, uint32_t delay_ms);
+static void read_pcb_temperature(void);
+static void update_screen(void);
+static void draw_screen(void);
 
 /******    File Scope Variables    ******/
-static uint8_t system_state;
+typedef struct {
+	uint8_t (*guard)(void); // Transition is taken when the guard returns SET
+	uint8_t target;
+} state_transition;
+
+typedef struct {
+	uint8_t parent; // NO_STATE for the top level states
+	void (*entry)(void);
+	void (*run)(void);
+	void (*exit)(void);
+	const state_transition *transitions; // Terminated by a NULL guard
+} state_table_entry;
+
+static uint8_t system_state = NO_STATE;
+static uint8_t station_fault = OFF; // AC_NOT_DETECTED, OVERHEATING or MEASUREMENT_TIMEOUT, read at the start of every state machine pass
+static uint32_t measurement_tick;	// Tick of the last temperature reading, or of AC coming back
+static uint16_t state_message;		// Message on the display, only redrawn when it changes
 
 static button tool_holder_sensor; // Detects when tool is placed in holder
 static button tip_change_sensor;  // Detects when tool touches the tip change bracket
@@ -37,16 +90,46 @@ static uint8_t tool_holder_state;
 static uint8_t tip_change_state;
 static uint8_t mmi_button_event;
 static uint8_t mmi_encoder_event;
+static uint8_t debug_page = DEBUG_PAGE_OFF;
+static uint32_t encoder_origin; // Encoder counter at init
+static uint32_t encoder_steps;	// Sum of all encoder deltas read since init
+
+static soft_timer standby_timer;	   // Time at standby temperature before turning the heater off
+static soft_timer tip_insert_timer;	   // Delay from a tip is detected until the heater may turn on
+static soft_timer standby_delay_timer; // Delay from the tool is lifted from the holder until standby ends
+static soft_timer tip_change_timer;	   // Delay from the tool leaves the tip change bracket
+
+static station_snapshot snapshot = {.tip_state = TIP_NOT_DETECTED, .ac_state = OFF, .sequence = UINT16_MAX}; // First event has sequence 0
+static volatile uint8_t sensor_scan_state = OFF; // Sensors are scanned from SysTick, enable when the objects are initialized
+
+// Tasks in priority order, highest first. The control task is also released by every temperature reading
+enum task_ids { CONTROL_TASK, INPUT_TASK, DISPLAY_TASK, PCB_TEMP_TASK, POWER_STATS_TASK, RAM_MONITOR_TASK, TASK_COUNT };
+static task tasks[TASK_COUNT] = {
+	[CONTROL_TASK] = {.run = state_machine, .period_ms = CONTROL_TASK_PERIOD_MS, .deadline_ms = CONTROL_TASK_PERIOD_MS},
+	[INPUT_TASK] = {.run = read_mmi, .period_ms = INPUT_TASK_PERIOD_MS, .deadline_ms = INPUT_TASK_PERIOD_MS},
+	[DISPLAY_TASK] = {.run = update_screen, .period_ms = DISPLAY_TASK_PERIOD_MS, .deadline_ms = DISPLAY_TASK_PERIOD_MS},
+	[PCB_TEMP_TASK] = {.run = read_pcb_temperature, .period_ms = PCB_TEMP_READ_INTERVAL_MS, .deadline_ms = PCB_TEMP_READ_INTERVAL_MS},
+	[POWER_STATS_TASK] = {.run = power_stats_update, .period_ms = POWER_STATS_PERIOD_MS, .deadline_ms = POWER_STATS_PERIOD_MS},
+	[RAM_MONITOR_TASK] = {.run = ram_monitor_scan, .period_ms = RAM_MONITOR_TASK_PERIOD_MS, .deadline_ms = RAM_MONITOR_TASK_PERIOD_MS},
+};
 
 /******    Init    ******/
 void opensolder_init(void) {
+	ram_monitor_init();
+	timebase_init(&htim14);
 	HAL_TIM_Encoder_Start(&htim2, TIM_CHANNEL_ALL);
 	HAL_I2C_Init(&hi2c1);
-	HAL_ADCEx_Calibration_Start(&hadc);
+	pct2075_init(&hi2c1, PCB_OVERHEAT_TEMP, PCB_OVERHEAT_HYST_TEMP);
+	adc_init();
 	HAL_Delay(50); // Wait for calibration to finish
 	init_mmi();
 	init_display(SPLASHSCREEN_TIMEOUT_MS);
-	system_state = INIT_STATE;
+#if BENCHMARK_ENABLE
+	benchmark_run();
+#endif
+	measurement_tick = HAL_GetTick();
+	state_transition_to(INIT_STATE);
+	scheduler_init(tasks, TASK_COUNT);
 }
 
 void init_mmi(void) {
@@ -54,114 +137,293 @@ void init_mmi(void) {
 	button_init(&tip_change_sensor, TIP_REMOVER_GPIO_Port, TIP_REMOVER_Pin, INVERTED);
 	button_init(&mmi_button, ENC_SW_GPIO_Port, ENC_SW_Pin, INVERTED);
 	encoder_init(&mmi_encoder, TIM2);
+	encoder_origin = get_encoder_value(&mmi_encoder);
+	sensor_scan_state = ON;
 }
 
 /******    Main    ******/
 void opensolder_main(void) {
-	read_mmi();
-	state_machine();
+	if (!scheduler_run()) {
+		scheduler_idle();
+	}
 }
 
 /******    State Machine    ******/
+/*
+ * Hierarchical state machine. Each state has a parent, and the composite states (RUN_STATE and
+ * TIP_PRESENT_STATE) are never active themselves. On every pass the transitions are checked from
+ * the outermost parent and inwards, so faults and tip removal take priority over the child states.
+ *
+ *   RUN_STATE            fault -> ERROR_STATE
+ *     INIT_STATE         -> TIP_CHANGE_STATE
+ *     TIP_CHANGE_STATE   tip detected for TIP_CHANGE_DELAY_MS -> OFF_STATE
+ *     TIP_PRESENT_STATE  tip removed or tip change -> TIP_CHANGE_STATE
+ *       OFF_STATE        tool lifted -> ON_STATE
+ *       ON_STATE         tool in holder -> STANDBY_STATE
+ *       STANDBY_STATE    tool lifted -> ON_STATE, standby time out -> OFF_STATE
+ *   ERROR_STATE          fault cleared -> INIT_STATE
+ *
+ * A transition runs the exit actions up to the first parent shared with the target, then the entry
+ * actions down to the target. Entry and exit actions run once, the run action on every pass.
+ */
+static const state_transition run_transitions[] = {
+	{fault_detected, ERROR_STATE},
+	{NULL, 0},
+};
+static const state_transition init_transitions[] = {
+	{always, TIP_CHANGE_STATE},
+	{NULL, 0},
+};
+static const state_transition tip_change_transitions[] = {
+	{tip_inserted, OFF_STATE},
+	{NULL, 0},
+};
+static const state_transition tip_present_transitions[] = {
+	{tip_removed, TIP_CHANGE_STATE},
+	{NULL, 0},
+};
+static const state_transition off_transitions[] = {
+	{tool_lifted, ON_STATE},
+	{NULL, 0},
+};
+static const state_transition on_transitions[] = {
+	{tool_in_holder, STANDBY_STATE},
+	{NULL, 0},
+};
+static const state_transition standby_transitions[] = {
+	{tool_lifted, ON_STATE},
+	{standby_expired, OFF_STATE},
+	{NULL, 0},
+};
+static const state_transition error_transitions[] = {
+	{fault_cleared, INIT_STATE},
+	{NULL, 0},
+};
+
+static const state_table_entry state_table[STATE_COUNT] = {
+	[RUN_STATE] = {.parent = NO_STATE, .transitions = run_transitions},
+	[INIT_STATE] = {.parent = RUN_STATE, .entry = init_entry, .transitions = init_transitions},
+	[TIP_CHANGE_STATE] = {.parent = RUN_STATE, .entry = tip_change_entry, .run = tip_change_run, .exit = tip_change_exit, .transitions = tip_change_transitions},
+	[TIP_PRESENT_STATE] = {.parent = RUN_STATE, .entry = draw_screen, .transitions = tip_present_transitions},
+	[OFF_STATE] = {.parent = TIP_PRESENT_STATE, .entry = heater_off, .transitions = off_transitions},
+	[ON_STATE] = {.parent = TIP_PRESENT_STATE, .transitions = on_transitions},
+	[STANDBY_STATE] = {.parent = TIP_PRESENT_STATE, .entry = standby_entry, .exit = standby_exit, .transitions = standby_transitions},
+	[ERROR_STATE] = {.parent = NO_STATE, .entry = error_entry, .run = error_run, .transitions = error_transitions},
+};
+
 static void state_machine(void) {
-	static uint32_t standby_timeout_tick_ms = 0;
-	static uint32_t tip_insert_delay_tick_ms = 0;
-	uint8_t tool_tip_state = get_tip_state();
-
-	if (HAL_GetTick() > get_ac_delay_tick()) {
-		error_handler();
-		display_message(AC_NOT_DETECTED);
-		system_state = ERROR_STATE;
+	read_events();
+	station_fault = read_fault();
+
+	// List the active state and its parents, outermost first
+	uint8_t path[STATE_DEPTH_MAX];
+	uint8_t depth = 0;
+	for (uint8_t state = system_state; (state != NO_STATE) && (depth < STATE_DEPTH_MAX); state = state_table[state].parent) {
+		depth++;
+	}
+	uint8_t state = system_state;
+	for (uint8_t i = depth; i > 0; i--) {
+		path[i - 1] = state;
+		state = state_table[state].parent;
+	}
+
+	// First transition with a true guard is taken, only one transition per pass
+	for (uint8_t i = 0; i < depth; i++) {
+		for (const state_transition *transition = state_table[path[i]].transitions; transition->guard != NULL; transition++) {
+			if (transition->guard()) {
+				state_transition_to(transition->target);
+				return;
+			}
+		}
+	}
+
+	for (uint8_t i = 0; i < depth; i++) {
+		if (state_table[path[i]].run != NULL) {
+			state_table[path[i]].run();
+		}
+	}
+}
+
+static void state_transition_to(uint8_t target) {
+	// Both states fit in one trace data byte, previous state in the upper nibble
+	TRACE(TRACE_STATE, (system_state << 4) | target);
+
+	INVARIANT((target < STATE_COUNT) && (target != TIP_PRESENT_STATE) && (target != RUN_STATE), INVARIANT_STATE);
+
+	// Exit up to the first state that also contains the target
+	uint8_t state = system_state;
+	while ((state != NO_STATE) && !state_contains(state, target)) {
+		TRACE(TRACE_STATE_EXIT, state);
+		if (state_table[state].exit != NULL) {
+			state_table[state].exit();
+		}
+		state = state_table[state].parent;
+	}
+
+	// The new state is set before the entry actions, so adc_process() can't run power_control()
+	// for the old state after an entry action has turned the heater off
+	system_state = target;
+	state_enter(state, target);
+}
+
+// Run the entry actions from below common_parent and down to state, outermost first
+static void state_enter(uint8_t common_parent, uint8_t state) {
+	if ((state == common_parent) || (state == NO_STATE)) {
 		return;
 	}
+	state_enter(common_parent, state_table[state].parent);
+	TRACE(TRACE_STATE_ENTRY, state);
+	if (state_table[state].entry != NULL) {
+		state_table[state].entry();
+	}
+}
+
+// Returns SET if state is child_state, or one of its parents
+static uint8_t state_contains(uint8_t state, uint8_t child_state) {
+	for (; child_state != NO_STATE; child_state = state_table[child_state].parent) {
+		if (child_state == state) {
+			return SET;
+		}
+	}
+	return RESET;
+}
 
-	switch (system_state) {
-		case INIT_STATE:
-			heater_off();
-			draw_default_display();
-			system_state = TIP_CHANGE_STATE;
-			break;
+// Returns SET if state is the active state, or a parent of the active state
+static uint8_t state_active(uint8_t state) {
+	return state_contains(state, system_state);
+}
 
-		case TIP_CHANGE_STATE: {
-			heater_off();
+static uint8_t read_fault(void) {
+	if (snapshot.ac_state == OFF) {
+		return AC_NOT_DETECTED;
+	}
+	if (get_overheat_state()) {
+		return OVERHEATING;
+	}
+	if ((HAL_GetTick() - measurement_tick) > MEASUREMENT_TIMEOUT_MS) {
+		return MEASUREMENT_TIMEOUT;
+	}
+	return OFF;
+}
 
-			if (tool_tip_state != TIP_DETECTED) {
-				tip_insert_delay_tick_ms = HAL_GetTick() + TIP_CHANGE_DELAY_MS;
-				display_message(tool_tip_state);
-			} else if ((tool_tip_state == TIP_DETECTED) && (HAL_GetTick() > tip_insert_delay_tick_ms) && !tip_change_state) {
-				draw_default_display();
-				system_state = OFF_STATE;
-			}
-		} break;
+/******    State Guards    ******/
+static uint8_t always(void) {
+	return SET;
+}
 
-		case OFF_STATE:
-			heater_off();
+static uint8_t fault_detected(void) {
+	return station_fault != OFF;
+}
 
-			if (tip_change_state || (tool_tip_state != TIP_DETECTED)) {
-				system_state = TIP_CHANGE_STATE;
-			} else if (!tool_holder_state) {
-				system_state = ON_STATE;
-			}
-			update_display();
-			break;
-
-		case ON_STATE:
-			if (tip_change_state || (tool_tip_state != TIP_DETECTED)) {
-				system_state = TIP_CHANGE_STATE;
-			} else if (tool_holder_state) {
-				standby_timeout_tick_ms = HAL_GetTick() + (STANDBY_TIME_S * 1000);
-				system_state = STANDBY_STATE;
-			}
-			update_display();
-			break;
-
-		case STANDBY_STATE:
-			if (tip_change_state || (tool_tip_state != TIP_DETECTED)) {
-				system_state = TIP_CHANGE_STATE;
-			} else if (!tool_holder_state) {
-				system_state = ON_STATE;
-			} else if (HAL_GetTick() > standby_timeout_tick_ms) {
-				system_state = OFF_STATE;
-			}
-			update_display();
-			break;
+static uint8_t fault_cleared(void) {
+	return station_fault == OFF;
+}
+
+static uint8_t tip_inserted(void) {
+	return (snapshot.tip_state == TIP_DETECTED) && soft_timer_expired(&tip_insert_timer) && !tip_change_state;
+}
+
+static uint8_t tip_removed(void) {
+	return tip_change_state || (snapshot.tip_state != TIP_DETECTED);
+}
+
+static uint8_t tool_lifted(void) {
+	return !tool_holder_state;
+}
+
+static uint8_t tool_in_holder(void) {
+	return tool_holder_state;
+}
+
+static uint8_t standby_expired(void) {
+	return soft_timer_expired(&standby_timer);
+}
+
+/******    State Actions    ******/
+static void init_entry(void) {
+	heater_off();
+	draw_default_display();
+}
 
-		case ERROR_STATE:
-			error_handler();
-			system_state = INIT_STATE;
-			break;
+static void tip_change_entry(void) {
+	heater_off();
+	tip_check_request();
+	soft_timer_stop(&tip_insert_timer);
+	state_message = OFF;
+}
 
-		default:
-			system_state = ERROR_STATE;
-			break;
+// The tip must be detected for TIP_CHANGE_DELAY_MS before leaving, the message is only drawn when it changes
+static void tip_change_run(void) {
+	if (snapshot.tip_state != TIP_DETECTED) {
+		soft_timer_stop(&tip_insert_timer);
+		if (state_message != snapshot.tip_state) {
+			state_message = snapshot.tip_state;
+			display_message(state_message);
+		}
+	} else if (!soft_timer_running(&tip_insert_timer) && !soft_timer_expired(&tip_insert_timer)) {
+		soft_timer_start(&tip_insert_timer, TIP_CHANGE_DELAY_MS);
+	}
+}
+
+static void tip_change_exit(void) {
+	soft_timer_stop(&tip_insert_timer);
+}
+
+static void standby_entry(void) {
+	soft_timer_start(&standby_timer, STANDBY_TIME_S * 1000);
+}
+
+static void standby_exit(void) {
+	soft_timer_stop(&standby_timer);
+}
+
+// The zero cross ISR can't switch the heater without AC, and the heater ISR checks the overheat flag, so no hard off is needed
+static void error_entry(void) {
+	heater_off();
+	state_message = station_fault;
+	display_message(state_message);
+}
+
+static void error_run(void) {
+	if (state_message != station_fault) {
+		state_message = station_fault;
+		display_message(state_message);
 	}
 }
 
 /******    Other Functions   ******/
 void read_mmi(void) {
-	mmi_button_event = button_event(&mmi_button);
+	read_events();
 	mmi_encoder_event = encoder_event(&mmi_encoder);
 
-	static uint32_t standby_delay_tick_ms = 0;
-	static uint32_t tip_change_delay_tick_ms = 0;
+	tool_holder_state = sensor_release_delay(&tool_holder_sensor, &standby_delay_timer, tool_holder_state, STANDBY_DELAY_MS);
+	tip_change_state = sensor_release_delay(&tip_change_sensor, &tip_change_timer, tip_change_state, TIP_CHANGE_DELAY_MS);
 
-	if (button_state(&tool_holder_sensor)) {
-		tool_holder_state = SET;
-		standby_delay_tick_ms = HAL_GetTick() + STANDBY_DELAY_MS;
-	} else if (HAL_GetTick() > standby_delay_tick_ms) {
-		tool_holder_state = RESET;
+	// Short press steps through the debug pages, and back to the default display
+	if (mmi_button_event == SHORT_PRESS) {
+		debug_page = (debug_page + 1) % DEBUG_PAGE_COUNT;
+		if (state_active(TIP_PRESENT_STATE)) {
+			draw_screen();
+		}
 	}
 
-	if (button_state(&tip_change_sensor)) {
-		tip_change_state = SET;
-		tip_change_delay_tick_ms = HAL_GetTick() + TIP_CHANGE_DELAY_MS;
-	} else if (HAL_GetTick() > tip_change_delay_tick_ms) {
-		tip_change_state = RESET;
+	// Long press on the runtime page selects the next ADC measurement profile, to compare the noise.
+	// Elsewhere it starts a thermocouple settle time calibration (runs on the next heated half cycle)
+	if ((mmi_button_event == LONG_PRESS) && (debug_page == DEBUG_PAGE_RUNTIME)) {
+		set_adc_profile((get_adc_profile() + 1) % ADC_PROFILE_COUNT);
+	} else if (mmi_button_event == LONG_PRESS) {
+		settle_calibration_request();
 	}
+	mmi_button_event = NO_PRESS;
 
 	if (mmi_encoder_event != NO_CHANGE) {
-		int16_t new_temp = get_set_temp();
-		new_temp += (TEMP_STEPS * get_encoder_delta(&mmi_encoder));
+		// 32 bit, a large encoder delta can't wrap the temperature before it is limited
+		int32_t new_temp = get_set_temp();
+		int32_t encoder_delta = get_encoder_delta(&mmi_encoder);
+		new_temp += (TEMP_STEPS * encoder_delta);
+
+		encoder_steps += encoder_delta;
+		INVARIANT((get_encoder_value(&mmi_encoder) - encoder_origin) == encoder_steps, INVARIANT_ENCODER_DELTA);
 
 		if (new_temp > MAX_TEMP) {
 			new_temp = MAX_TEMP;
@@ -173,12 +435,115 @@ void read_mmi(void) {
 	}
 }
 
+// Returns SET while the sensor is active, and for delay_ms after it is released. The timer is only started on release
+static uint8_t sensor_release_delay(button *const sensor, soft_timer *const timer, uint8_t state, uint32_t delay_ms) {
+	if (button_state(sensor)) {
+		soft_timer_stop(timer);
+		return SET;
+	}
+
+	if (soft_timer_expired(timer)) {
+		soft_timer_stop(timer);
+		return RESET;
+	}
+
+	if (state && !soft_timer_running(timer)) {
+		soft_timer_start(timer, delay_ms);
+	}
+	return state;
+}
+
+static void read_pcb_temperature(void) {
+	pct2075_read_start();
+}
+
+static void update_screen(void) {
+	// Messages and state changes are drawn by the state machine, only refresh the default display here
+	if (state_active(TIP_PRESENT_STATE)) {
+		if (debug_page != DEBUG_PAGE_OFF) {
+			update_debug_display(debug_page);
+		} else {
+			update_display();
+		}
+	}
+}
+
+static void draw_screen(void) {
+	if (debug_page != DEBUG_PAGE_OFF) {
+		draw_debug_display(debug_page);
+	} else {
+		draw_default_display();
+	}
+}
+
+// Update the snapshot with all pending events. Must only be called from the main loop (the queue consumer)
+static void read_events(void) {
+	event new_event;
+
+	while (event_pop(&new_event)) {
+		INVARIANT((int16_t)(new_event.sequence - snapshot.sequence) > 0, INVARIANT_EVENT_SEQUENCE);
+		snapshot.lost_events += (uint16_t)(new_event.sequence - snapshot.sequence - 1);
+		snapshot.sequence = new_event.sequence;
+
+		switch (new_event.type) {
+			case EVENT_MEASUREMENT:
+				snapshot.tip_temp = new_event.data.measurement.tip_temp;
+				snapshot.on_periods = new_event.data.measurement.on_periods;
+				measurement_tick = HAL_GetTick();
+				control_metrics_update(snapshot.tip_temp, snapshot.on_periods, get_target_temp());
+				break;
+			case EVENT_TIP_STATE:
+				snapshot.tip_state = new_event.data.tip_state;
+				break;
+			case EVENT_AC_STATE:
+				snapshot.ac_state = new_event.data.ac_state;
+				measurement_tick = HAL_GetTick(); // Readings start again with the zero cross interrupts
+				break;
+			case EVENT_BUTTON:
+				mmi_button_event = new_event.data.button;
+				break;
+			default:
+				break;
+		}
+	}
+
+	// Level events lost on a full queue are recovered from the latched levels
+	uint16_t level;
+	if (event_get_level(EVENT_TIP_STATE, &level)) {
+		snapshot.tip_state = level;
+	}
+	if (event_get_level(EVENT_AC_STATE, &level) && (level != snapshot.ac_state)) {
+		snapshot.ac_state = level;
+		measurement_tick = HAL_GetTick();
+	}
+}
+
+// Called from adc_process() when a new temperature reading is available
+void measurement_complete(void) {
+	task_signal(&tasks[CONTROL_TASK]);
+}
+
+// Called from the SysTick callback every SENSOR_SCAN_INTERVAL_MS, front button releases are published as events
 void sensor_scan(void) {
+	if (sensor_scan_state == OFF) {
+		return;
+	}
+
 	button_scan(&tool_holder_sensor);
 	button_scan(&tip_change_sensor);
 	button_scan(&mmi_button);
+
+	uint8_t press = button_event(&mmi_button);
+	if (press != NO_PRESS) {
+		event button_release = {.type = EVENT_BUTTON, .data.button = press};
+		event_push(&button_release);
+	}
 }
 
 uint8_t get_system_state(void) {
 	return system_state;
 }
+
+const station_snapshot *get_station_snapshot(void) {
+	return &snapshot;
+}
@@ -0,0 +1,69 @@
+/*
+ * pct2075.c
+ *
+ * Non-blocking driver for the PCT2075 I2C temperature sensor
+ *
+ * The temperature register is read with HAL_I2C_Mem_Read_IT(), and parsed in
+ * HAL_I2C_MemRxCpltCallback(). The OS (over-temperature shutdown) output is set up in
+ * comparator mode: it goes low above os_temp, and is released below hyst_temp.
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "pct2075.h"
+
+/******    Local Function Declarations    ******/
+static int16_t register_to_temperature(const uint8_t *buffer);
+
+/******    File Scope Variables    ******/
+static I2C_HandleTypeDef *pct2075_hi2c;
+static uint8_t rx_buffer[2];
+static volatile int16_t temperature = PCT2075_READ_ERROR;
+
+/******    Functions    ******/
+void pct2075_init(I2C_HandleTypeDef *hi2c, int8_t os_temp, int8_t hyst_temp) {
+	pct2075_hi2c = hi2c;
+
+	// Tos and Thyst are 9 bit left aligned registers with 0.5C resolution, whole degrees go in the MSB
+	uint8_t config = PCT2075_CONF_OS_QUEUE_2;
+	uint8_t os_register[2] = {(uint8_t)os_temp, 0};
+	uint8_t hyst_register[2] = {(uint8_t)hyst_temp, 0};
+	HAL_I2C_Mem_Write(hi2c, PCT2075_I2C_ADDR, PCT2075_CONF_REG, I2C_MEMADD_SIZE_8BIT, &config, 1, PCT2075_TIMEOUT_MS);
+	HAL_I2C_Mem_Write(hi2c, PCT2075_I2C_ADDR, PCT2075_HYST_REG, I2C_MEMADD_SIZE_8BIT, hyst_register, 2, PCT2075_TIMEOUT_MS);
+	HAL_I2C_Mem_Write(hi2c, PCT2075_I2C_ADDR, PCT2075_OS_REG, I2C_MEMADD_SIZE_8BIT, os_register, 2, PCT2075_TIMEOUT_MS);
+
+	// First reading is blocking, so the value is available for the splash screen
+	if (HAL_I2C_Mem_Read(hi2c, PCT2075_I2C_ADDR, PCT2075_TEMP_REG, I2C_MEMADD_SIZE_8BIT, rx_buffer, 2, PCT2075_TIMEOUT_MS) == HAL_OK) {
+		temperature = register_to_temperature(rx_buffer);
+	}
+}
+
+void pct2075_read_start(void) {
+	// Skip this reading if the previous transfer is still ongoing
+	if (HAL_I2C_GetState(pct2075_hi2c) == HAL_I2C_STATE_READY) {
+		HAL_I2C_Mem_Read_IT(pct2075_hi2c, PCT2075_I2C_ADDR, PCT2075_TEMP_REG, I2C_MEMADD_SIZE_8BIT, rx_buffer, 2);
+	}
+}
+
+int16_t pct2075_get_temperature(void) {
+	return temperature;
+}
+
+static int16_t register_to_temperature(const uint8_t *buffer) {
+	// 11 bit signed (2s compl.) left aligned value with 0.125C resolution, the MSB holds the whole degrees
+	return (int16_t)((buffer[0] << 8) | buffer[1]) >> 8;
+}
+
+/******    Callback Functions    ******/
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c) {
+	if (hi2c == pct2075_hi2c) {
+		temperature = register_to_temperature(rx_buffer);
+	}
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) {
+	if (hi2c == pct2075_hi2c) {
+		temperature = PCT2075_READ_ERROR;
+	}
+}
@@ -0,0 +1,124 @@
+/*
+ * power_stats.c
+ *
+ * Heater energy and duty accounting
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "power_stats.h"
+#include "cartridge.h"
+#include "opensolder.h"
+
+/******    Global Variables    ******/
+power_counters power_stats_counters;
+
+/******    File Scope Variables    ******/
+static uint32_t last_half_cycles;
+static uint32_t last_fired;
+static uint32_t last_tick;
+static uint16_t half_cycles_per_s;
+static uint16_t fired_per_s;
+static uint16_t duty;			  // 0.1%
+static int32_t average_duty_q8;	  // 0.1%, 8 fractional bits
+static uint16_t watts;
+static uint16_t peak_watts;
+static uint32_t energy_mj;		  // Below one joule, carried to energy_j
+static uint32_t energy_j;
+static uint32_t histogram_ms[POWER_HISTOGRAM_BINS];
+static uint32_t histogram_s[POWER_HISTOGRAM_BINS];
+
+/******    Functions    ******/
+void power_stats_update(void) {
+	uint32_t tick = HAL_GetTick();
+
+	// Both counters are read together, so fired can't be ahead of half_cycles
+	__disable_irq();
+	uint32_t half_cycles = power_stats_counters.half_cycles;
+	uint32_t fired = power_stats_counters.fired;
+	__enable_irq();
+
+	uint32_t period_ms = tick - last_tick;
+	uint32_t half_cycle_delta = half_cycles - last_half_cycles;
+	uint32_t fired_delta = fired - last_fired;
+	last_tick = tick;
+	last_half_cycles = half_cycles;
+	last_fired = fired;
+
+	if (period_ms == 0) {
+		return;
+	}
+
+	half_cycles_per_s = half_cycle_delta * 1000 / period_ms;
+	fired_per_s = fired_delta * 1000 / period_ms;
+	duty = half_cycle_delta ? (fired_delta * 1000 / half_cycle_delta) : 0;
+	average_duty_q8 += (((int32_t)duty << 8) - average_duty_q8) >> POWER_AVERAGE_SHIFT;
+
+	uint32_t period_watts = power_stats_get_full_power_w() * duty / 1000;
+	watts = power_stats_get_full_power_w() * power_stats_get_average_duty() / 1000;
+	if (period_watts > peak_watts) {
+		peak_watts = period_watts;
+	}
+
+	energy_mj += period_watts * period_ms;
+	energy_j += energy_mj / 1000;
+	energy_mj %= 1000;
+
+	// Time is kept in ms per bin, and carried over to whole seconds. A period at the highest duty can count
+	// one half cycle less, rounding keeps it in the last bin
+	uint16_t max_duty = power_stats_get_max_duty();
+	uint8_t bin = ((uint32_t)duty * (POWER_HISTOGRAM_BINS - 1) + max_duty / 2) / max_duty;
+	if (bin >= POWER_HISTOGRAM_BINS) {
+		bin = POWER_HISTOGRAM_BINS - 1;
+	}
+	histogram_ms[bin] += period_ms;
+	histogram_s[bin] += histogram_ms[bin] / 1000;
+	histogram_ms[bin] %= 1000;
+}
+
+uint16_t power_stats_get_half_cycles_per_s(void) {
+	return half_cycles_per_s;
+}
+
+uint16_t power_stats_get_fired_per_s(void) {
+	return fired_per_s;
+}
+
+uint16_t power_stats_get_duty(void) {
+	return duty;
+}
+
+uint16_t power_stats_get_average_duty(void) {
+	return average_duty_q8 >> 8;
+}
+
+uint16_t power_stats_get_watts(void) {
+	return watts;
+}
+
+uint16_t power_stats_get_peak_watts(void) {
+	return peak_watts;
+}
+
+uint32_t power_stats_get_energy_j(void) {
+	return energy_j;
+}
+
+// V^2 / R, with the voltage in mV and the resistance in mOhm. Uses the measured tip resistance once the tip is classified
+uint32_t power_stats_get_full_power_w(void) {
+	uint32_t resistance_mohm = TIP_RESISTANCE_MOHM;
+	if (cartridge_get_family() != CARTRIDGE_UNKNOWN) {
+		resistance_mohm = cartridge_get_resistance_mohm();
+	}
+	return (uint32_t)HEATER_SUPPLY_MV * HEATER_SUPPLY_MV / resistance_mohm / 1000;
+}
+
+uint16_t power_stats_get_max_duty(void) {
+	uint8_t max_on_periods = cartridge_get_profile()->max_on_periods;
+	return max_on_periods * 1000 / (max_on_periods + 1);
+}
+
+const uint32_t *power_stats_get_histogram(void) {
+	return histogram_s;
+}
@@ -0,0 +1,75 @@
+/*
+ * ram_monitor.c
+ *
+ * Stack high-water mark and RAM usage
+ *
+ * RAM layout (see STM32F072CBTX_FLASH.ld):
+ * | stack (_sstack - _estack) | .data (incl. RAM functions) | .bss | heap (_end - sbrk end) | free | _eram
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "ram_monitor.h"
+#include <stddef.h>
+
+/******    Linker Symbols    ******/
+extern uint32_t _sstack;
+extern uint32_t _estack;
+extern uint8_t _sdata;
+extern uint8_t _ebss;
+extern uint8_t _end;
+extern uint8_t _eram;
+extern uint8_t _sramfunc;
+extern uint8_t _eramfunc;
+extern void *_sbrk(ptrdiff_t incr);
+
+/******    File Scope Variables    ******/
+static uint16_t stack_used = 0;
+static uint16_t heap_used = 0;
+
+/******    Functions    ******/
+void ram_monitor_init(void) {
+	// Paint from the bottom of the stack up to just below the frames in use
+	uint32_t *stack_pointer = (uint32_t *)__get_MSP() - STACK_PAINT_MARGIN;
+	for (uint32_t *word = &_sstack; word < stack_pointer; word++) {
+		*word = STACK_PAINT;
+	}
+	ram_monitor_scan();
+}
+
+void ram_monitor_scan(void) {
+	// The stack grows down, so the first overwritten word from the bottom is the deepest point reached
+	const uint32_t *word = &_sstack;
+	while ((word < &_estack) && (*word == STACK_PAINT)) {
+		word++;
+	}
+	stack_used = (uint8_t *)&_estack - (uint8_t *)word;
+
+	// _sbrk(0) returns the current end of the heap without allocating
+	heap_used = (uint8_t *)_sbrk(0) - &_end;
+}
+
+uint16_t ram_monitor_get_stack_size(void) {
+	return (uint8_t *)&_estack - (uint8_t *)&_sstack;
+}
+
+uint16_t ram_monitor_get_stack_used(void) {
+	return stack_used;
+}
+
+uint16_t ram_monitor_get_static_ram(void) {
+	return &_ebss - &_sdata;
+}
+
+uint16_t ram_monitor_get_ramfunc_size(void) {
+	return &_eramfunc - &_sramfunc;
+}
+
+uint16_t ram_monitor_get_heap_used(void) {
+	return heap_used;
+}
+
+uint16_t ram_monitor_get_free(void) {
+	return &_eram - &_end - heap_used;
+}
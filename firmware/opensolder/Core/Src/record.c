@@ -0,0 +1,40 @@
+/*
+ * record.c
+ *
+ * Recording of the raw thermocouple readings and control decisions in a RAM ring buffer
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "record.h"
+
+#if RECORD_ENABLE
+/******    Global Variables    ******/
+record_buffer record_log = {.magic = RECORD_MAGIC};
+
+/******    Functions    ******/
+// Called from adc_process() with the thermocouple samples of the reading
+void record_reading(const uint16_t *buffer, uint8_t sample_count, uint32_t zc_us, uint16_t tip_temp, uint8_t on_periods, uint8_t tip_state, uint8_t tip_check) {
+	record_entry *const entry = &record_log.entries[record_log.head & (RECORD_LENGTH - 1)];
+
+	entry->zc_us = zc_us;
+	entry->tip_temp = tip_temp;
+	entry->encoder = TIM2->CNT;
+	entry->sample_count = sample_count;
+	entry->on_periods = on_periods;
+	entry->tip_state = tip_state;
+	entry->flags = tip_check ? RECORD_FLAG_TIP_CHECK : 0;
+	entry->flags |= (STAND_GPIO_Port->IDR & STAND_Pin) ? RECORD_FLAG_HOLDER : 0;
+	entry->flags |= (TIP_REMOVER_GPIO_Port->IDR & TIP_REMOVER_Pin) ? RECORD_FLAG_TIP_CHANGE : 0;
+	entry->flags |= (ENC_SW_GPIO_Port->IDR & ENC_SW_Pin) ? RECORD_FLAG_BUTTON : 0;
+
+	for (uint8_t i = 0; i < sample_count; i++) {
+		entry->samples[i] = buffer[i];
+	}
+
+	// The entry is complete before head moves, a dump taken while running sees whole records
+	__DMB();
+	record_log.head++;
+}
+#endif
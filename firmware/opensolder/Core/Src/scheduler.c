@@ -0,0 +1,136 @@
+/*
+ * scheduler.c
+ *
+ * Cooperative run-to-completion task scheduler for embedded systems
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "scheduler.h"
+#include "timebase.h"
+
+/******    Local Function Declarations    ******/
+static void cpu_load_update(uint32_t time_us);
+
+/******    File Scope Variables    ******/
+static task *task_list;
+static uint8_t task_list_count;
+
+static uint32_t idle_us;		  // Time spent in WFI during the current load window
+static uint32_t window_start_us; // Start of the current load window
+static uint8_t cpu_load = 100;	  // CPU load of the last completed window in %
+
+/******    Functions    ******/
+void scheduler_init(task *tasks, uint8_t task_count) {
+	task_list = tasks;
+	task_list_count = task_count;
+
+	uint32_t tick = HAL_GetTick();
+	for (uint8_t i = 0; i < task_count; i++) {
+		tasks[i].release_tick = tick;
+		tasks[i].event_flag = RESET;
+		tasks[i].overruns = 0;
+		tasks[i].max_response_ms = 0;
+	}
+
+	window_start_us = timebase_get_us();
+	idle_us = 0;
+}
+
+// Run the highest priority ready task. Returns SET if a task was run, RESET if all tasks are idle
+uint8_t scheduler_run(void) {
+	uint32_t tick = HAL_GetTick();
+
+	for (uint8_t i = 0; i < task_list_count; i++) {
+		task *const self = &task_list[i];
+		uint32_t release_tick;
+
+		if (self->event_flag) {
+			self->event_flag = RESET;
+			release_tick = self->event_tick;
+		} else if (self->period_ms && ((tick - self->release_tick) >= self->period_ms)) {
+			release_tick = self->release_tick + self->period_ms;
+
+			// Count missed periodic releases as overruns, and restart the period from now
+			if ((tick - release_tick) >= self->period_ms) {
+				self->overruns++;
+				release_tick = tick;
+			}
+			self->release_tick = release_tick;
+		} else {
+			continue;
+		}
+
+		self->run();
+
+		__disable_irq();
+		cpu_load_update(timebase_get_us());
+		__enable_irq();
+
+		uint32_t response_ms = HAL_GetTick() - release_tick;
+		if (response_ms > self->max_response_ms) {
+			self->max_response_ms = response_ms;
+		}
+		if (response_ms > self->deadline_ms) {
+			self->overruns++;
+		}
+		return SET;
+	}
+	return RESET;
+}
+
+// Sleep until the next interrupt, if no task was signalled since the last call to scheduler_run()
+void scheduler_idle(void) {
+	// Interrupts are masked so a task_signal() from an ISR can't slip in between the check and WFI.
+	// A pending interrupt still wakes the core from WFI, and is serviced when interrupts are enabled again.
+	__disable_irq();
+	uint32_t sleep_us = timebase_get_us();
+	uint8_t signalled = RESET;
+
+	for (uint8_t i = 0; i < task_list_count; i++) {
+		if (task_list[i].event_flag) {
+			signalled = SET;
+		}
+	}
+
+	if (!signalled) {
+		__WFI();
+	}
+
+	uint32_t wake_us = timebase_get_us();
+	idle_us += wake_us - sleep_us;
+	cpu_load_update(wake_us);
+	__enable_irq();
+}
+
+void task_signal(task *const self) {
+	self->event_tick = HAL_GetTick();
+	self->event_flag = SET;
+}
+
+uint16_t scheduler_get_overruns(void) {
+	uint16_t overruns = 0;
+	for (uint8_t i = 0; i < task_list_count; i++) {
+		overruns += task_list[i].overruns;
+	}
+	return overruns;
+}
+
+uint8_t scheduler_get_cpu_load(void) {
+	return cpu_load;
+}
+
+// Close the load window every CPU_LOAD_WINDOW_MS. Must be called with interrupts disabled.
+static void cpu_load_update(uint32_t time_us) {
+	uint32_t window_us = time_us - window_start_us;
+	if (window_us < (CPU_LOAD_WINDOW_MS * 1000UL)) {
+		return;
+	}
+
+	uint32_t idle_percent = idle_us / (window_us / 100);
+	cpu_load = (idle_percent >= 100) ? 0 : 100 - idle_percent;
+
+	window_start_us = time_us;
+	idle_us = 0;
+}
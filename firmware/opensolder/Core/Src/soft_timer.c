@@ -0,0 +1,95 @@
+/*
+ * soft_timer.c
+ *
+ * Timer wheel for millisecond software timers
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "soft_timer.h"
+
+/******    Local Function Declarations    ******/
+static void wheel_insert(soft_timer *const self);
+static void wheel_remove(soft_timer *const self);
+
+/******    File Scope Variables    ******/
+static soft_timer *wheel[SOFT_TIMER_WHEEL_SLOTS];
+static volatile uint32_t wheel_tick = 0; // Last tick processed by soft_timer_tick()
+
+/******    Functions    ******/
+void soft_timer_start(soft_timer *const self, uint32_t delay_ms) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (self->state == SOFT_TIMER_RUNNING) {
+		wheel_remove(self);
+	}
+
+	// The slot of the current tick has already been processed, so expire on the next tick at the earliest
+	self->expiry_tick = wheel_tick + (delay_ms ? delay_ms : 1);
+	self->state = SOFT_TIMER_RUNNING;
+	wheel_insert(self);
+
+	__set_PRIMASK(primask);
+}
+
+void soft_timer_stop(soft_timer *const self) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (self->state == SOFT_TIMER_RUNNING) {
+		wheel_remove(self);
+	}
+	self->state = SOFT_TIMER_STOPPED;
+
+	__set_PRIMASK(primask);
+}
+
+uint8_t soft_timer_running(soft_timer *const self) {
+	return self->state == SOFT_TIMER_RUNNING;
+}
+
+uint8_t soft_timer_expired(soft_timer *const self) {
+	return self->state == SOFT_TIMER_EXPIRED;
+}
+
+// Process every tick up to and including tick. Only the timers in the slot of each tick are visited
+void soft_timer_tick(uint32_t tick) {
+	while (wheel_tick != tick) {
+		wheel_tick++;
+
+		soft_timer *timer = wheel[wheel_tick & (SOFT_TIMER_WHEEL_SLOTS - 1)];
+		while (timer) {
+			soft_timer *next = timer->next;
+			if ((int32_t)(wheel_tick - timer->expiry_tick) >= 0) {
+				wheel_remove(timer);
+				timer->state = SOFT_TIMER_EXPIRED;
+			}
+			timer = next;
+		}
+	}
+}
+
+static void wheel_insert(soft_timer *const self) {
+	soft_timer **slot = &wheel[self->expiry_tick & (SOFT_TIMER_WHEEL_SLOTS - 1)];
+	self->prev = NULL;
+	self->next = *slot;
+	if (*slot) {
+		(*slot)->prev = self;
+	}
+	*slot = self;
+}
+
+static void wheel_remove(soft_timer *const self) {
+	if (self->prev) {
+		self->prev->next = self->next;
+	} else {
+		wheel[self->expiry_tick & (SOFT_TIMER_WHEEL_SLOTS - 1)] = self->next;
+	}
+	if (self->next) {
+		self->next->prev = self->prev;
+	}
+	self->next = NULL;
+	self->prev = NULL;
+}
@@ -1,5 +1,5 @@
 #include "ssd1306.h"
-#include <math.h>
+#include "fixed_point.h"
 #include <stdlib.h>
 #include <string.h>  // For memcpy
 
@@ -331,10 +331,6 @@ void ssd1306_Polyline(const SSD1306_VERTEX *par_vertex, uint16_t par_size, SSD13
   }
   return;
 }
-/*Convert Degrees to Radians*/
-static float ssd1306_DegToRad(float par_deg) {
-    return par_deg * 3.14 / 180.0;
-}
 /*Normalize degree to [0;360]*/
 static uint16_t ssd1306_NormalizeTo0_360(uint16_t par_deg) {
   uint16_t loc_angle;
@@ -355,35 +351,34 @@ static uint16_t ssd1306_NormalizeTo0_360(uint16_t par_deg) {
  */
 void ssd1306_DrawArc(uint8_t x, uint8_t y, uint8_t radius, uint16_t start_angle, uint16_t sweep, SSD1306_COLOR color) {
     #define CIRCLE_APPROXIMATION_SEGMENTS 36
-    float approx_degree;
     uint32_t approx_segments;
     uint8_t xp1,xp2;
     uint8_t yp1,yp2;
     uint32_t count = 0;
     uint32_t loc_sweep = 0;
-    float rad;
+    uint32_t degree;
     
     loc_sweep = ssd1306_NormalizeTo0_360(sweep);
     
     count = (ssd1306_NormalizeTo0_360(start_angle) * CIRCLE_APPROXIMATION_SEGMENTS) / 360;
     approx_segments = (loc_sweep * CIRCLE_APPROXIMATION_SEGMENTS) / 360;
-    approx_degree = loc_sweep / (float)approx_segments;
     while(count < approx_segments)
     {
-        rad = ssd1306_DegToRad(count*approx_degree);
-        xp1 = x + (int8_t)(sin(rad)*radius);
-        yp1 = y + (int8_t)(cos(rad)*radius);    
+        // Fixed-point sin/cos on whole degrees, no soft-float or libm
+        degree = (count * loc_sweep) / approx_segments;
+        xp1 = x + q15_mul(radius, fixed_sin_deg(degree));
+        yp1 = y + q15_mul(radius, fixed_cos_deg(degree));
         count++;
         if(count != approx_segments)
         {
-            rad = ssd1306_DegToRad(count*approx_degree);
+            degree = (count * loc_sweep) / approx_segments;
         }
         else
         {            
-            rad = ssd1306_DegToRad(loc_sweep);
+            degree = loc_sweep;
         }
-        xp2 = x + (int8_t)(sin(rad)*radius);
-        yp2 = y + (int8_t)(cos(rad)*radius);    
+        xp2 = x + q15_mul(radius, fixed_sin_deg(degree));
+        yp2 = y + q15_mul(radius, fixed_cos_deg(degree));
         ssd1306_Line(xp1,yp1,xp2,yp2,color);
     }
     
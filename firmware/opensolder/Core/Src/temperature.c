@@ -25,115 +25,325 @@
  * 			- Start TIM7 (2ms timer)
  * 3. TIM7 interrupt
  * 		- Check if this is the first or second TIM7 interrupt. Two options:
- * 		A - First interrupt (2ms after ZC):
+ * 		A - First interrupt (TIP_CLAMP_DELAY_US after ZC):
  * 			- Set TIP_CLAMP pin to input state (high impedance)
- * 			- Do a tip_state check if TIP_CHECK_INTERVAL has passed (checks if tip is inserted)
- * 		B - Second interrupt (4ms after ZC):
+ * 			- Do a tip_state check if one is due (see TIP CHECK SCHEDULING)
+ * 			- Or start a settle calibration trace, if requested and the clamp was engaged
+ * 		B - Second interrupt (settle_delay_us after the first):
  * 			- Start the ADC reading
- * 4. HAL_ADC_ConvCpltCallback() calls adc_complete() when the ADC conversion is done
+ * 4. HAL_ADC_ConvCpltCallback() calls adc_complete() when the ADC conversion is done.
+ *    adc_complete() only hands the filled buffer over and pends PendSV
+ * 5. PendSV_Handler() calls adc_process(), which does the filtering, tip check and
+ *    power control at the lowest interrupt priority
+ *
+ * zerocross_interrupt(), timer_interrupt() and adc_calculate_channel_stats() run from RAM (RAMFUNC),
+ * so the half cycle ISRs and the sample loop don't pay flash wait states at 48MHz. With TRACE_ENABLE,
+ * get_isr_time_ns() gives the average timer ISR time, build with RAMFUNC_ENABLE 0 to compare.
+ * Release builds don't time the ISR, and get_isr_time_ns() returns 0.
+ *
+ * - INTERRUPT PRIORITIES -
+ * 0: ZERO_CROSS EXTI, TIM6	(heater switching at the true zero cross)
+ *    TIM14					(microsecond timebase overflow, see timebase.h)
+ * 1: TIM7					(clamp release and ADC start)
+ * 2: DMA1 channel 1		(ADC buffer hand-over)
+ * 3: SysTick, PendSV		(deferred processing, event producers)
  *
  * The reason for these delays are to delay the ADC reading until the thermocouple amplifier
  * and low-pass filter have reached steady state.
+ *
+ * - ADC SCAN -
+ * Every reading converts the thermocouple alone, so the measurement window is only as long as its
+ * samples. When that DMA transfer is done, adc_complete() selects the internal temperature sensor and
+ * VREFINT and converts them ADC_INTERNAL_SCANS times in a short second transfer (see adc_channel_constants),
+ * then selects the thermocouple again. adc_calculate_channel_stats() gives an average, min and max per channel.
+ * VREFINT gives the actual VDDA, which is used to correct the thermocouple reading for supply droop
+ * and to calculate the MCU temperature (a non-blocking ambient reference next to the PCT2075).
+ * The ADC converts continuously, so adc_complete() stops it after each transfer.
+ *
+ * - MEASUREMENT PROFILES -
+ * Each profile sets the number of samples per reading and the ADC sampling time. Profiles with a
+ * power of two sample count average by shifting instead of dividing. set_adc_profile() selects a
+ * profile at runtime (a long press on the runtime debug page), it is applied by start_adc() while the
+ * ADC is idle. get_adc_noise() returns the largest deviation from the average in the last reading, to
+ * compare profiles on a given installation. host/profiles.c compares them on a recorded session.
+ * The sampling time is shared by all channels, and must be at least 4us (57 cycles) for the internal
+ * channels.
+ *
+ * - SETTLE CALIBRATION -
+ * settle_calibration_request() makes the next TIM7 clamp release after a heated half cycle
+ * start a dense ADC trace (SETTLE_TRACE_LENGTH thermocouple samples, captured with the sampling time
+ * of ADC_PROFILE_PRECISE) instead of waiting. adc_process()
+ * then finds the earliest sample from which the trace stays within SETTLE_TOLERANCE of its
+ * final value, and uses that time plus SETTLE_MARGIN_US as the second TIM7 period.
+ *
+ * - TIP CHECK SCHEDULING -
+ * A tip check replaces a temperature reading, so it is only done when needed. With no tip, an open
+ * thermocouple saturates the amplifier, so every normal reading also tells if the tip is there:
+ * 		- Below ADC_TIP_MAX_VALUE: plausible reading, the tip is present
+ * 		- Above ADC_NO_TIP_MIN_VALUE: saturated, the tip is removed without waiting for a tip check
+ * 		- In between: ambiguous, the heater is held off and a tip check is requested
+ * tip_check_due() decides when the first TIM7 period does a tip check:
+ * 		- On request (ambiguous reading, or tip_check_request() from the tip change state),
+ * 		  at least TIP_CHECK_MIN_INTERVAL half cycles after the last check
+ * 		- Every TIP_CHECK_RUN_INTERVAL half cycles in ON state with a tip detected, to keep the
+ * 		  cartridge resistance estimate (cartridge.h) current
+ * 		- Every TIP_CHECK_INTERVAL half cycles otherwise (no tip, standby, off or tip change)
+ *
+ * - EVENTS -
+ * The main loop doesn't read the measurement state directly. adc_process() publishes every reading
+ * (EVENT_MEASUREMENT) and tip check result (EVENT_TIP_STATE) to the event queue, and the SysTick
+ * callback publishes zero cross loss/restore (EVENT_AC_STATE), detected with a soft timer. Both run at priority 3, so they can't
+ * preempt each other and the queue has a single producer. error_handler() may be called from any
+ * context: it cuts the heater right away, and leaves the tip state update to adc_process().
  */
 
 #include "temperature.h"
+#include "benchmark.h"
+#include "cartridge.h"
+#include "event_queue.h"
+#include "invariant.h"
+#include "power_stats.h"
+#include "record.h"
+#include "soft_timer.h"
+#include "timebase.h"
+#include "trace.h"
+#include "stm32f0xx_ll_adc.h"
+
+/******    Struct Declaration    ******/
+typedef struct {
+	uint8_t sample_count;	   // Number of ADC samples per channel and reading, max ADC_BUFFER_LENGTH
+	uint8_t average_shift;	   // log2(sample_count) if sample_count is a power of two, 0 to average by division
+	uint16_t sample_period_ns; // Time between two conversions in continuous mode ((sampling time + 12.5) ADC cycles at 14MHz)
+	uint32_t sampling_time;	   // ADC_SAMPLETIME_x, written to the ADC SMPR register
+} adc_profile;
+
+typedef struct {
+	uint32_t average;
+	uint16_t min;
+	uint16_t max;
+} adc_channel_stats;
 
 /******    Local Function Declarations    ******/
 static void start_adc(void);
 static void adc_complete(void);
-static void zerocross_interrupt(uint16_t GPIO_Pin);
-static void timer_interrupt(TIM_HandleTypeDef *htim);
-static void adc_calculate_buffer_average(void);
+static RAMFUNC void zerocross_interrupt(uint16_t GPIO_Pin);
+static void overheat_interrupt(uint16_t GPIO_Pin);
+static RAMFUNC void timer_interrupt(TIM_HandleTypeDef *htim);
+static RAMFUNC uint8_t tip_check_due(void);
+static uint8_t settle_trace_start(void);
+static void adc_stop(void);
+static RAMFUNC void adc_calculate_channel_stats(const uint16_t *buffer, const uint16_t *internal_buffer, const adc_profile *profile);
 static void adc_to_temperature(void);
+static void adc_to_mcu_temperature(void);
 static void adc_deviation_check(void);
 static void power_control(void);
+static void settle_calibration(const uint16_t *trace);
+static void ac_watchdog(void);
+static void publish_measurement(void);
+static void publish_tip_state(void);
+static void heater_hard_off(void);
 
 /******    File Scope Variables    ******/
-static uint16_t adc_buffer[ADC_BUFFER_LENGTH];
-static uint32_t adc_buffer_average = 0;
+static uint16_t adc_buffer[2][ADC_BUFFER_LENGTH]; // Thermocouple ping-pong buffers, DMA fills one while adc_process() reads the other
+static uint16_t adc_internal_buffer[2][ADC_INTERNAL_SCANS * ADC_INTERNAL_CHANNEL_COUNT]; // Internal channels in scan order, same slots as adc_buffer
+static volatile uint8_t adc_internal_scan = RESET; // SET while the internal channels are converted after the thermocouple
+static adc_channel_stats adc_stats[ADC_CHANNEL_COUNT];
+static uint32_t adc_buffer_average = 0; // Thermocouple average, uncorrected
+static uint32_t tip_baseline_average = 0; // adc_buffer_average of the last normal reading, 0 if none since the last tip check
+static volatile uint8_t adc_dma_slot = 0;		// adc_buffer slot used by the next DMA transfer
+static volatile uint8_t adc_ready_slot = 0;		// adc_buffer slot handed over to adc_process()
+static volatile uint8_t adc_ready_flag = RESET; // Set by adc_complete(), cleared by adc_process()
+
+static const adc_profile adc_profiles[ADC_PROFILE_COUNT] = {
+	[ADC_PROFILE_PRECISE] = {50, 0, 18000, ADC_SAMPLETIME_239CYCLES_5},
+	[ADC_PROFILE_BALANCED] = {32, 5, 6000, ADC_SAMPLETIME_71CYCLES_5},
+	[ADC_PROFILE_FAST] = {16, 4, 6000, ADC_SAMPLETIME_71CYCLES_5},
+};
+static const adc_profile *adc_slot_profile[2]; // Profile used for each adc_buffer slot
+static const adc_profile *adc_active_profile = &adc_profiles[ADC_DEFAULT_PROFILE];
+static volatile uint8_t adc_profile_request = ADC_DEFAULT_PROFILE;
+static volatile uint16_t adc_noise = 0;
+static volatile uint16_t vdda_mv = VREFINT_CAL_VREF;
+static volatile int16_t mcu_temp = 0;
 
 static uint16_t set_temp = DEFAULT_TEMP;
 static uint16_t tip_temp = 0;
 
 static volatile uint8_t on_periods = 0;
-static volatile uint8_t power_bar_value = 0;
-static volatile uint32_t heater_power_history = 0; // DEBUG only - could be used for power histogram
-static volatile uint8_t error_flag = RESET;
-static volatile uint32_t ac_delay_tick_ms = 0;
-static volatile uint16_t tip_state = TIP_NOT_DETECTED;
+static uint8_t error_flag = RESET;				   // Set by adc_deviation_check()
+static volatile uint8_t error_request = RESET;	   // Set by error_handler(), handled by adc_process()
+static volatile uint8_t zc_flag = RESET; // Set by every zero cross interrupt, cleared by ac_watchdog()
+static soft_timer ac_loss_timer;		 // Restarted by ac_watchdog() on every zero cross
+static uint8_t ac_state = OFF;			 // Last published zero cross state, only used by the SysTick callback
+static uint16_t tip_state = TIP_NOT_DETECTED; // Only written by adc_process(), published as EVENT_TIP_STATE
 static volatile uint8_t tip_check_flag = RESET;
-static volatile uint16_t tip_check_counter = 0;
+static volatile uint16_t tip_check_counter = 0;			 // AC half cycles since the last tip check
+static volatile uint8_t tip_check_request_flag = RESET; // Set by tip_check_request() or an ambiguous reading, cleared when the check starts
+static volatile uint8_t overheat_flag = RESET; // Set by the PCT2075 OS pin, cleared when the pin is released
+static uint16_t settle_trace[SETTLE_TRACE_LENGTH];
+static volatile uint8_t settle_calibration_flag = RESET; // SET when requested, WAIT while the trace is captured
+static volatile uint8_t settle_trace_flag = RESET;		 // Set by adc_complete() when the trace is captured, cleared by adc_process()
+static volatile uint16_t settle_delay_us = SETTLE_DELAY_US;
+static volatile uint8_t clamp_flag = RESET; // Set while the thermocouple clamp is engaged
+static uint32_t zc_last_us = 0;					// Timebase value of the previous zero cross interrupt
+static volatile uint16_t zc_period_us = UINT16_MAX; // Time between the last two zero cross interrupts (one mains half cycle)
+#if TRACE_ENABLE
+static uint32_t isr_time_sum_us = 0;			  // Sum of the timer ISR durations in the current window
+static uint16_t isr_time_count = 0;
+static volatile uint16_t isr_time_ns = 0;		  // Average timer ISR duration over the last ISR_TIME_SAMPLES interrupts
+#endif
+static volatile uint16_t zc_latency_max_us = 0; // Worst case delay from the TIM6 update event (true zero cross) to the heater switching
+
+/******    Init    ******/
+void adc_init(void) {
+	// HAL_ADC_ConfigChannel() enables TSEN and VREFEN for the internal channels
+	ADC_ChannelConfTypeDef sConfig = {0};
+	sConfig.Rank = ADC_RANK_CHANNEL_NUMBER;
+	sConfig.SamplingTime = adc_active_profile->sampling_time;
+
+	sConfig.Channel = ADC_CHANNEL_TEMPSENSOR;
+	HAL_ADC_ConfigChannel(&hadc, &sConfig);
+	sConfig.Channel = ADC_CHANNEL_VREFINT;
+	HAL_ADC_ConfigChannel(&hadc, &sConfig);
+
+	// Readings start with the thermocouple alone, adc_complete() switches to the internal channels
+	LL_ADC_REG_SetSequencerChannels(hadc.Instance, LL_ADC_CHANNEL_0);
+
+	HAL_ADCEx_Calibration_Start(&hadc);
+}
 
 /******    Callback Functions    ******/
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
 	zerocross_interrupt(GPIO_Pin);
+	overheat_interrupt(GPIO_Pin);
 }
 
 void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim) {
-	timer_interrupt(htim);
+	timebase_interrupt(htim);
+
+	if ((htim == &htim6) || (htim == &htim7)) {
+#if TRACE_ENABLE
+		// The timer ISRs only take a few us, averaging over many interrupts gives sub-us resolution
+		uint32_t start_us = timebase_get_us();
+		timer_interrupt(htim);
+		isr_time_sum_us += timebase_get_us() - start_us;
+
+		if (++isr_time_count >= ISR_TIME_SAMPLES) {
+			isr_time_ns = isr_time_sum_us * 1000 / ISR_TIME_SAMPLES;
+			isr_time_sum_us = 0;
+			isr_time_count = 0;
+		}
+#else
+		timer_interrupt(htim);
+#endif
+	}
 }
 
 void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc) {
 	adc_complete();
 }
 
+// Called every 1ms from SysTick_Handler() (priority 3)
+void HAL_SYSTICK_Callback(void) {
+	static uint8_t sensor_scan_counter = 0;
+
+	soft_timer_tick(HAL_GetTick());
+	ac_watchdog();
+
+	if (++sensor_scan_counter >= SENSOR_SCAN_INTERVAL_MS) {
+		sensor_scan_counter = 0;
+		sensor_scan();
+	}
+}
+
 /******    ISR Functions    ******/
 // ISR: Rising edge is detected on ZERO_CROSS pin. Start TIM6, which is a delay for when the true AC zero cross happens
-static void zerocross_interrupt(uint16_t GPIO_Pin) {
+static RAMFUNC void zerocross_interrupt(uint16_t GPIO_Pin) {
 	if (GPIO_Pin == ZERO_CROSS_Pin) {
+		TRACE(TRACE_ZC_EDGE, 0);
 		HAL_TIM_Base_Start_IT(&htim6);
-		ac_delay_tick_ms = HAL_GetTick() + AC_DETECTION_INTERVAL_MS;
+		zc_flag = SET;
+
+		// Track the mains half cycle period, the first edge after an AC loss gives a saturated value
+		uint32_t zc_time_us = timebase_get_us();
+		uint32_t zc_period = zc_time_us - zc_last_us;
+		zc_period_us = (zc_period > UINT16_MAX) ? UINT16_MAX : zc_period;
+		zc_last_us = zc_time_us;
+	}
+}
+
+// ISR: Falling edge is detected on the PCT2075 OS pin, the PCB is above PCB_OVERHEAT_TEMP. Cut the heater immediately
+static void overheat_interrupt(uint16_t GPIO_Pin) {
+	if (GPIO_Pin == OS_Pin) {
+		overheat_flag = SET;
+		heater_hard_off();
 	}
 }
 
 // ISR: Do heater and temperature reading tasks at specific points during the AC mains cycle
-static void timer_interrupt(TIM_HandleTypeDef *htim) {
+static RAMFUNC void timer_interrupt(TIM_HandleTypeDef *htim) {
 
 	// TIM6 interrupt, indicating true AC zero cross. This is where to turn the heater on/off to avoid inductive spikes
 	if (htim == &htim6) {
+		// TIM6 keeps counting in 1us steps after the update event, so CNT is the interrupt latency
+		uint16_t zc_latency_us = htim6.Instance->CNT;
 		HAL_TIM_Base_Stop_IT(&htim6);
+		TRACE(TRACE_TIM6, zc_latency_us);
+		if (zc_latency_us > zc_latency_max_us) {
+			zc_latency_max_us = zc_latency_us;
+		}
 
-		heater_power_history <<= 1; // Records the tip power history of the past 32 AC half cycles. Power to tip = 1, no power = 0
-		tip_check_counter++;		// Increase counter every AC half cycle
+		power_stats_half_cycle();
+		tip_check_counter++; // Increase counter every AC half cycle
 
 		// Switch heater on or off
-		if ((on_periods >= 1) && (tip_temp < MAX_TEMP)) {
+		if ((on_periods >= 1) && (tip_temp < MAX_TEMP) && !overheat_flag) {
 			// Drive TIP_CHECK pin LOW, this clamps thermo-couple signal to prevent transients and noise on the op-amp input
 			TIP_CLAMP_GPIO_Port->BRR |= GPIO_BRR_BR_1;		   // Set PA2 LOW
 			TIP_CLAMP_GPIO_Port->MODER |= GPIO_MODER_MODER2_0; // Set PA2 to push pull output mode
+			clamp_flag = SET;
 
 			// Turn heater on
+			INVARIANT(((get_system_state() == ON_STATE) || (get_system_state() == STANDBY_STATE)) && (tip_state == TIP_DETECTED), INVARIANT_HEATER_STATE);
 			HAL_GPIO_WritePin(HEATER_GPIO_Port, HEATER_Pin, ON);
 			on_periods--;
-			heater_power_history++;
+			TRACE(TRACE_HEATER_ON, on_periods);
+			power_stats_fired();
 
 		} else {
 			HAL_GPIO_WritePin(HEATER_GPIO_Port, HEATER_Pin, OFF); // Turn heater OFF
+			TRACE(TRACE_HEATER_OFF, 0);
 			HAL_TIM_Base_Start_IT(&htim7);						  // Start TIM7 to read tip temperature
 		}
 
-		sensor_scan(); // Scan buttons (zero cross happens at 100Hz, 10ms between each scan)
-
 	} else if (htim == &htim7) {
 
 		/*
-		 * Wait 2ms (one TIM7 period) after power is turned off for transients
-		 * to settle, then remove thermo-couple clamp (pin PA2). Wait another 2ms
+		 * Wait TIP_CLAMP_DELAY_US after power is turned off for transients
+		 * to settle, then remove thermo-couple clamp (pin PA2). Wait another settle_delay_us
 		 * for the RC pre-amp filter to settle before starting the ADC conversion
 		 */
 
 		static uint8_t delay_flag = SET;
 
-		// First period of TIM7, 2ms after true zero cross
+		// First period of TIM7, TIP_CLAMP_DELAY_US after true zero cross
 		if (delay_flag) {
 			delay_flag = RESET;
+			__HAL_TIM_SET_AUTORELOAD(&htim7, settle_delay_us - 1);
 
 			// Set TIP_CLAMP pin to input state (high impedance)
 			TIP_CLAMP_GPIO_Port->MODER &= ~GPIO_MODER_MODER2_0; // Set PA2 to input mode
-
-			if (tip_check_counter > TIP_CHECK_INTERVAL) {
+			TRACE(TRACE_CLAMP_RELEASE, 0);
+
+			if ((settle_calibration_flag == SET) && clamp_flag && !tip_check_due() && settle_trace_start()) {
+				// The trace replaces the reading of this half cycle
+				delay_flag = SET;
+				HAL_TIM_Base_Stop_IT(&htim7);
+				__HAL_TIM_SET_AUTORELOAD(&htim7, TIP_CLAMP_DELAY_US - 1);
+			} else if (tip_check_due()) {
 				heater_off();
 				tip_check_flag = SET;
+				tip_check_request_flag = RESET;
 
 				// Drive TIP_CHECK pin HIGH, if no tip is inserted the op-amp will saturate and ADC will read close to 4096.
 				TIP_CHECK_GPIO_Port->BSRR |= GPIO_BSRR_BS_1;	   // Set PA1 HIGH
@@ -141,64 +351,285 @@ static void timer_interrupt(TIM_HandleTypeDef *htim) {
 
 				tip_check_counter = 0;
 			}
+			clamp_flag = RESET;
 
-			// Second period of TIM7, 4ms after true zero cross
+			// Second period of TIM7, settle_delay_us after clamp release
 		} else {
 			delay_flag = SET;
 			HAL_TIM_Base_Stop_IT(&htim7); // Stop TIM7
-			start_adc();				  // Start ADC conversion in DMA mode
+			__HAL_TIM_SET_AUTORELOAD(&htim7, TIP_CLAMP_DELAY_US - 1);
+			start_adc(); // Start ADC conversion in DMA mode
 		}
 	}
 }
 
+// See TIP CHECK SCHEDULING
+static RAMFUNC uint8_t tip_check_due(void) {
+	if (tip_check_request_flag) {
+		return tip_check_counter >= TIP_CHECK_MIN_INTERVAL;
+	} else if ((tip_state == TIP_DETECTED) && (get_system_state() == ON_STATE)) {
+		return tip_check_counter > TIP_CHECK_RUN_INTERVAL;
+	}
+	return tip_check_counter > TIP_CHECK_INTERVAL;
+}
+
+// Capture the amplifier output from the moment the clamp is released. Returns RESET if the ADC
+// is busy or the transfer could not be started, the calibration is then retried on the next heated half cycle
+static uint8_t settle_trace_start(void) {
+	if (hadc.Instance->CR & ADC_CR_ADSTART) {
+		return RESET;
+	}
+
+	// Always trace with the longest sampling time, start_adc() restores the requested profile
+	MODIFY_REG(hadc.Instance->SMPR, ADC_SMPR_SMP, adc_profiles[ADC_PROFILE_PRECISE].sampling_time);
+	adc_active_profile = &adc_profiles[ADC_PROFILE_PRECISE];
+	if (HAL_ADC_Start_DMA(&hadc, (uint32_t *)settle_trace, SETTLE_TRACE_LENGTH) != HAL_OK) {
+		return RESET;
+	}
+	settle_calibration_flag = WAIT;
+	return SET;
+}
+
 static void start_adc(void) {
-	HAL_ADC_Start_DMA(&hadc, (uint32_t *)adc_buffer, (sizeof(adc_buffer) / sizeof(uint16_t)));
+	// Apply a new measurement profile, SMPR can only be written while no conversion is ongoing
+	const adc_profile *requested_profile = &adc_profiles[adc_profile_request];
+	if ((requested_profile != adc_active_profile) && !(hadc.Instance->CR & ADC_CR_ADSTART)) {
+		MODIFY_REG(hadc.Instance->SMPR, ADC_SMPR_SMP, requested_profile->sampling_time);
+		adc_active_profile = requested_profile;
+	}
+
+	adc_slot_profile[adc_dma_slot] = adc_active_profile;
+	TRACE(TRACE_ADC_START, adc_active_profile - adc_profiles);
+	HAL_ADC_Start_DMA(&hadc, (uint32_t *)adc_buffer[adc_dma_slot], adc_active_profile->sample_count);
 }
 
+// The ADC converts continuously, stop it before the channel selection is changed or the next transfer is started
+static void adc_stop(void) {
+	if (LL_ADC_REG_IsConversionOngoing(hadc.Instance)) {
+		LL_ADC_REG_StopConversion(hadc.Instance);
+		while (LL_ADC_REG_IsStopConversionOngoing(hadc.Instance)) {
+		}
+	}
+}
+
+// ISR: Convert the internal channels after the thermocouple, then hand the filled buffers over to adc_process()
+// and defer all processing to PendSV
 static void adc_complete(void) {
-	adc_calculate_buffer_average();
+	TRACE(TRACE_ADC_COMPLETE, adc_internal_scan);
+	adc_stop();
+
+	if (settle_calibration_flag == WAIT) {
+		settle_trace_flag = SET;
+		SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+		return;
+	}
+
+	if (!adc_internal_scan) {
+		if (tip_check_flag == SET) {
+			TIP_CHECK_GPIO_Port->MODER &= ~GPIO_MODER_MODER1_0; // Set TIP_CHECK pin PA1 to input mode
+		}
+
+		// If the short scan can't be started, the reading keeps the internal channel values of the previous use of the slot
+		LL_ADC_REG_SetSequencerChannels(hadc.Instance, LL_ADC_CHANNEL_TEMPSENSOR | LL_ADC_CHANNEL_VREFINT);
+		if (HAL_ADC_Start_DMA(&hadc, (uint32_t *)adc_internal_buffer[adc_dma_slot], ADC_INTERNAL_SCANS * ADC_INTERNAL_CHANNEL_COUNT) == HAL_OK) {
+			adc_internal_scan = SET;
+			return;
+		}
+	}
+	adc_internal_scan = RESET;
+	LL_ADC_REG_SetSequencerChannels(hadc.Instance, LL_ADC_CHANNEL_0);
+
+	adc_ready_slot = adc_dma_slot;
+	adc_dma_slot ^= 1;
+	adc_ready_flag = SET;
+	SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
+
+/*
+ * Called from PendSV_Handler() at the lowest interrupt priority. The buffer in adc_ready_slot
+ * is not touched by the DMA until the next ADC conversion is done (at least one AC half cycle later)
+ */
+void adc_process(void) {
+	if (error_request) {
+		error_request = RESET;
+		tip_state = TIP_CHECK_ERROR;
+		publish_tip_state();
+	}
 
-	if (tip_check_flag == SET) {
+	// PendSV is also pended by error_handler(), so only a completed transfer ends the calibration
+	if (settle_trace_flag) {
+		settle_trace_flag = RESET;
+		settle_calibration(settle_trace);
+		settle_calibration_flag = RESET;
+		return;
+	}
+
+	if (adc_ready_flag == RESET) {
+		return;
+	}
+	adc_ready_flag = RESET;
+
+	const uint16_t *buffer = adc_buffer[adc_ready_slot];
+	const adc_profile *profile = adc_slot_profile[adc_ready_slot];
+	adc_calculate_channel_stats(buffer, adc_internal_buffer[adc_ready_slot], profile);
+	adc_to_mcu_temperature();
+
+	// tip_check() resets the flag, so the record takes it from here
+	uint8_t was_tip_check = (tip_check_flag == SET);
+	if (was_tip_check) {
 		tip_check_flag = WAIT;
-		TIP_CHECK_GPIO_Port->MODER &= ~GPIO_MODER_MODER1_0; // Set TIP_CHECK pin PA1 to input mode
 		tip_state = tip_check();
+		publish_tip_state();
 	} else if ((tip_check_flag == RESET) && (tip_state == TIP_DETECTED)) {
 		adc_to_temperature();
 		adc_deviation_check();
-		if (error_flag == SET) {
+		tip_baseline_average = adc_buffer_average;
+		if (adc_buffer_average > ADC_NO_TIP_MIN_VALUE) {
+			// Saturated amplifier, the thermocouple is open
+			error_flag = RESET;
+			tip_baseline_average = 0;
+			tip_temp = ADC_READING_ERROR;
+			heater_off();
+			cartridge_reset();
+			tip_state = TIP_NOT_DETECTED;
+			publish_tip_state();
+		} else if (adc_buffer_average >= ADC_TIP_MAX_VALUE) {
+			// Neither a plausible reading nor saturated, let a tip check decide
+			error_flag = RESET;
+			tip_baseline_average = 0;
+			heater_off();
+			tip_check_request_flag = SET;
+		} else if (error_flag == SET) {
+			error_flag = RESET;
+			tip_baseline_average = 0;
 			tip_temp = ADC_READING_ERROR;
-			error_handler();
+			heater_hard_off();
+			tip_state = TIP_CHECK_ERROR;
+			publish_tip_state();
 		} else if ((get_system_state() == ON_STATE) || (get_system_state() == STANDBY_STATE)) {
 			power_control();
 		}
 	}
-	power_bar_value = on_periods;
+	RECORD(buffer, profile->sample_count, zc_last_us, tip_temp, on_periods, tip_state, was_tip_check);
+	publish_measurement();
+	measurement_complete();
+}
+
+static void publish_measurement(void) {
+	event measurement = {.type = EVENT_MEASUREMENT};
+	measurement.data.measurement.tip_temp = tip_temp;
+	measurement.data.measurement.on_periods = on_periods;
+	event_push(&measurement);
+}
+
+static void publish_tip_state(void) {
+	event tip_state_event = {.type = EVENT_TIP_STATE, .data.tip_state = tip_state};
+	event_push(&tip_state_event);
+}
+
+// Publish an EVENT_AC_STATE when zero cross interrupts stop, or start again
+static void ac_watchdog(void) {
+	uint8_t new_ac_state = ac_state;
+
+	if (zc_flag) {
+		zc_flag = RESET;
+		soft_timer_start(&ac_loss_timer, AC_DETECTION_INTERVAL_MS);
+		new_ac_state = ON;
+	} else if (soft_timer_expired(&ac_loss_timer)) {
+		new_ac_state = OFF;
+	}
+
+	// Without zero cross interrupts the heater is never switched off by TIM6. If AC is still present
+	// (a zero cross detector fault), a heater left on would stay on, so cut it here
+	if ((new_ac_state == OFF) && (ac_state == ON)) {
+		heater_hard_off();
+	}
+
+	if (new_ac_state != ac_state) {
+		ac_state = new_ac_state;
+		event ac_state_event = {.type = EVENT_AC_STATE, .data.ac_state = ac_state};
+		event_push(&ac_state_event);
+	}
 }
 
 static void adc_to_temperature(void) {
+	// Scale the reading to a 3.3V supply, VREFINT_CAL is the VREFINT reading at exactly 3.3V
+	uint32_t corrected_average = adc_buffer_average;
+	if (adc_stats[ADC_CH_VREFINT].average) {
+		corrected_average = adc_buffer_average * (*VREFINT_CAL_ADDR) / adc_stats[ADC_CH_VREFINT].average;
+	}
+
 	// Calculate tip temperature in Celsius
-	tip_temp = (adc_buffer_average * 100 / 750) + 25;
+	tip_temp = (corrected_average * 100 / 750) + 25;
 }
 
-static void adc_calculate_buffer_average(void) {
-	// Calculate the average value of adc_buffer
-	adc_buffer_average = 0;
-	for (uint16_t i = 0; i < ADC_BUFFER_LENGTH; i++) {
-		adc_buffer_average += adc_buffer[i];
+static void adc_to_mcu_temperature(void) {
+	uint32_t vrefint = adc_stats[ADC_CH_VREFINT].average;
+	if (vrefint == 0) {
+		return;
 	}
-	adc_buffer_average /= ADC_BUFFER_LENGTH;
+	vdda_mv = VREFINT_CAL_VREF * (*VREFINT_CAL_ADDR) / vrefint;
+
+	// Interpolate between the factory calibration points (TS_CAL1 at 30C, TS_CAL2 at 110C, both at 3.3V)
+	int32_t tempsensor = adc_stats[ADC_CH_TEMPSENSOR].average * (*VREFINT_CAL_ADDR) / vrefint;
+	mcu_temp = ((tempsensor - (int32_t)*TEMPSENSOR_CAL1_ADDR) * (TEMPSENSOR_CAL2_TEMP - TEMPSENSOR_CAL1_TEMP)
+				/ ((int32_t)*TEMPSENSOR_CAL2_ADDR - (int32_t)*TEMPSENSOR_CAL1_ADDR))
+			   + TEMPSENSOR_CAL1_TEMP;
 }
 
-static void adc_deviation_check(void) {
-	// Check if any values in adc_buffer deviates more than expected, if so set error_flag
-	int16_t upper_limit = adc_buffer_average + ADC_MAX_DEVIATION;
-	int16_t lower_limit = adc_buffer_average - ADC_MAX_DEVIATION;
+static RAMFUNC void adc_calculate_channel_stats(const uint16_t *buffer, const uint16_t *internal_buffer, const adc_profile *profile) {
+	// Calculate the average, min and max of each channel in one pass. The thermocouple samples come first
+	for (uint8_t ch = 0; ch < ADC_CHANNEL_COUNT; ch++) {
+		adc_stats[ch].average = 0;
+		adc_stats[ch].min = UINT16_MAX;
+		adc_stats[ch].max = 0;
+	}
 
-	for (uint16_t i = 0; i < ADC_BUFFER_LENGTH; i++) {
-		if ((adc_buffer[i] > upper_limit) || (adc_buffer[i] < lower_limit)) {
-			error_flag = SET;
+	adc_channel_stats *stats = &adc_stats[ADC_CH_THERMOCOUPLE];
+	for (uint16_t i = 0; i < profile->sample_count; i++) {
+		uint16_t sample = *buffer++;
+		stats->average += sample;
+		if (sample < stats->min) {
+			stats->min = sample;
+		}
+		if (sample > stats->max) {
+			stats->max = sample;
 		}
 	}
+	if (profile->average_shift) {
+		stats->average >>= profile->average_shift;
+	} else {
+		stats->average /= profile->sample_count;
+	}
+
+	// The internal channels are interleaved in scan order
+	for (uint16_t i = 0; i < ADC_INTERNAL_SCANS; i++) {
+		for (uint8_t ch = ADC_CH_TEMPSENSOR; ch < ADC_CHANNEL_COUNT; ch++) {
+			uint16_t sample = *internal_buffer++;
+			adc_stats[ch].average += sample;
+			if (sample < adc_stats[ch].min) {
+				adc_stats[ch].min = sample;
+			}
+			if (sample > adc_stats[ch].max) {
+				adc_stats[ch].max = sample;
+			}
+		}
+	}
+	for (uint8_t ch = ADC_CH_TEMPSENSOR; ch < ADC_CHANNEL_COUNT; ch++) {
+		adc_stats[ch].average /= ADC_INTERNAL_SCANS;
+	}
+	adc_buffer_average = adc_stats[ADC_CH_THERMOCOUPLE].average;
+}
+
+static void adc_deviation_check(void) {
+	// Check if any thermocouple sample deviates more than expected, if so set error_flag
+	uint16_t upper_deviation = adc_stats[ADC_CH_THERMOCOUPLE].max - adc_buffer_average;
+	uint16_t lower_deviation = adc_buffer_average - adc_stats[ADC_CH_THERMOCOUPLE].min;
+
+	if ((upper_deviation > ADC_MAX_DEVIATION) || (lower_deviation > ADC_MAX_DEVIATION)) {
+		error_flag = SET;
+	}
+	adc_noise = (upper_deviation > lower_deviation) ? upper_deviation : lower_deviation;
 }
 
 static void power_control(void) {
@@ -211,17 +642,15 @@ static void power_control(void) {
 	 * temperature closes in on set_temp to prevent too much overshoot.
 	 */
 
-	uint16_t tmp_set_temp = set_temp;
-	if ((get_system_state() == STANDBY_STATE) && (tmp_set_temp > STANDBY_TEMP)) {
-		tmp_set_temp = STANDBY_TEMP;
-	}
+	uint16_t tmp_set_temp = get_target_temp();
+	const cartridge_profile *profile = cartridge_get_profile();
 
 	// Turn heater ON/OFF
 	if ((tip_temp + 3) < tmp_set_temp) {
 		uint16_t temperature_error = tmp_set_temp - tip_temp;
-		on_periods = temperature_error / 10;
-		if (on_periods > MAX_ON_PERIODS) {
-			on_periods = MAX_ON_PERIODS;
+		on_periods = temperature_error / profile->error_per_period;
+		if (on_periods > profile->max_on_periods) {
+			on_periods = profile->max_on_periods;
 		} else if (on_periods == 0) {
 			on_periods = 1;
 		}
@@ -230,18 +659,52 @@ static void power_control(void) {
 	}
 }
 
+static void settle_calibration(const uint16_t *trace) {
+	// The settled value is the average of the last SETTLE_FINAL_SAMPLES samples of the trace
+	uint32_t settled_value = 0;
+	for (uint16_t i = SETTLE_TRACE_LENGTH - SETTLE_FINAL_SAMPLES; i < SETTLE_TRACE_LENGTH; i++) {
+		settled_value += trace[i];
+	}
+	settled_value /= SETTLE_FINAL_SAMPLES;
+
+	// Search backwards for the last sample outside the tolerance band
+	uint16_t settle_index = SETTLE_TRACE_LENGTH;
+	while (settle_index > 0) {
+		int32_t deviation = (int32_t)trace[settle_index - 1] - (int32_t)settled_value;
+		if ((deviation > SETTLE_TOLERANCE) || (deviation < -SETTLE_TOLERANCE)) {
+			break;
+		}
+		settle_index--;
+	}
+
+	// Not settled before the end of the trace, keep the current delay
+	if (settle_index > (SETTLE_TRACE_LENGTH - SETTLE_FINAL_SAMPLES)) {
+		return;
+	}
+
+	uint32_t sample_period_ns = adc_profiles[ADC_PROFILE_PRECISE].sample_period_ns;
+	uint32_t new_delay_us = ((uint32_t)settle_index * sample_period_ns / 1000) + SETTLE_MARGIN_US;
+	if (new_delay_us < SETTLE_DELAY_MIN_US) {
+		new_delay_us = SETTLE_DELAY_MIN_US;
+	} else if (new_delay_us > SETTLE_DELAY_MAX_US) {
+		new_delay_us = SETTLE_DELAY_MAX_US;
+	}
+	settle_delay_us = new_delay_us;
+}
+
 uint8_t tip_check(void) {
 	/*
 	 * - TIP CHECK -
-	 * 1. tip_check_flag is set every TIP_CHECK_INTERVAL AC half cycles, and TIP_CHECK_PIN is pulled high
-	 * 2. When ADC is finished, adc_complete() reset TIP_CHECK_PIN,
+	 * 1. tip_check_flag is set when tip_check_due(), and TIP_CHECK_PIN is pulled high
+	 * 2. When ADC is finished, adc_complete() reset TIP_CHECK_PIN, and adc_process()
 	 *    calculates the average value of the ADC buffer reading and calls tip_check() to update tip_state
+	 * 3. With a tip detected, the rise from the last normal reading gives the heater resistance (cartridge.h)
 	 */
 
 	uint8_t tmp_return = TIP_NOT_DETECTED;
 
 	if (tip_check_flag != WAIT) {
-		error_handler();
+		heater_hard_off();
 		tmp_return = TIP_CHECK_ERROR;
 	} else if (adc_buffer_average > ADC_NO_TIP_MIN_VALUE) {
 		tmp_return = TIP_NOT_DETECTED;
@@ -251,33 +714,41 @@ uint8_t tip_check(void) {
 		tmp_return = TIP_CHECK_ERROR;
 	}
 
+	if (tmp_return != TIP_DETECTED) {
+		cartridge_reset();
+	} else if (tip_baseline_average && (adc_buffer_average > tip_baseline_average) && (tip_temp != ADC_READING_ERROR)) {
+		cartridge_update(adc_buffer_average - tip_baseline_average, tip_temp, get_target_temp());
+	}
+	tip_baseline_average = 0;
+
 	tip_check_flag = RESET;
 	return tmp_return;
 }
 
 /******    Other Functions   ******/
-int16_t read_pcb_temperature(void) {
-	int16_t temp_register = 0;
-	uint8_t tmp_buffer[2];
-
-	if (HAL_I2C_Master_Receive(&hi2c1, PCT2075_I2C_ADDR, tmp_buffer, sizeof(tmp_buffer), 100) != HAL_ERROR) {
-		temp_register = (tmp_buffer[0] << 8);
-		temp_register |= tmp_buffer[1];
-		return ((temp_register >> 5) * 0.125); // Returns 11 bit signed (2s compl.) temperature in Celsius.
-	} else {
-		return ADC_READING_ERROR;
-	}
+#if BENCHMARK_ENABLE
+void adc_stats_benchmark(void) {
+	adc_calculate_channel_stats(adc_buffer[adc_ready_slot], adc_internal_buffer[adc_ready_slot], adc_active_profile);
 }
 
-uint32_t get_ac_delay_tick(void) {
-	return ac_delay_tick_ms;
+void adc_deviation_benchmark(void) {
+	adc_deviation_check();
+	error_flag = RESET;
 }
+#endif
 
 void heater_off(void) {
 	on_periods = 0;
 }
 
+// Turn heater hard OFF, without waiting for the next zero cross
+static void heater_hard_off(void) {
+	HAL_GPIO_WritePin(HEATER_GPIO_Port, HEATER_Pin, OFF);
+	heater_off();
+}
+
 void set_new_temp(uint16_t new_temp) {
+	INVARIANT((new_temp >= MIN_TEMP) && (new_temp <= MAX_TEMP), INVARIANT_SET_TEMP);
 	set_temp = new_temp;
 }
 
@@ -285,22 +756,79 @@ uint16_t get_set_temp(void) {
 	return set_temp;
 }
 
-uint16_t get_tip_temp(void) {
-	return tip_temp;
+// Temperature the heater regulates to in the current system state, 0 when the heater is off
+uint16_t get_target_temp(void) {
+	switch (get_system_state()) {
+		case ON_STATE:
+			return set_temp;
+		case STANDBY_STATE:
+			return (set_temp > STANDBY_TEMP) ? STANDBY_TEMP : set_temp;
+		default:
+			return 0;
+	}
 }
 
-uint8_t get_tip_state(void) {
-	return tip_state;
+uint8_t get_overheat_state(void) {
+	// OS pin is active low, and is released when the PCB has cooled below PCB_OVERHEAT_HYST_TEMP.
+	// Reading the level also catches a station that is already overheated at power up (no falling edge)
+	overheat_flag = (HAL_GPIO_ReadPin(OS_GPIO_Port, OS_Pin) == GPIO_PIN_RESET);
+	return overheat_flag;
 }
 
+// Can be called from any context. adc_process() sets tip_state to TIP_CHECK_ERROR and publishes it
 void error_handler(void) {
-	// Turn heater hard OFF
-	HAL_GPIO_WritePin(HEATER_GPIO_Port, HEATER_Pin, OFF);
-	heater_off();
-	tip_state = TIP_CHECK_ERROR;
-	error_flag = RESET;
+	heater_hard_off();
+	error_request = SET;
+	SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
+
+void settle_calibration_request(void) {
+	settle_calibration_flag = SET;
+}
+
+// Do a tip check at the next reading, at least TIP_CHECK_MIN_INTERVAL half cycles after the last one
+void tip_check_request(void) {
+	tip_check_request_flag = SET;
+}
+
+uint16_t get_settle_delay_us(void) {
+	return settle_delay_us;
+}
+
+void set_adc_profile(uint8_t profile) {
+	if (profile < ADC_PROFILE_COUNT) {
+		adc_profile_request = profile;
+	}
+}
+
+uint8_t get_adc_profile(void) {
+	return adc_active_profile - adc_profiles;
+}
+
+uint16_t get_adc_noise(void) {
+	return adc_noise;
+}
+
+uint16_t get_vdda_mv(void) {
+	return vdda_mv;
+}
+
+int16_t get_mcu_temperature(void) {
+	return mcu_temp;
+}
+
+uint16_t get_zc_latency_max_us(void) {
+	return zc_latency_max_us;
+}
+
+uint16_t get_zc_period_us(void) {
+	return zc_period_us;
 }
 
-uint8_t get_power_bar_value(void) {
-	return power_bar_value;
+uint16_t get_isr_time_ns(void) {
+#if TRACE_ENABLE
+	return isr_time_ns;
+#else
+	return 0;
+#endif
 }
@@ -0,0 +1,44 @@
+/*
+ * timebase.c
+ *
+ * 32 bit microsecond timebase from a 16 bit hardware timer
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "timebase.h"
+
+/******    File Scope Variables    ******/
+static TIM_HandleTypeDef *timebase_htim;
+static volatile uint16_t overflow_count = 0; // Upper 16 bits of the timebase
+
+/******    Functions    ******/
+void timebase_init(TIM_HandleTypeDef *htim) {
+	timebase_htim = htim;
+	HAL_TIM_Base_Start_IT(htim);
+}
+
+// ISR: The hardware counter has wrapped
+void timebase_interrupt(TIM_HandleTypeDef *htim) {
+	if (htim == timebase_htim) {
+		overflow_count++;
+	}
+}
+
+uint32_t timebase_get_us(void) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	uint16_t high = overflow_count;
+	uint16_t low = timebase_htim->Instance->CNT;
+
+	// The counter has wrapped, but the update interrupt has not been serviced yet.
+	// A low count means the wrap happened before CNT was read
+	if ((timebase_htim->Instance->SR & TIM_SR_UIF) && (low < 0x8000U)) {
+		high++;
+	}
+
+	__set_PRIMASK(primask);
+	return ((uint32_t)high << 16) | low;
+}
@@ -0,0 +1,15 @@
+/*
+ * trace.c
+ *
+ * Timestamped event trace in a RAM ring buffer
+ *
+ * License: GPL-3.0 or any later version
+ * Copyright (c) 2022 Håvard Jakobsen
+ */
+
+#include "trace.h"
+
+/******    Global Variables    ******/
+#if TRACE_ENABLE
+trace_buffer trace_log = {.magic = TRACE_MAGIC};
+#endif
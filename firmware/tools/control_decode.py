@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""
+control_decode.py
+
+Decodes a control_log dump from the OpenSolder firmware (see Core/Inc/control_metrics.h) into
+one line per temperature step, as CSV or JSON. With --baseline, the mean of each metric is
+compared against another dump, e.g. one taken with the previous power_control().
+
+Dump the buffer with the debugger while the MCU is halted, e.g. in gdb:
+    dump binary value control.bin control_log
+
+Usage:
+    control_decode.py control.bin [--json] [--baseline baseline.bin]
+
+License: GPL-3.0 or any later version
+Copyright (c) 2022 Håvard Jakobsen
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+CONTROL_LOG_MAGIC = 0x4354524C
+CONTROL_LOG_LENGTH = 8
+
+# Keep in sync with control_run in Core/Inc/control_metrics.h
+RUN_FORMAT = "<HHHHhHHHIIIB3x"
+RUN_FIELDS = [
+    "start_temp",
+    "target_temp",
+    "rise_time_ms",
+    "settling_time_ms",
+    "overshoot",
+    "ripple",
+    "droop",
+    "recovery_time_ms",
+    "duration_ms",
+    "energy_mj",
+    "full_power_ms",
+    "status",
+]
+STATUS = ["IDLE", "RISING", "SETTLING", "SETTLED"]
+
+# Metrics compared with --baseline
+SUMMARY_FIELDS = ["rise_time_ms", "settling_time_ms", "overshoot", "ripple", "droop", "recovery_time_ms", "energy_mj", "full_power_ms"]
+
+
+def read_runs(path):
+    data = open(path, "rb").read()
+    magic, head = struct.unpack_from("<II", data, 0)
+    if magic != CONTROL_LOG_MAGIC:
+        sys.exit("%s: not a control_log dump (magic 0x%08x)" % (path, magic))
+
+    size = struct.calcsize(RUN_FORMAT)
+    count = min(head, CONTROL_LOG_LENGTH)
+    runs = []
+    for i in range(head - count, head):
+        values = struct.unpack_from(RUN_FORMAT, data, 8 + (i % CONTROL_LOG_LENGTH) * size)
+        run = dict(zip(RUN_FIELDS, values))
+        run["status"] = STATUS[run["status"]] if run["status"] < len(STATUS) else run["status"]
+        runs.append(run)
+    return runs
+
+
+def summary(runs):
+    # Rise and settling times only count for runs that got that far
+    result = {}
+    for field in SUMMARY_FIELDS:
+        values = [run[field] for run in runs if run[field] or field not in ("rise_time_ms", "settling_time_ms")]
+        result[field] = sum(values) / len(values) if values else None
+    return result
+
+
+def print_csv(runs):
+    print(",".join(RUN_FIELDS))
+    for run in runs:
+        print(",".join(str(run[field]) for field in RUN_FIELDS))
+
+
+def print_comparison(runs, baseline_runs):
+    current = summary(runs)
+    baseline = summary(baseline_runs)
+    print("\n%-18s %10s %10s %10s" % ("metric", "baseline", "current", "change"))
+    for field in SUMMARY_FIELDS:
+        if current[field] is None or baseline[field] is None:
+            print("%-18s %10s %10s" % (field, baseline[field], current[field]))
+        else:
+            print("%-18s %10.1f %10.1f %+10.1f" % (field, baseline[field], current[field], current[field] - baseline[field]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode an OpenSolder control_log dump")
+    parser.add_argument("dump", help="binary dump of control_log")
+    parser.add_argument("--json", action="store_true", help="print JSON instead of CSV")
+    parser.add_argument("--baseline", help="control_log dump to compare the mean metrics against")
+    args = parser.parse_args()
+
+    runs = read_runs(args.dump)
+    if args.json:
+        output = {"runs": runs, "summary": summary(runs)}
+        if args.baseline:
+            output["baseline"] = summary(read_runs(args.baseline))
+        print(json.dumps(output, indent=2))
+        return
+
+    print_csv(runs)
+    if args.baseline:
+        print_comparison(runs, read_runs(args.baseline))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""
+record_decode.py
+
+Decodes record_log dumps from the OpenSolder firmware (see Core/Inc/record.h) into one CSV line
+per reading. Several dumps taken while the MCU runs are joined on the record sequence numbers,
+and readings that were overwritten between two dumps are reported as gaps.
+
+Dump the buffer with the debugger, e.g. in gdb:
+    dump binary value record.bin record_log
+
+Usage:
+    record_decode.py record1.bin [record2.bin ...] [--samples] [--save session.bin]
+
+--save writes the joined session as a flat file of records (RECORD_FORMAT, sequence first),
+which host/build/opensolder_replay replays through the firmware (host/sim/replay.h).
+
+License: GPL-3.0 or any later version
+Copyright (c) 2022 Håvard Jakobsen
+"""
+
+import argparse
+import struct
+import sys
+
+RECORD_MAGIC = 0x52435244
+RECORD_LENGTH = 16
+ADC_BUFFER_LENGTH = 50
+
+# Keep in sync with record_entry in Core/Inc/record.h
+RECORD_FORMAT = "<IHHBBBB%dH" % ADC_BUFFER_LENGTH
+FLAG_HOLDER = 0x01
+FLAG_TIP_CHANGE = 0x02
+FLAG_BUTTON = 0x04
+FLAG_TIP_CHECK = 0x80
+
+# Keep in sync with enum opensolder_messages in Core/Inc/opensolder.h
+TIP_STATES = {3: "DETECTED", 4: "NOT_DETECTED", 5: "CHECK_ERROR"}
+
+
+def read_records(path):
+    data = open(path, "rb").read()
+    magic, head = struct.unpack_from("<II", data, 0)
+    if magic != RECORD_MAGIC:
+        sys.exit("%s: not a record_log dump (magic 0x%08x)" % (path, magic))
+
+    size = struct.calcsize(RECORD_FORMAT)
+    # The oldest entry is skipped, it may be half overwritten in a dump taken while the MCU runs
+    records = {}
+    for sequence in range(max(0, head - RECORD_LENGTH + 1), head):
+        values = struct.unpack_from(RECORD_FORMAT, data, 8 + (sequence % RECORD_LENGTH) * size)
+        records[sequence] = values
+    return records
+
+
+def print_records(records, samples):
+    print("sequence,zc_us,zc_delta_us,tip_temp,on_periods,tip_state,tip_check,holder,tip_change,button,encoder,sample_count,min,max,mean" + (",samples" if samples else ""))
+    previous_sequence = None
+    previous_zc = None
+    for sequence in sorted(records):
+        zc_us, tip_temp, encoder, count, on_periods, tip_state, flags = records[sequence][:7]
+        raw = records[sequence][7 : 7 + count]
+        if previous_sequence is not None and sequence != previous_sequence + 1:
+            print("# gap: %d records lost" % (sequence - previous_sequence - 1))
+            previous_zc = None
+        delta = (zc_us - previous_zc) & 0xFFFFFFFF if previous_zc is not None else ""
+        line = [
+            sequence,
+            zc_us,
+            delta,
+            tip_temp,
+            on_periods,
+            TIP_STATES.get(tip_state, tip_state),
+            int(bool(flags & FLAG_TIP_CHECK)),
+            int(bool(flags & FLAG_HOLDER)),
+            int(bool(flags & FLAG_TIP_CHANGE)),
+            int(bool(flags & FLAG_BUTTON)),
+            encoder,
+            count,
+            min(raw) if raw else "",
+            max(raw) if raw else "",
+            "%.1f" % (sum(raw) / count) if raw else "",
+        ]
+        if samples:
+            line.append(" ".join(str(sample) for sample in raw))
+        print(",".join(str(value) for value in line))
+        previous_sequence = sequence
+        previous_zc = zc_us
+
+
+def save_session(path, records):
+    with open(path, "wb") as session:
+        for sequence in sorted(records):
+            session.write(struct.pack("<I", sequence) + struct.pack(RECORD_FORMAT, *records[sequence]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode OpenSolder record_log dumps")
+    parser.add_argument("dumps", nargs="+", help="binary dumps of record_log, in the order they were taken")
+    parser.add_argument("--samples", action="store_true", help="include the raw thermocouple samples")
+    parser.add_argument("--save", help="write the joined session to this file")
+    args = parser.parse_args()
+
+    records = {}
+    for path in args.dumps:
+        records.update(read_records(path))
+
+    print_records(records, args.samples)
+    if args.save:
+        save_session(args.save, records)
+
+
+if __name__ == "__main__":
+    main()
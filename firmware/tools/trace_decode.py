@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""
+trace_decode.py
+
+Decodes a trace_log dump from the OpenSolder firmware (see Core/Inc/trace.h) into a
+timeline and latency histograms between related events.
+
+Dump the buffer with the debugger while the MCU is halted, e.g. in gdb:
+    dump binary value trace.bin trace_log
+
+Usage:
+    trace_decode.py trace.bin [--timeline] [--bin-us 5]
+
+License: GPL-3.0 or any later version
+Copyright (c) 2022 Håvard Jakobsen
+"""
+
+import argparse
+import struct
+import sys
+
+TRACE_MAGIC = 0x54524345
+TRACE_LENGTH = 256
+
+# Keep in sync with enum trace_events in Core/Inc/trace.h
+EVENTS = {
+    1: "ZC_EDGE",
+    2: "TIM6",
+    3: "HEATER_ON",
+    4: "HEATER_OFF",
+    5: "CLAMP_RELEASE",
+    6: "ADC_START",
+    7: "ADC_COMPLETE",
+    8: "STATE",
+    9: "DISPLAY_BEGIN",
+    10: "DISPLAY_END",
+    11: "INVARIANT",
+    12: "STATE_EXIT",
+    13: "STATE_ENTRY",
+}
+
+STATES = ["INIT", "TIP_CHANGE", "OFF", "ON", "STANDBY", "ERROR", "TIP_PRESENT", "RUN"]
+
+# Latency is measured from the first event to the next occurrence of the second event
+LATENCY_PAIRS = [
+    ("ZC_EDGE", "TIM6"),
+    ("TIM6", "HEATER_ON"),
+    ("TIM6", "HEATER_OFF"),
+    ("HEATER_OFF", "CLAMP_RELEASE"),
+    ("CLAMP_RELEASE", "ADC_START"),
+    ("ADC_START", "ADC_COMPLETE"),
+    ("DISPLAY_BEGIN", "DISPLAY_END"),
+]
+
+
+def read_trace(path):
+    data = open(path, "rb").read()
+    magic, head = struct.unpack_from("<II", data, 0)
+    if magic != TRACE_MAGIC:
+        sys.exit("%s: not a trace_log dump (magic 0x%08x)" % (path, magic))
+
+    entries = struct.unpack_from("<%dI" % TRACE_LENGTH, data, 8)
+    count = min(head, TRACE_LENGTH)
+    first = head - count
+    ordered = [entries[i % TRACE_LENGTH] for i in range(first, head)]
+
+    # Unwrap the 16 bit timestamps, assumes less than 65ms between two events
+    events = []
+    time_us = 0
+    previous = None
+    for word in ordered:
+        stamp = word & 0xFFFF
+        if previous is not None:
+            time_us += (stamp - previous) & 0xFFFF
+        previous = stamp
+        events.append((time_us, EVENTS.get((word >> 16) & 0xFF, "UNKNOWN"), word >> 24))
+    return events, head
+
+
+def state_name(state):
+    return STATES[state] if state < len(STATES) else "NONE"
+
+
+def state_change(data):
+    # Previous state in the upper nibble, new state in the lower nibble
+    return "%s -> %s" % (state_name(data >> 4), state_name(data & 0x0F))
+
+
+def print_timeline(events):
+    previous_time = 0
+    for time_us, name, data in events:
+        if name == "STATE":
+            detail = state_change(data)
+        elif name in ("STATE_EXIT", "STATE_ENTRY"):
+            detail = state_name(data)
+        else:
+            detail = data
+        print("%10d us  +%6d  %-14s %s" % (time_us, time_us - previous_time, name, detail))
+        previous_time = time_us
+
+
+def latencies(events, start, end):
+    result = []
+    start_time = None
+    for time_us, name, _ in events:
+        if name == start:
+            start_time = time_us
+        elif name == end and start_time is not None:
+            result.append(time_us - start_time)
+            start_time = None
+    return result
+
+
+def print_histogram(title, values, bin_us):
+    print("\n%s: %d samples" % (title, len(values)))
+    if not values:
+        return
+    print("  min %d us, max %d us, mean %.1f us" % (min(values), max(values), sum(values) / len(values)))
+
+    bins = {}
+    for value in values:
+        bins[value // bin_us] = bins.get(value // bin_us, 0) + 1
+    largest = max(bins.values())
+    for index in sorted(bins):
+        bar = "#" * max(1, bins[index] * 40 // largest)
+        print("  %6d-%-6d us %5d %s" % (index * bin_us, (index + 1) * bin_us - 1, bins[index], bar))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode an OpenSolder trace_log dump")
+    parser.add_argument("dump", help="binary dump of trace_log")
+    parser.add_argument("--timeline", action="store_true", help="print every event")
+    parser.add_argument("--bin-us", type=int, default=5, help="histogram bin width in us")
+    args = parser.parse_args()
+
+    events, head = read_trace(args.dump)
+    print("%d events logged, %d in buffer, %d us covered" % (head, len(events), events[-1][0] if events else 0))
+
+    if args.timeline:
+        print_timeline(events)
+
+    for start, end in LATENCY_PAIRS:
+        print_histogram("%s -> %s" % (start, end), latencies(events, start, end), args.bin_us)
+
+
+if __name__ == "__main__":
+    main()